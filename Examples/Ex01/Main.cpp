@@ -93,6 +93,23 @@ int main(int, char**)
         ima.strokeRect(20, 20, 200, 200, skPalette::Black);
         ima.save("test2.jpg");
     }
+    {
+        const skImage ima(512, 512, SK_RGBA);
+        ima.clear(skPalette::Grey09);
+
+        const skPointf star[5] = {
+            {256, 56},
+            {374, 418},
+            {66, 194},
+            {446, 194},
+            {138, 418},
+        };
+
+        ima.fillPolygon(star, 5, skPalette::Blue, SK_FILL_NON_ZERO, SK_AA_4X);
+        ima.fillCircle(256, 256, 64, skPalette::Orange, SK_AA_8X);
+        ima.fillTriangle({20, 500}, {120, 500}, {70, 420}, skPalette::Green);
+        ima.save("test3.png");
+    }
     skImage::finalize();
     return 0;
 }
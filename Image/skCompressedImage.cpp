@@ -0,0 +1,693 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Image/skCompressedImage.h"
+#include "Image/skImage.h"
+#include "Image/skImageUtils.h"
+#include "Image/skParallel.h"
+#include "Utils/skMinMax.h"
+
+
+static SKuint16 pack565(const SKint32 r, const SKint32 g, const SKint32 b)
+{
+    return (SKuint16)(((r * 31 + 127) / 255) << 11 |
+                      ((g * 63 + 127) / 255) << 5 |
+                      (b * 31 + 127) / 255);
+}
+
+static void unpack565(SKint32 col[3], const SKuint16 c)
+{
+    const SKint32 r = c >> 11, g = (c >> 5) & 63, b = c & 31;
+
+    col[0] = r << 3 | r >> 2;
+    col[1] = g << 2 | g >> 4;
+    col[2] = b << 3 | b >> 2;
+}
+
+static void colorPalette(SKint32 pal[4][3], const SKuint16 c0, const SKuint16 c1, const bool four)
+{
+    unpack565(pal[0], c0);
+    unpack565(pal[1], c1);
+
+    for (SKuint32 k = 0; k < 3; ++k)
+    {
+        if (four)
+        {
+            pal[2][k] = (2 * pal[0][k] + pal[1][k]) / 3;
+            pal[3][k] = (pal[0][k] + 2 * pal[1][k]) / 3;
+        }
+        else
+        {
+            pal[2][k] = (pal[0][k] + pal[1][k]) / 2;
+            pal[3][k] = 0;
+        }
+    }
+}
+
+// Picks the nearest palette entry for every pixel and returns the
+// summed squared error. Pixels in the transparent mask take index 3.
+static SKuint32 colorIndices(const SKubyte px[16][4],
+                             const SKuint32 transparent,
+                             const SKuint16 c0,
+                             const SKuint16 c1,
+                             const bool     four,
+                             SKuint32&      indices)
+{
+    SKint32 pal[4][3];
+    colorPalette(pal, c0, c1, four);
+
+    // Equal endpoints read back as the three color mode in BC1.
+    const SKuint32 n = c0 == c1 ? 1 : four ? 4 : 3;
+
+    SKuint32 error = 0;
+    indices        = 0;
+
+    for (SKuint32 i = 0; i < 16; ++i)
+    {
+        if (transparent & (1 << i))
+        {
+            indices |= 3u << (2 * i);
+            continue;
+        }
+
+        SKuint32 best = 0, bestDist = 0xFFFFFFFF;
+        for (SKuint32 j = 0; j < n; ++j)
+        {
+            const SKint32 dr = px[i][0] - pal[j][0];
+            const SKint32 dg = px[i][1] - pal[j][1];
+            const SKint32 db = px[i][2] - pal[j][2];
+
+            const SKuint32 d = (SKuint32)(dr * dr + dg * dg + db * db);
+            if (d < bestDist)
+            {
+                bestDist = d;
+                best     = j;
+            }
+        }
+
+        indices |= best << (2 * i);
+        error += bestDist;
+    }
+    return error;
+}
+
+struct skColorBlock
+{
+    SKuint16 c0, c1;
+    SKuint32 indices;
+    SKuint32 error;
+};
+
+static void evaluateColor(skColorBlock&  best,
+                          const SKubyte  px[16][4],
+                          const SKuint32 transparent,
+                          SKuint16       c0,
+                          SKuint16       c1)
+{
+    // Four color blocks need c0 > c1, three color blocks c0 <= c1.
+    const bool four = transparent == 0;
+    if (four ? c0 < c1 : c0 > c1)
+        skSwap(c0, c1);
+
+    SKuint32       indices;
+    const SKuint32 error = colorIndices(px, transparent, c0, c1, four, indices);
+    if (error < best.error)
+    {
+        best.c0      = c0;
+        best.c1      = c1;
+        best.indices = indices;
+        best.error   = error;
+    }
+}
+
+// Least squares endpoints for the current index assignment.
+static bool refineColor(const skColorBlock& block,
+                        const SKubyte       px[16][4],
+                        const SKuint32      transparent,
+                        SKuint16&           c0,
+                        SKuint16&           c1)
+{
+    static const float Weights4[4] = {1.f, 0.f, 2.f / 3.f, 1.f / 3.f};
+    static const float Weights3[4] = {1.f, 0.f, 0.5f, 0.f};
+
+    const float* weights = transparent == 0 ? Weights4 : Weights3;
+
+    float aa = 0, bb = 0, ab = 0;
+    float ax[3] = {0, 0, 0}, bx[3] = {0, 0, 0};
+
+    for (SKuint32 i = 0; i < 16; ++i)
+    {
+        if (transparent & (1 << i))
+            continue;
+
+        const float a = weights[(block.indices >> (2 * i)) & 3];
+        const float b = 1.f - a;
+
+        aa += a * a;
+        bb += b * b;
+        ab += a * b;
+        for (SKuint32 k = 0; k < 3; ++k)
+        {
+            ax[k] += a * px[i][k];
+            bx[k] += b * px[i][k];
+        }
+    }
+
+    const float det = aa * bb - ab * ab;
+    if (det < 1e-6f)
+        return false;
+
+    SKint32 e0[3], e1[3];
+    for (SKuint32 k = 0; k < 3; ++k)
+    {
+        e0[k] = skClamp<SKint32>((SKint32)((ax[k] * bb - bx[k] * ab) / det + 0.5f), 0, 255);
+        e1[k] = skClamp<SKint32>((SKint32)((bx[k] * aa - ax[k] * ab) / det + 0.5f), 0, 255);
+    }
+
+    c0 = pack565(e0[0], e0[1], e0[2]);
+    c1 = pack565(e1[0], e1[1], e1[2]);
+    return true;
+}
+
+// Endpoints at the extremes of the principal axis of the colors.
+static void principalColor(const SKubyte  px[16][4],
+                           const SKuint32 transparent,
+                           SKuint16&      c0,
+                           SKuint16&      c1)
+{
+    float    mean[3] = {0, 0, 0};
+    SKuint32 n       = 0;
+
+    for (SKuint32 i = 0; i < 16; ++i)
+    {
+        if (transparent & (1 << i))
+            continue;
+        for (SKuint32 k = 0; k < 3; ++k)
+            mean[k] += px[i][k];
+        ++n;
+    }
+    for (SKuint32 k = 0; k < 3; ++k)
+        mean[k] /= (float)n;
+
+    float cov[6] = {0, 0, 0, 0, 0, 0};
+    for (SKuint32 i = 0; i < 16; ++i)
+    {
+        if (transparent & (1 << i))
+            continue;
+
+        const float r = px[i][0] - mean[0];
+        const float g = px[i][1] - mean[1];
+        const float b = px[i][2] - mean[2];
+
+        cov[0] += r * r;
+        cov[1] += r * g;
+        cov[2] += r * b;
+        cov[3] += g * g;
+        cov[4] += g * b;
+        cov[5] += b * b;
+    }
+
+    // Power iteration, starting from the luminance direction.
+    float axis[3] = {0.299f, 0.587f, 0.114f};
+    for (SKuint32 it = 0; it < 8; ++it)
+    {
+        const float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        const float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        const float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+
+        const float m = skMax(skMax(skABS(x), skABS(y)), skABS(z));
+        if (m < 1e-6f)
+            break;
+
+        axis[0] = x / m;
+        axis[1] = y / m;
+        axis[2] = z / m;
+    }
+
+    float    lo = 1e30f, hi = -1e30f;
+    SKuint32 iLo = 0, iHi = 0;
+    for (SKuint32 i = 0; i < 16; ++i)
+    {
+        if (transparent & (1 << i))
+            continue;
+
+        const float t = px[i][0] * axis[0] + px[i][1] * axis[1] + px[i][2] * axis[2];
+        if (t < lo)
+        {
+            lo  = t;
+            iLo = i;
+        }
+        if (t > hi)
+        {
+            hi  = t;
+            iHi = i;
+        }
+    }
+
+    c0 = pack565(px[iHi][0], px[iHi][1], px[iHi][2]);
+    c1 = pack565(px[iLo][0], px[iLo][1], px[iLo][2]);
+}
+
+static void encodeColorBlock(SKubyte*      dst,
+                             const SKubyte px[16][4],
+                             const bool    quality,
+                             const bool    punchThrough)
+{
+    SKuint32 transparent = 0;
+    if (punchThrough)
+    {
+        for (SKuint32 i = 0; i < 16; ++i)
+        {
+            if (px[i][3] < 128)
+                transparent |= 1 << i;
+        }
+    }
+
+    skColorBlock best = {0, 0, 0xFFFFFFFF, 0xFFFFFFFF};
+
+    if (transparent != 0xFFFF)
+    {
+        // Bounding box endpoints, inset by 1/16 of the range.
+        SKint32 lo[3] = {255, 255, 255}, hi[3] = {0, 0, 0};
+        for (SKuint32 i = 0; i < 16; ++i)
+        {
+            if (transparent & (1 << i))
+                continue;
+            for (SKuint32 k = 0; k < 3; ++k)
+            {
+                lo[k] = skMin<SKint32>(lo[k], px[i][k]);
+                hi[k] = skMax<SKint32>(hi[k], px[i][k]);
+            }
+        }
+        for (SKuint32 k = 0; k < 3; ++k)
+        {
+            const SKint32 inset = (hi[k] - lo[k]) >> 4;
+            lo[k] += inset;
+            hi[k] -= inset;
+        }
+
+        evaluateColor(best, px, transparent, pack565(hi[0], hi[1], hi[2]), pack565(lo[0], lo[1], lo[2]));
+
+        if (quality)
+        {
+            SKuint16 c0, c1;
+            principalColor(px, transparent, c0, c1);
+            evaluateColor(best, px, transparent, c0, c1);
+
+            for (SKuint32 it = 0; it < 2 && best.error > 0; ++it)
+            {
+                if (!refineColor(best, px, transparent, c0, c1))
+                    break;
+                evaluateColor(best, px, transparent, c0, c1);
+            }
+        }
+    }
+
+    dst[0] = (SKubyte)best.c0;
+    dst[1] = (SKubyte)(best.c0 >> 8);
+    dst[2] = (SKubyte)best.c1;
+    dst[3] = (SKubyte)(best.c1 >> 8);
+    dst[4] = (SKubyte)best.indices;
+    dst[5] = (SKubyte)(best.indices >> 8);
+    dst[6] = (SKubyte)(best.indices >> 16);
+    dst[7] = (SKubyte)(best.indices >> 24);
+}
+
+static void alphaPalette(SKint32 pal[8], const SKint32 a0, const SKint32 a1)
+{
+    pal[0] = a0;
+    pal[1] = a1;
+
+    if (a0 > a1)
+    {
+        for (SKint32 i = 1; i < 7; ++i)
+            pal[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+    }
+    else
+    {
+        for (SKint32 i = 1; i < 5; ++i)
+            pal[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+        pal[6] = 0;
+        pal[7] = 255;
+    }
+}
+
+static SKuint32 alphaIndices(const SKubyte v[16], const SKint32 a0, const SKint32 a1, SKuint64& indices)
+{
+    SKint32 pal[8];
+    alphaPalette(pal, a0, a1);
+
+    SKuint32 error = 0;
+    indices        = 0;
+
+    for (SKuint32 i = 0; i < 16; ++i)
+    {
+        SKuint32 best = 0, bestDist = 0xFFFFFFFF;
+        for (SKuint32 j = 0; j < 8; ++j)
+        {
+            const SKint32  d    = v[i] - pal[j];
+            const SKuint32 dist = (SKuint32)(d * d);
+            if (dist < bestDist)
+            {
+                bestDist = dist;
+                best     = j;
+            }
+        }
+
+        indices |= (SKuint64)best << (3 * i);
+        error += bestDist;
+    }
+    return error;
+}
+
+static void encodeAlphaBlock(SKubyte* dst, const SKubyte v[16], const bool quality)
+{
+    SKint32 lo = 255, hi = 0;
+    SKint32 lo6 = 255, hi6 = 0;
+
+    for (SKuint32 i = 0; i < 16; ++i)
+    {
+        lo = skMin<SKint32>(lo, v[i]);
+        hi = skMax<SKint32>(hi, v[i]);
+
+        if (v[i] != 0 && v[i] != 255)
+        {
+            lo6 = skMin<SKint32>(lo6, v[i]);
+            hi6 = skMax<SKint32>(hi6, v[i]);
+        }
+    }
+
+    SKint32  a0 = hi, a1 = lo;
+    SKuint64 indices;
+    SKuint32 error = alphaIndices(v, a0, a1, indices);
+
+    if (quality && error > 0)
+    {
+        // Pull the eight value endpoints inwards, then try the six
+        // value mode that has exact 0 and 255.
+        for (SKint32 d0 = 0; d0 < 4; ++d0)
+        {
+            for (SKint32 d1 = 0; d1 < 4; ++d1)
+            {
+                const SKint32 b0 = hi - d0, b1 = lo + d1;
+                if (b0 <= b1)
+                    continue;
+
+                SKuint64       idx;
+                const SKuint32 err = alphaIndices(v, b0, b1, idx);
+                if (err < error)
+                {
+                    a0      = b0;
+                    a1      = b1;
+                    indices = idx;
+                    error   = err;
+                }
+            }
+        }
+
+        if (lo6 > hi6)
+            lo6 = hi6 = lo;
+
+        SKuint64       idx;
+        const SKuint32 err = alphaIndices(v, lo6, hi6, idx);
+        if (err < error)
+        {
+            a0      = lo6;
+            a1      = hi6;
+            indices = idx;
+        }
+    }
+
+    dst[0] = (SKubyte)a0;
+    dst[1] = (SKubyte)a1;
+    for (SKuint32 i = 0; i < 6; ++i)
+        dst[2 + i] = (SKubyte)(indices >> (8 * i));
+}
+
+static void decodeColorBlock(SKubyte px[16][4], const SKubyte* src, const bool bc1)
+{
+    const SKuint16 c0 = (SKuint16)(src[0] | src[1] << 8);
+    const SKuint16 c1 = (SKuint16)(src[2] | src[3] << 8);
+
+    const SKuint32 indices = (SKuint32)src[4] |
+                             (SKuint32)src[5] << 8 |
+                             (SKuint32)src[6] << 16 |
+                             (SKuint32)src[7] << 24;
+
+    const bool four = !bc1 || c0 > c1;
+
+    SKint32 pal[4][3];
+    colorPalette(pal, c0, c1, four);
+
+    for (SKuint32 i = 0; i < 16; ++i)
+    {
+        const SKuint32 j = (indices >> (2 * i)) & 3;
+
+        px[i][0] = (SKubyte)pal[j][0];
+        px[i][1] = (SKubyte)pal[j][1];
+        px[i][2] = (SKubyte)pal[j][2];
+        px[i][3] = !four && j == 3 ? 0 : 255;
+    }
+}
+
+static void decodeAlphaBlock(SKubyte px[16][4], const SKuint32 channel, const SKubyte* src)
+{
+    SKint32 pal[8];
+    alphaPalette(pal, src[0], src[1]);
+
+    SKuint64 indices = 0;
+    for (SKuint32 i = 0; i < 6; ++i)
+        indices |= (SKuint64)src[2 + i] << (8 * i);
+
+    for (SKuint32 i = 0; i < 16; ++i)
+        px[i][channel] = (SKubyte)pal[(indices >> (3 * i)) & 7];
+}
+
+
+skCompressedImage::skCompressedImage() :
+    m_width(0),
+    m_height(0),
+    m_format(SK_BC1),
+    m_bytes(nullptr),
+    m_size(0)
+{
+}
+
+skCompressedImage::~skCompressedImage()
+{
+    delete[] m_bytes;
+}
+
+SKuint32 skCompressedImage::getBlockSize(const skBlockFormat& format)
+{
+    return format == SK_BC1 || format == SK_BC4 ? 8 : 16;
+}
+
+bool skCompressedImage::compress(const skImage& image, const skBlockFormat format, const skBlockQuality quality)
+{
+    if (!image.getBytes() || image.getWidth() == 0 || image.getHeight() == 0)
+        return false;
+
+    SKint32 offs[SK_CHANNEL_MAX];
+    if (!ImageUtils::getChannelOffsets(image.getFormat(), offs))
+    {
+        skImage* rgba = image.convertToFormat(SK_RGBA);
+        if (!rgba)
+            return false;
+
+        const bool result = compress(*rgba, format, quality);
+        delete rgba;
+        return result;
+    }
+
+    // Luminance has no alpha; the offsets alias it to the gray value.
+    if (image.getFormat() == SK_LUMINANCE)
+        offs[3] = -1;
+
+    delete[] m_bytes;
+
+    m_width  = image.getWidth();
+    m_height = image.getHeight();
+    m_format = format;
+
+    const SKuint32 blocksX   = getBlocksX();
+    const SKuint32 blocksY   = getBlocksY();
+    const SKuint32 blockSize = getBlockSize(format);
+
+    m_size  = (SKsize)blocksX * blocksY * blockSize;
+    m_bytes = new SKubyte[m_size];
+
+    const SKuint32 w   = m_width;
+    const SKuint32 h   = m_height;
+    const SKuint32 bpp = image.getBPP();
+    const bool     hq  = quality == SK_BLOCK_QUALITY;
+
+    skParallel::forRange(
+        blocksY,
+        1,
+        [&](const SKuint32 by0, const SKuint32 by1)
+        {
+            SKubyte px[16][4];
+            SKubyte v[16];
+
+            for (SKuint32 by = by0; by < by1; ++by)
+            {
+                SKubyte* dst = m_bytes + (SKsize)by * blocksX * blockSize;
+
+                // Rows and columns past the edge repeat the last one.
+                const SKubyte* rows[4];
+                for (SKuint32 j = 0; j < 4; ++j)
+                {
+                    const SKuint32 y = skMin(by * 4 + j, h - 1);
+                    rows[j]          = image.getBytes() + (SKsize)(image.isFlipY() ? h - 1 - y : y) * image.getPitch();
+                }
+
+                for (SKuint32 bx = 0; bx < blocksX; ++bx, dst += blockSize)
+                {
+                    for (SKuint32 i = 0; i < 16; ++i)
+                    {
+                        const SKuint32 x = skMin(bx * 4 + (i & 3), w - 1);
+                        const SKubyte* p = rows[i >> 2] + (SKsize)x * bpp;
+
+                        px[i][0] = p[offs[0]];
+                        px[i][1] = p[offs[1]];
+                        px[i][2] = p[offs[2]];
+                        px[i][3] = offs[3] < 0 ? 255 : p[offs[3]];
+                    }
+
+                    switch (format)
+                    {
+                    case SK_BC1:
+                        encodeColorBlock(dst, px, hq, true);
+                        break;
+                    case SK_BC3:
+                        for (SKuint32 i = 0; i < 16; ++i)
+                            v[i] = px[i][3];
+                        encodeAlphaBlock(dst, v, hq);
+                        encodeColorBlock(dst + 8, px, hq, false);
+                        break;
+                    case SK_BC4:
+                    case SK_BC5:
+                        for (SKuint32 i = 0; i < 16; ++i)
+                            v[i] = px[i][0];
+                        encodeAlphaBlock(dst, v, hq);
+                        if (format == SK_BC5)
+                        {
+                            for (SKuint32 i = 0; i < 16; ++i)
+                                v[i] = px[i][1];
+                            encodeAlphaBlock(dst + 8, v, hq);
+                        }
+                        break;
+                    }
+                }
+            }
+        },
+        (SKsize)w * h >= SK_IMAGE_PARALLEL_MIN ? 0 : 1);
+    return true;
+}
+
+skImage* skCompressedImage::decompress() const
+{
+    if (!m_bytes)
+        return nullptr;
+
+    skPixelFormat fmt;
+    switch (m_format)
+    {
+    case SK_BC4:
+        fmt = SK_LUMINANCE;
+        break;
+    case SK_BC5:
+        fmt = SK_RGB;
+        break;
+    default:
+        fmt = SK_RGBA;
+        break;
+    }
+
+    skImage* img = new skImage(m_width, m_height, fmt);
+    if (!img->getBytes())
+    {
+        delete img;
+        return nullptr;
+    }
+
+    SKint32 offs[SK_CHANNEL_MAX];
+    ImageUtils::getChannelOffsets(fmt, offs);
+
+    const SKuint32 blocksX   = getBlocksX();
+    const SKuint32 blockSize = getBlockSize(m_format);
+    const SKuint32 bpp       = img->getBPP();
+    const SKuint32 channels  = fmt == SK_RGBA ? 4 : fmt == SK_RGB ? 3 : 1;
+
+    skParallel::forRange(
+        getBlocksY(),
+        1,
+        [&](const SKuint32 by0, const SKuint32 by1)
+        {
+            SKubyte px[16][4];
+
+            for (SKuint32 by = by0; by < by1; ++by)
+            {
+                const SKubyte* src = m_bytes + (SKsize)by * blocksX * blockSize;
+
+                for (SKuint32 bx = 0; bx < blocksX; ++bx, src += blockSize)
+                {
+                    switch (m_format)
+                    {
+                    case SK_BC1:
+                        decodeColorBlock(px, src, true);
+                        break;
+                    case SK_BC3:
+                        decodeColorBlock(px, src + 8, false);
+                        decodeAlphaBlock(px, 3, src);
+                        break;
+                    case SK_BC4:
+                        decodeAlphaBlock(px, 0, src);
+                        break;
+                    case SK_BC5:
+                        decodeAlphaBlock(px, 0, src);
+                        decodeAlphaBlock(px, 1, src + 8);
+                        for (SKuint32 i = 0; i < 16; ++i)
+                            px[i][2] = 0;
+                        break;
+                    }
+
+                    for (SKuint32 i = 0; i < 16; ++i)
+                    {
+                        const SKuint32 x = bx * 4 + (i & 3);
+                        const SKuint32 y = by * 4 + (i >> 2);
+                        if (x >= m_width || y >= m_height)
+                            continue;
+
+                        SKubyte* p = img->getBytes() +
+                                     (SKsize)(img->isFlipY() ? m_height - 1 - y : y) * img->getPitch() +
+                                     (SKsize)x * bpp;
+
+                        for (SKuint32 k = 0; k < channels; ++k)
+                            p[offs[k]] = px[i][k];
+                    }
+                }
+            }
+        },
+        (SKsize)m_width * m_height >= SK_IMAGE_PARALLEL_MIN ? 0 : 1);
+    return img;
+}
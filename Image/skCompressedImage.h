@@ -0,0 +1,95 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _skCompressedImage_h_
+#define _skCompressedImage_h_
+
+#include "Image/skImageTypes.h"
+#include "Utils/Config/skConfig.h"
+
+class skImage;
+
+// Holds an image encoded as 4x4 BCn blocks, stored row by row from
+// the top of the image, ready to upload as a GPU texture.
+class skCompressedImage
+{
+private:
+    SKuint32      m_width;
+    SKuint32      m_height;
+    skBlockFormat m_format;
+    SKubyte*      m_bytes;
+    SKsize        m_size;
+
+public:
+    skCompressedImage();
+    ~skCompressedImage();
+
+    skCompressedImage(const skCompressedImage& rhs) = delete;
+    skCompressedImage& operator=(const skCompressedImage& rhs) = delete;
+
+    SKuint32 getWidth() const
+    {
+        return m_width;
+    }
+
+    SKuint32 getHeight() const
+    {
+        return m_height;
+    }
+
+    SKuint32 getBlocksX() const
+    {
+        return (m_width + 3) >> 2;
+    }
+
+    SKuint32 getBlocksY() const
+    {
+        return (m_height + 3) >> 2;
+    }
+
+    skBlockFormat getFormat() const
+    {
+        return m_format;
+    }
+
+    const SKubyte* getBytes() const
+    {
+        return m_bytes;
+    }
+
+    SKsize getSizeInBytes() const
+    {
+        return m_size;
+    }
+
+    // BC1 and BC3 read r, g, b and a, BC4 reads r and BC5 reads r and g.
+    bool compress(const skImage& image,
+                  skBlockFormat  format,
+                  skBlockQuality quality = SK_BLOCK_FAST);
+
+    // Returns SK_RGBA for BC1 and BC3, SK_LUMINANCE for BC4
+    // and SK_RGB, with b set to zero, for BC5.
+    skImage* decompress() const;
+
+    static SKuint32 getBlockSize(const skBlockFormat& format);
+};
+
+#endif  //_skCompressedImage_h_
@@ -0,0 +1,311 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Image/skDrawList.h"
+#include <math.h>
+#include "Image/skImage.h"
+#include "Image/skParallel.h"
+#include "Image/skRasterizer.h"
+#include "Utils/skMinMax.h"
+
+const SKint32 MaxCoord = 0x7FFFFFFF;
+
+skDrawList::skDrawList() :
+    m_tileWidth(128),
+    m_tileHeight(64)
+{
+}
+
+skDrawList::~skDrawList() = default;
+
+void skDrawList::setTileSize(const SKuint32 width, const SKuint32 height)
+{
+    m_tileWidth  = skMax<SKuint32>(width, 8);
+    m_tileHeight = skMax<SKuint32>(height, 8);
+}
+
+void skDrawList::reset()
+{
+    m_commands.clear();
+    m_points.clear();
+}
+
+skDrawList::Command& skDrawList::push(const CommandType type, const skPixel& col)
+{
+    Command cmd = {};
+    cmd.type    = type;
+    cmd.color   = col;
+    cmd.aa      = SK_AA_NONE;
+    cmd.rule    = SK_FILL_EVEN_ODD;
+
+    m_commands.push_back(cmd);
+    return m_commands.back();
+}
+
+void skDrawList::clear(const skPixel& col)
+{
+    Command& cmd = push(CT_CLEAR, col);
+    cmd.x0       = 0;
+    cmd.y0       = 0;
+    cmd.x1       = MaxCoord;
+    cmd.y1       = MaxCoord;
+}
+
+void skDrawList::fillRect(const SKint32  x,
+                          const SKint32  y,
+                          const SKint32  width,
+                          const SKint32  height,
+                          const skPixel& col)
+{
+    if (width <= 0 || height <= 0)
+        return;
+
+    Command& cmd = push(CT_FILL_RECT, col);
+    cmd.i[0]     = x;
+    cmd.i[1]     = y;
+    cmd.i[2]     = width;
+    cmd.i[3]     = height;
+    cmd.x0       = x;
+    cmd.y0       = y;
+    cmd.x1       = (SKint32)skMin<SKint64>((SKint64)x + width, MaxCoord);
+    cmd.y1       = (SKint32)skMin<SKint64>((SKint64)y + height, MaxCoord);
+}
+
+void skDrawList::strokeRect(const SKint32  x,
+                            const SKint32  y,
+                            const SKint32  width,
+                            const SKint32  height,
+                            const skPixel& col)
+{
+    const SKint32 x2 = x + width;
+    const SKint32 y2 = y + height;
+
+    lineTo(x, y, x2, y, col);
+    lineTo(x2, y, x2, y2, col);
+    lineTo(x2, y2, x, y2, col);
+    lineTo(x, y2, x, y, col);
+}
+
+void skDrawList::lineTo(const SKint32  x1,
+                        const SKint32  y1,
+                        const SKint32  x2,
+                        const SKint32  y2,
+                        const skPixel& col)
+{
+    Command& cmd = push(CT_LINE, col);
+    cmd.i[0]     = x1;
+    cmd.i[1]     = y1;
+    cmd.i[2]     = x2;
+    cmd.i[3]     = y2;
+    cmd.x0       = skMin(x1, x2);
+    cmd.y0       = skMin(y1, y2);
+    cmd.x1       = skMax(x1, x2) + 1;
+    cmd.y1       = skMax(y1, y2) + 1;
+}
+
+void skDrawList::fillPolygon(const skPointf*   points,
+                             const SKuint32    count,
+                             const skPixel&    col,
+                             const skFillRule  rule,
+                             const skAntiAlias aa)
+{
+    if (!points || count < 3)
+        return;
+
+    Command& cmd = push(CT_POLYGON, col);
+    cmd.rule     = rule;
+    cmd.aa       = aa;
+    cmd.first    = (SKuint32)m_points.size();
+    cmd.count    = count;
+
+    float xMin = points[0].x, xMax = points[0].x;
+    float yMin = points[0].y, yMax = points[0].y;
+
+    for (SKuint32 i = 0; i < count; ++i)
+    {
+        m_points.push_back(points[i]);
+
+        xMin = skMin(xMin, points[i].x);
+        xMax = skMax(xMax, points[i].x);
+        yMin = skMin(yMin, points[i].y);
+        yMax = skMax(yMax, points[i].y);
+    }
+
+    cmd.x0 = (SKint32)floorf(xMin);
+    cmd.y0 = (SKint32)floorf(yMin);
+    cmd.x1 = (SKint32)ceilf(xMax) + 1;
+    cmd.y1 = (SKint32)ceilf(yMax) + 1;
+}
+
+void skDrawList::fillTriangle(const skPointf&   a,
+                              const skPointf&   b,
+                              const skPointf&   c,
+                              const skPixel&    col,
+                              const skAntiAlias aa)
+{
+    const skPointf points[3] = {a, b, c};
+    fillPolygon(points, 3, col, SK_FILL_EVEN_ODD, aa);
+}
+
+void skDrawList::fillCircle(const float       cx,
+                            const float       cy,
+                            const float       radius,
+                            const skPixel&    col,
+                            const skAntiAlias aa)
+{
+    fillEllipse(cx, cy, radius, radius, col, aa);
+}
+
+void skDrawList::fillEllipse(const float       cx,
+                             const float       cy,
+                             const float       rx,
+                             const float       ry,
+                             const skPixel&    col,
+                             const skAntiAlias aa)
+{
+    if (rx <= 0 || ry <= 0)
+        return;
+
+    Command& cmd = push(CT_ELLIPSE, col);
+    cmd.aa       = aa;
+    cmd.f[0]     = cx;
+    cmd.f[1]     = cy;
+    cmd.f[2]     = rx;
+    cmd.f[3]     = ry;
+    cmd.x0       = (SKint32)floorf(cx - rx);
+    cmd.y0       = (SKint32)floorf(cy - ry);
+    cmd.x1       = (SKint32)ceilf(cx + rx) + 1;
+    cmd.y1       = (SKint32)ceilf(cy + ry) + 1;
+}
+
+void skDrawList::execute(const skImage& target, const SKuint32 threads) const
+{
+    const SKint32 w = (SKint32)target.getWidth();
+    const SKint32 h = (SKint32)target.getHeight();
+
+    if (m_commands.empty() || !target.getBytes() || w <= 0 || h <= 0)
+        return;
+
+    const SKint32  tw     = (SKint32)m_tileWidth;
+    const SKint32  th     = (SKint32)m_tileHeight;
+    const SKint32  tx     = (w + tw - 1) / tw;
+    const SKint32  ty     = (h + th - 1) / th;
+    const SKuint32 nTiles = (SKuint32)(tx * ty);
+    const SKuint32 nCmd   = (SKuint32)m_commands.size();
+
+    // Bin the commands by the tiles their bounds overlap. The bins are
+    // a counting sort over one index array, so each tile's commands
+    // stay in submission order.
+    SKuint32* binStart = new SKuint32[nTiles + 1];
+    for (SKuint32 i = 0; i <= nTiles; ++i)
+        binStart[i] = 0;
+
+    SKuint32* binFill = new SKuint32[nTiles];
+    SKuint32* binItem = nullptr;
+
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (SKuint32 c = 0; c < nCmd; ++c)
+        {
+            const Command& cmd = m_commands[c];
+
+            const SKint32 x0 = skMax(cmd.x0, 0);
+            const SKint32 y0 = skMax(cmd.y0, 0);
+            const SKint32 x1 = skMin(cmd.x1, w);
+            const SKint32 y1 = skMin(cmd.y1, h);
+            if (x0 >= x1 || y0 >= y1)
+                continue;
+
+            for (SKint32 j = y0 / th; j <= (y1 - 1) / th; ++j)
+            {
+                for (SKint32 i = x0 / tw; i <= (x1 - 1) / tw; ++i)
+                {
+                    const SKuint32 t = (SKuint32)(j * tx + i);
+                    if (pass == 0)
+                        binStart[t + 1]++;
+                    else
+                        binItem[binFill[t]++] = c;
+                }
+            }
+        }
+
+        if (pass == 0)
+        {
+            for (SKuint32 t = 0; t < nTiles; ++t)
+                binStart[t + 1] += binStart[t];
+            for (SKuint32 t = 0; t < nTiles; ++t)
+                binFill[t] = binStart[t];
+
+            binItem = new SKuint32[binStart[nTiles] + 1];
+        }
+    }
+
+    skParallel::forEach(
+        nTiles,
+        [&](const SKuint32 t)
+        {
+            if (binStart[t] == binStart[t + 1])
+                return;
+
+            const SKint32 cx = (SKint32)(t % (SKuint32)tx) * tw;
+            const SKint32 cy = (SKint32)(t / (SKuint32)tx) * th;
+
+            skRasterizer rasterizer(&target);
+            rasterizer.setClip(cx, cy, cx + tw, cy + th);
+
+            for (SKuint32 b = binStart[t]; b < binStart[t + 1]; ++b)
+            {
+                const Command& cmd = m_commands[binItem[b]];
+                switch (cmd.type)
+                {
+                case CT_CLEAR:
+                {
+                    // Match skImage::clear, which fills SK_LUMINANCE
+                    // images with the alpha value.
+                    skPixel col = cmd.color;
+                    if (target.getFormat() == SK_LUMINANCE)
+                        col.r = col.a;
+                    rasterizer.fillRect(0, 0, w, h, col);
+                    break;
+                }
+                case CT_FILL_RECT:
+                    rasterizer.fillRect(cmd.i[0], cmd.i[1], cmd.i[2], cmd.i[3], cmd.color);
+                    break;
+                case CT_LINE:
+                    rasterizer.line(cmd.i[0], cmd.i[1], cmd.i[2], cmd.i[3], cmd.color);
+                    break;
+                case CT_POLYGON:
+                    rasterizer.setAntiAlias(cmd.aa);
+                    rasterizer.fillPolygon(&m_points[cmd.first], cmd.count, cmd.color, cmd.rule);
+                    break;
+                case CT_ELLIPSE:
+                    rasterizer.setAntiAlias(cmd.aa);
+                    rasterizer.fillEllipse(cmd.f[0], cmd.f[1], cmd.f[2], cmd.f[3], cmd.color);
+                    break;
+                }
+            }
+        },
+        threads);
+
+    delete[] binStart;
+    delete[] binFill;
+    delete[] binItem;
+}
@@ -0,0 +1,135 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _skDrawList_h_
+#define _skDrawList_h_
+
+#include "Image/skPixel.h"
+#include "Utils/skArray.h"
+
+class skImage;
+
+class skDrawList
+{
+private:
+    enum CommandType
+    {
+        CT_CLEAR,
+        CT_FILL_RECT,
+        CT_LINE,
+        CT_POLYGON,
+        CT_ELLIPSE,
+    };
+
+    struct Command
+    {
+        CommandType type;
+        skPixel     color;
+        skAntiAlias aa;
+        skFillRule  rule;
+        SKint32     i[4];
+        float       f[4];
+        SKuint32    first, count;
+        SKint32     x0, y0, x1, y1;
+    };
+
+    skArray<Command>  m_commands;
+    skArray<skPointf> m_points;
+    SKuint32          m_tileWidth;
+    SKuint32          m_tileHeight;
+
+    Command& push(CommandType type, const skPixel& col);
+
+public:
+    skDrawList();
+    ~skDrawList();
+
+    void setTileSize(SKuint32 width, SKuint32 height);
+
+    SKuint32 getTileWidth() const
+    {
+        return m_tileWidth;
+    }
+
+    SKuint32 getTileHeight() const
+    {
+        return m_tileHeight;
+    }
+
+    SKsize size() const
+    {
+        return m_commands.size();
+    }
+
+    void reset();
+
+    void clear(const skPixel& col);
+
+    void fillRect(SKint32        x,
+                  SKint32        y,
+                  SKint32        width,
+                  SKint32        height,
+                  const skPixel& col);
+
+    void strokeRect(SKint32        x,
+                    SKint32        y,
+                    SKint32        width,
+                    SKint32        height,
+                    const skPixel& col);
+
+    void lineTo(SKint32        x1,
+                SKint32        y1,
+                SKint32        x2,
+                SKint32        y2,
+                const skPixel& col);
+
+    void fillPolygon(const skPointf* points,
+                     SKuint32        count,
+                     const skPixel&  col,
+                     skFillRule      rule = SK_FILL_EVEN_ODD,
+                     skAntiAlias     aa   = SK_AA_NONE);
+
+    void fillTriangle(const skPointf& a,
+                      const skPointf& b,
+                      const skPointf& c,
+                      const skPixel&  col,
+                      skAntiAlias     aa = SK_AA_NONE);
+
+    void fillCircle(float          cx,
+                    float          cy,
+                    float          radius,
+                    const skPixel& col,
+                    skAntiAlias    aa = SK_AA_NONE);
+
+    void fillEllipse(float          cx,
+                     float          cy,
+                     float          rx,
+                     float          ry,
+                     const skPixel& col,
+                     skAntiAlias    aa = SK_AA_NONE);
+
+    // Replays the recorded commands onto the target one tile at a time.
+    // Each tile applies, in order, only the commands that overlap it.
+    // A thread count of zero uses every hardware thread.
+    void execute(const skImage& target, SKuint32 threads = 0) const;
+};
+
+#endif  //_skDrawList_h_
@@ -19,117 +19,21 @@
   3. This notice may not be removed or altered from any source distribution.
 -------------------------------------------------------------------------------
 */
+#include <ctype.h>
+#include <string.h>
 #include "skImage.h"
 #include "FreeImage.h"
+#include "Image/skImageUtils.h"
+#include "Image/skMipChain.h"
+#include "Image/skPngWriter.h"
+#include "Image/skQuantizer.h"
+#include "Image/skRasterizer.h"
 #include "Utils/skLogger.h"
 #include "Utils/skMemoryUtils.h"
 #include "Utils/skMinMax.h"
 #include "Utils/skPlatformHeaders.h"
 
 
-class ImageUtils
-{
-public:
-    static int getFormat(const int format)
-    {
-        int out = (int)FIF_UNKNOWN;
-        switch (format)
-        {
-        case FIF_BMP:
-            out = FIF_BMP;
-            break;
-        case FIF_JPEG:
-            out = FIF_JPEG;
-            break;
-        case FIF_J2K:
-            out = FIF_J2K;
-            break;
-        case FIF_PNG:
-            out = FIF_PNG;
-            break;
-        case FIF_PSD:
-            out = FIF_PSD;
-            break;
-        case FIF_TARGA:
-            out = FIF_TARGA;
-            break;
-        case FIF_XPM:
-            out = FIF_XPM;
-            break;
-        default:
-            break;
-        }
-        return out;
-    }
-
-    static void clearA(SKubyte* mem, const SKsize max, const skPixel& p)
-    {
-        skMemset(mem, p.a, max);
-    }
-
-    static void clearLa(SKubyte* mem, const SKsize max, const skPixel& p)
-    {
-        if (mem && max > 2)
-        {
-            SKubyte cp[2] = {
-                (SKubyte)(((int)p.r + (int)p.g + (int)p.b) / 3),
-                p.a,
-            };
-            for (SKsize i = 0; i < max - 1; i += 2)
-            {
-#if SK_ENDIAN == SK_ENDIAN_BIG
-                mem[i]     = cp[0];
-                mem[i + 1] = cp[1];
-#else
-                mem[i + 1] = cp[0];
-                mem[i]     = cp[1];
-#endif
-            }
-        }
-    }
-
-    static void clearRgb(SKubyte* mem, const SKsize max, const skPixel& p)
-    {
-        if (mem && max > 3)
-        {
-            for (SKsize i = 0; i < max - 3; i += 3)
-            {
-#if SK_ENDIAN == SK_ENDIAN_BIG
-                mem[i]     = p.r;
-                mem[i + 1] = p.g;
-                mem[i + 2] = p.b;
-#else
-                mem[i]     = p.b;
-                mem[i + 1] = p.g;
-                mem[i + 2] = p.r;
-#endif
-            }
-        }
-    }
-
-    static void clearRgba(SKubyte* mem, const SKsize max, const skPixel& p)
-    {
-        if (mem && max > 4)
-        {
-            for (SKsize i = 0; i < max - 4; i += 4)
-            {
-#if SK_ENDIAN == SK_ENDIAN_BIG
-                mem[i]     = p.r;
-                mem[i + 1] = p.g;
-                mem[i + 2] = p.b;
-                mem[i + 3] = p.a;
-#else
-                mem[i]     = p.b;
-                mem[i + 1] = p.g;
-                mem[i + 2] = p.r;
-                mem[i + 3] = p.a;
-#endif
-            }
-        }
-    }
-};
-
-
 skImage::skImage() :
     m_width(0),
     m_height(0),
@@ -138,8 +42,13 @@ skImage::skImage() :
     m_size(0),
     m_bytes(nullptr),
     m_flip(true),
+    m_view(false),
+    m_premultiplied(false),
     m_format(SK_ALPHA),
-    m_bitmap(nullptr)
+    m_bitmap(nullptr),
+    m_source(nullptr),
+    m_sourceSize(0),
+    m_sourceFormat(FIF_UNKNOWN)
 {
 }
 
@@ -153,8 +62,13 @@ skImage::skImage(const SKuint32      width,
     m_size(0),
     m_bytes(nullptr),
     m_flip(true),
+    m_view(false),
+    m_premultiplied(false),
     m_format(format),
-    m_bitmap(nullptr)
+    m_bitmap(nullptr),
+    m_source(nullptr),
+    m_sourceSize(0),
+    m_sourceFormat(FIF_UNKNOWN)
 {
     calculateBitsPerPixel();
     allocateBytes();
@@ -164,6 +78,7 @@ skImage::~skImage()
 {
     if (m_bitmap)
         FreeImage_Unload(m_bitmap);
+    delete[] m_source;
 }
 
 void skImage::unloadAndReset()
@@ -178,7 +93,15 @@ void skImage::unloadAndReset()
     m_size   = 0;
     m_bytes  = nullptr;
     m_bitmap = nullptr;
+    m_view   = false;
     m_format = SK_ALPHA;
+
+    m_premultiplied = false;
+
+    delete[] m_source;
+    m_source       = nullptr;
+    m_sourceSize   = 0;
+    m_sourceFormat = FIF_UNKNOWN;
 }
 
 void skImage::calculateFormat()
@@ -211,6 +134,7 @@ void skImage::calculateBitsPerPixel()
     {
     case SK_LUMINANCE:
     case SK_ALPHA:
+    case SK_INDEXED8:
         m_bpp = 1;
         break;
     case SK_LUMINANCE_ALPHA:
@@ -226,19 +150,136 @@ void skImage::calculateBitsPerPixel()
     case SK_ABGR:
         m_bpp = 4;
         break;
+    case SK_LUMINANCE16:
+    case SK_LUMINANCE_HALF:
+        m_bpp = 2;
+        break;
+    case SK_RGBA16:
+    case SK_RGBA_HALF:
+        m_bpp = 8;
+        break;
+    case SK_LUMINANCE_FLOAT:
+        m_bpp = 4;
+        break;
+    case SK_RGBA_FLOAT:
+        m_bpp = 16;
+        break;
     case SK_PF_MAX:
         m_bpp = 0;
         break;
     }
 }
 
+// skPngWriter only writes pixels, so bitmaps carrying metadata, an ICC
+// profile or a palette transparency table are left to FreeImage.
+static bool hasPngExtras(FIBITMAP* bitmap)
+{
+    // Only a palette tRNS chunk counts; 32 and 64 bit alpha is written
+    // by skPngWriter, and FreeImage_IsTransparent would scan every pixel.
+    if (FreeImage_GetBPP(bitmap) <= 8 && FreeImage_GetTransparencyCount(bitmap) > 0)
+        return true;
+
+    const FIICCPROFILE* icc = FreeImage_GetICCProfile(bitmap);
+    if (icc && icc->size > 0)
+        return true;
+
+    for (int model = FIMD_COMMENTS; model <= FIMD_EXIF_RAW; ++model)
+    {
+        if (FreeImage_GetMetadataCount((FREE_IMAGE_MDMODEL)model, bitmap) > 0)
+            return true;
+    }
+    return false;
+}
+
+static bool isQoiFile(const char* file)
+{
+    if (!file)
+        return false;
+
+    const SKsize len = strlen(file);
+    if (len < 4)
+        return false;
+
+    const char* ext = file + len - 4;
+    return ext[0] == '.' &&
+           tolower(ext[1]) == 'q' &&
+           tolower(ext[2]) == 'o' &&
+           tolower(ext[3]) == 'i';
+}
+
+static bool readFile(const char* file, SKubyte*& bytes, SKsize& size)
+{
+    FILE* fp = fopen(file, "rb");
+    if (!fp)
+        return false;
+
+    fseek(fp, 0, SEEK_END);
+    const long len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    bytes = len > 0 ? new SKubyte[(SKsize)len] : nullptr;
+    size  = (SKsize)len;
+    if (!bytes || fread(bytes, 1, size, fp) != size)
+    {
+        fclose(fp);
+        delete[] bytes;
+        bytes = nullptr;
+        return false;
+    }
+    fclose(fp);
+    return true;
+}
+
 void skImage::save(const char* file) const
 {
+    if (m_bitmap != nullptr && isQoiFile(file))
+    {
+        materialize();
+        saveQoi(file);
+        return;
+    }
+
     const int fmt = FreeImage_GetFIFFromFilename(file);
     const int out = ImageUtils::getFormat(fmt);
 
-    if (m_bitmap != nullptr && out != FIF_UNKNOWN && file != nullptr)
-        FreeImage_Save((FREE_IMAGE_FORMAT)out, m_bitmap, file);
+    if (m_bitmap == nullptr || out == FIF_UNKNOWN || file == nullptr)
+        return;
+
+    if (m_source && out == m_sourceFormat)
+    {
+        FILE* fp = fopen(file, "wb");
+        if (!fp)
+        {
+            skLogf(LD_ERROR, "Failed to open %s for writing.\n", file);
+            return;
+        }
+
+        if (fwrite(m_source, 1, m_sourceSize, fp) != m_sourceSize)
+            skLogf(LD_ERROR, "Failed to write %s.\n", file);
+        fclose(fp);
+        return;
+    }
+
+    materialize();
+
+    if (out == FIF_PNG && !hasPngExtras(m_bitmap))
+    {
+        skPngWriter png;
+        if (png.save(*this, file))
+            return;
+    }
+
+    // FreeImage has no half type, so half images are written as float.
+    if (m_format == SK_LUMINANCE_HALF || m_format == SK_RGBA_HALF)
+    {
+        skImage* tmp = convertToFormat(m_format == SK_RGBA_HALF ? SK_RGBA_FLOAT : SK_LUMINANCE_FLOAT);
+        if (tmp)
+            FreeImage_Save((FREE_IMAGE_FORMAT)out, tmp->m_bitmap, file);
+        delete tmp;
+        return;
+    }
+
+    FreeImage_Save((FREE_IMAGE_FORMAT)out, m_bitmap, file);
 }
 
 void skImage::_updateFromBitmap()
@@ -246,10 +287,70 @@ void skImage::_updateFromBitmap()
     if (!m_bitmap)
         return;
 
-    m_bytes = FreeImage_GetBits(m_bitmap);
+    // Bring types without a matching format to the nearest one. A
+    // header only bitmap is described as it will be once decoded.
+    const bool hasPixels = FreeImage_HasPixels(m_bitmap) != FALSE;
+
+    FIBITMAP*             converted = nullptr;
+    const FREE_IMAGE_TYPE type      = FreeImage_GetImageType(m_bitmap);
+    switch (hasPixels ? type : FIT_UNKNOWN)
+    {
+    case FIT_RGB16:
+        converted = FreeImage_ConvertToRGBA16(m_bitmap);
+        break;
+    case FIT_RGBF:
+        converted = FreeImage_ConvertToRGBAF(m_bitmap);
+        break;
+    case FIT_INT16:
+    case FIT_UINT32:
+    case FIT_INT32:
+    case FIT_DOUBLE:
+        converted = FreeImage_ConvertToType(m_bitmap, FIT_FLOAT, TRUE);
+        break;
+    default:
+        break;
+    }
+
+    if (converted)
+    {
+        FreeImage_Unload(m_bitmap);
+        m_bitmap = converted;
+    }
+
+    m_bytes = hasPixels ? FreeImage_GetBits(m_bitmap) : nullptr;
     m_bpp   = FreeImage_GetBPP(m_bitmap);
     m_bpp /= 8;
-    calculateFormat();
+
+    switch (converted ? FreeImage_GetImageType(m_bitmap) : type)
+    {
+    case FIT_UINT16:
+        m_format = SK_LUMINANCE16;
+        calculateBitsPerPixel();
+        break;
+    case FIT_RGB16:
+    case FIT_RGBA16:
+        m_format = SK_RGBA16;
+        calculateBitsPerPixel();
+        break;
+    case FIT_FLOAT:
+    case FIT_INT16:
+    case FIT_UINT32:
+    case FIT_INT32:
+    case FIT_DOUBLE:
+        m_format = SK_LUMINANCE_FLOAT;
+        calculateBitsPerPixel();
+        break;
+    case FIT_RGBF:
+    case FIT_RGBAF:
+        m_format = SK_RGBA_FLOAT;
+        calculateBitsPerPixel();
+        break;
+    default:
+        calculateFormat();
+        if (m_bpp == 1 && FreeImage_GetColorType(m_bitmap) == FIC_PALETTE)
+            m_format = SK_INDEXED8;
+        break;
+    }
 
     m_width  = FreeImage_GetWidth(m_bitmap);
     m_height = FreeImage_GetHeight(m_bitmap);
@@ -258,12 +359,16 @@ void skImage::_updateFromBitmap()
     m_size = (SKsize)m_width * (SKsize)m_height * (SKsize)m_bpp;
 }
 
-bool skImage::load(const char* file)
+bool skImage::load(const char* file, const bool lazy)
 {
-    const int fmt = FreeImage_GetFIFFromFilename(file);
-    const int out = ImageUtils::getFormat(fmt);
+    const bool qoi = isQoiFile(file);
+    const int  fmt = FreeImage_GetFIFFromFilename(file);
+    const int  out = ImageUtils::getFormat(fmt);
 
-    if (out != FIF_UNKNOWN && file != nullptr)
+    if ((out == FIF_UNKNOWN && !qoi) || file == nullptr)
+        return false;
+
+    if (!lazy && !qoi)
     {
         unloadAndReset();
 
@@ -273,34 +378,115 @@ bool skImage::load(const char* file)
             _updateFromBitmap();
             return true;
         }
+        return false;
     }
-    return false;
+
+    SKubyte* bytes = nullptr;
+    SKsize   size  = 0;
+    if (!readFile(file, bytes, size))
+        return false;
+
+    if (qoi && isQoi(bytes, size))
+    {
+        const bool result = loadQoi(bytes, size);
+        delete[] bytes;
+        return result;
+    }
+    return loadSource(bytes, size, true);
 }
 
 
-bool skImage::loadFromMemory(void* mem, const SKsize& size)
+bool skImage::loadFromMemory(void* mem, const SKsize& size, const bool lazy)
 {
     if (!mem || size <= 0)
         return false;
 
+    if (!lazy)
+        return loadSource((SKubyte*)mem, size, false);
 
-    FIMEMORY memStream = {mem};
+    SKubyte* bytes = new SKubyte[size];
+    skMemcpy(bytes, mem, size);
+    return loadSource(bytes, size, true);
+}
 
-    const int fmt = FreeImage_GetFileTypeFromMemory(&memStream, (int)size);
+// Lazy loads hand over ownership of bytes, which are kept if only
+// the header was read.
+bool skImage::loadSource(SKubyte* bytes, const SKsize size, const bool lazy)
+{
+    // QOI decodes about as fast as it copies, so it is never deferred.
+    if (isQoi(bytes, size))
+    {
+        const bool result = loadQoi(bytes, size);
+        if (lazy)
+            delete[] bytes;
+        return result;
+    }
+
+    FIMEMORY* stream = FreeImage_OpenMemory(bytes, (DWORD)size);
+    if (!stream)
+    {
+        if (lazy)
+            delete[] bytes;
+        return false;
+    }
+
+    const int fmt = FreeImage_GetFileTypeFromMemory(stream, (int)size);
     const int out = ImageUtils::getFormat(fmt);
 
+    bool result = false;
     if (out != FIF_UNKNOWN)
     {
         unloadAndReset();
 
-        m_bitmap = FreeImage_LoadFromMemory((FREE_IMAGE_FORMAT)out, &memStream);
+        // Plugins that cannot stop after the header decode right away.
+        const bool headerOnly = lazy && FreeImage_FIFSupportsNoPixels((FREE_IMAGE_FORMAT)out);
+
+        m_bitmap = FreeImage_LoadFromMemory((FREE_IMAGE_FORMAT)out,
+                                            stream,
+                                            headerOnly ? FIF_LOAD_NOPIXELS : 0);
         if (m_bitmap != nullptr)
         {
+            if (headerOnly)
+            {
+                m_source       = bytes;
+                m_sourceSize   = size;
+                m_sourceFormat = out;
+                bytes          = nullptr;
+            }
+
             _updateFromBitmap();
-            return true;
+            result = true;
         }
     }
-    return false;
+
+    FreeImage_CloseMemory(stream);
+    if (lazy)
+        delete[] bytes;
+    return result;
+}
+
+void skImage::decodeSource()
+{
+    FIMEMORY* stream = FreeImage_OpenMemory(m_source, (DWORD)m_sourceSize);
+
+    FIBITMAP* bitmap = stream ? FreeImage_LoadFromMemory((FREE_IMAGE_FORMAT)m_sourceFormat, stream) : nullptr;
+    if (stream)
+        FreeImage_CloseMemory(stream);
+
+    delete[] m_source;
+    m_source       = nullptr;
+    m_sourceSize   = 0;
+    m_sourceFormat = FIF_UNKNOWN;
+
+    if (!bitmap)
+    {
+        skLogf(LD_ERROR, "Failed to decode the image pixels.\n");
+        return;
+    }
+
+    FreeImage_Unload(m_bitmap);
+    m_bitmap = bitmap;
+    _updateFromBitmap();
 }
 
 void skImage::allocateBytes()
@@ -321,7 +507,10 @@ void skImage::allocateBytes()
     if (m_bitmap != nullptr)
         FreeImage_Unload(m_bitmap);
 
-    m_bitmap = FreeImage_Allocate(m_width, m_height, 8 * (int)m_bpp);
+    m_bitmap = FreeImage_AllocateT(ImageUtils::getImageType(m_format),
+                                   m_width,
+                                   m_height,
+                                   8 * (int)m_bpp);
     m_size   = (SKsize)m_width * (SKsize)m_height * (SKsize)m_bpp;
     m_bpp    = FreeImage_GetBPP(m_bitmap) / 8;
     m_bytes  = FreeImage_GetBits(m_bitmap);
@@ -330,28 +519,20 @@ void skImage::allocateBytes()
 
 void skImage::clear(const skPixel& pixel) const
 {
-    switch (m_format)
-    {
-    case SK_LUMINANCE:
-    case SK_ALPHA:
-        ImageUtils::clearA(m_bytes, m_size, pixel);
-        break;
-    case SK_LUMINANCE_ALPHA:
-        ImageUtils::clearLa(m_bytes, m_size, pixel);
-        break;
-    case SK_RGB:
-    case SK_BGR:
-        ImageUtils::clearRgb(m_bytes, m_size, pixel);
-        break;
-    case SK_RGBA:
-    case SK_BGRA:
-    case SK_ARGB:
-    case SK_ABGR:
-        ImageUtils::clearRgba(m_bytes, m_size, pixel);
-        break;
-    case SK_PF_MAX:
-        break;
-    }
+    materialize();
+
+    if (!m_bytes || m_bpp == 0)
+        return;
+
+    SKubyte packed[16];
+    packPixel(packed, pixel);
+
+    // Luminance images have always been cleared to the alpha value.
+    if (m_format == SK_LUMINANCE)
+        packed[0] = pixel.a;
+
+    for (SKuint32 y = 0; y < m_height; ++y)
+        ImageUtils::fillSpan(m_bytes + (SKsize)y * m_pitch, m_width, packed, m_bpp);
 }
 
 
@@ -434,6 +615,56 @@ void skImage::getPixel(skPixel& dest, const SKubyte* src, const skPixelFormat fo
         rs->a = rs->r;
         break;
     }
+    case SK_INDEXED8:
+    {
+        rs->r = src[0];
+        rs->g = rs->r;
+        rs->b = rs->r;
+        rs->a = 255;
+        break;
+    }
+    case SK_LUMINANCE16:
+    case SK_RGBA16:
+    {
+        SKuint16 v[4] = {0, 0, 0, 65535};
+        skMemcpy(v, src, format == SK_RGBA16 ? 8 : 2);
+        if (format == SK_LUMINANCE16)
+            v[1] = v[2] = v[0];
+
+        rs->r = (SKubyte)((v[0] * 255u + 32767) / 65535);
+        rs->g = (SKubyte)((v[1] * 255u + 32767) / 65535);
+        rs->b = (SKubyte)((v[2] * 255u + 32767) / 65535);
+        rs->a = (SKubyte)((v[3] * 255u + 32767) / 65535);
+        break;
+    }
+    case SK_LUMINANCE_HALF:
+    case SK_RGBA_HALF:
+    {
+        SKuint16 v[4] = {0, 0, 0, 0x3C00};
+        skMemcpy(v, src, format == SK_RGBA_HALF ? 8 : 2);
+        if (format == SK_LUMINANCE_HALF)
+            v[1] = v[2] = v[0];
+
+        rs->r = ImageUtils::unitToByte(ImageUtils::halfToFloat(v[0]));
+        rs->g = ImageUtils::unitToByte(ImageUtils::halfToFloat(v[1]));
+        rs->b = ImageUtils::unitToByte(ImageUtils::halfToFloat(v[2]));
+        rs->a = ImageUtils::unitToByte(ImageUtils::halfToFloat(v[3]));
+        break;
+    }
+    case SK_LUMINANCE_FLOAT:
+    case SK_RGBA_FLOAT:
+    {
+        float v[4] = {0, 0, 0, 1};
+        skMemcpy(v, src, format == SK_RGBA_FLOAT ? 16 : 4);
+        if (format == SK_LUMINANCE_FLOAT)
+            v[1] = v[2] = v[0];
+
+        rs->r = ImageUtils::unitToByte(v[0]);
+        rs->g = ImageUtils::unitToByte(v[1]);
+        rs->b = ImageUtils::unitToByte(v[2]);
+        rs->a = ImageUtils::unitToByte(v[3]);
+        break;
+    }
     case SK_PF_MAX:
         break;
     }
@@ -513,6 +744,40 @@ void skImage::setPixel(SKubyte* dst, const skPixel& src, const skPixelFormat for
     case SK_ALPHA:
         dst[0] = src.a;
         break;
+    case SK_INDEXED8:
+        dst[0] = (SKubyte)(((int)src.r + (int)src.g + (int)src.b) / 3);
+        break;
+    case SK_LUMINANCE16:
+    case SK_RGBA16:
+    {
+        const SKuint16 v[4] = {
+            (SKuint16)(src.r * 257),
+            (SKuint16)(src.g * 257),
+            (SKuint16)(src.b * 257),
+            (SKuint16)(src.a * 257),
+        };
+        skMemcpy(dst, v, format == SK_RGBA16 ? 8 : 2);
+        break;
+    }
+    case SK_LUMINANCE_HALF:
+    case SK_RGBA_HALF:
+    {
+        const SKuint16 v[4] = {
+            ImageUtils::floatToHalf(src.r / 255.f),
+            ImageUtils::floatToHalf(src.g / 255.f),
+            ImageUtils::floatToHalf(src.b / 255.f),
+            ImageUtils::floatToHalf(src.a / 255.f),
+        };
+        skMemcpy(dst, v, format == SK_RGBA_HALF ? 8 : 2);
+        break;
+    }
+    case SK_LUMINANCE_FLOAT:
+    case SK_RGBA_FLOAT:
+    {
+        const float v[4] = {src.r / 255.f, src.g / 255.f, src.b / 255.f, src.a / 255.f};
+        skMemcpy(dst, v, format == SK_RGBA_FLOAT ? 16 : 4);
+        break;
+    }
     case SK_PF_MAX:
         break;
     }
@@ -521,17 +786,99 @@ void skImage::setPixel(SKubyte* dst, const skPixel& src, const skPixelFormat for
 
 void skImage::setPixel(const SKuint32& x, const SKuint32& y, const skPixel& pixel) const
 {
-    const SKuint32 loc = getBufferPos(x, y);
-    if (loc < m_size)
-        setPixel(&m_bytes[loc], pixel, m_format);
+    materialize();
+
+    if (m_bytes && x < m_width && y < m_height)
+        packPixel(&m_bytes[getBufferPos(x, y)], pixel);
 }
 
 
 void skImage::getPixel(const SKuint32& x, const SKuint32& y, skPixel& pixel) const
 {
-    const SKuint32 loc = getBufferPos(x, y);
-    if (loc < m_size)
-        getPixel(pixel, &m_bytes[loc], m_format);
+    materialize();
+
+    if (m_bytes && x < m_width && y < m_height)
+        unpackPixel(pixel, &m_bytes[getBufferPos(x, y)]);
+}
+
+void skImage::packPixel(SKubyte* dst, const skPixel& src) const
+{
+    if (m_format == SK_INDEXED8)
+        dst[0] = (SKubyte)findPaletteIndex(src);
+    else
+        setPixel(dst, src, m_format);
+}
+
+void skImage::unpackPixel(skPixel& dest, const SKubyte* src) const
+{
+    if (m_format == SK_INDEXED8 && getPaletteColor(src[0], dest))
+        return;
+    getPixel(dest, src, m_format);
+}
+
+SKuint32 skImage::getPaletteSize() const
+{
+    materialize();
+
+    if (m_format != SK_INDEXED8 || !m_bitmap)
+        return 0;
+    return FreeImage_GetColorsUsed(m_bitmap);
+}
+
+bool skImage::getPaletteColor(const SKuint32 index, skPixel& col) const
+{
+    if (index >= getPaletteSize())
+        return false;
+
+    const RGBQUAD* pal = FreeImage_GetPalette(m_bitmap);
+    if (!pal)
+        return false;
+
+    col.r = pal[index].rgbRed;
+    col.g = pal[index].rgbGreen;
+    col.b = pal[index].rgbBlue;
+    col.a = 255;
+    return true;
+}
+
+bool skImage::setPaletteColor(const SKuint32 index, const skPixel& col) const
+{
+    if (index >= getPaletteSize())
+        return false;
+
+    RGBQUAD* pal = FreeImage_GetPalette(m_bitmap);
+    if (!pal)
+        return false;
+
+    pal[index].rgbRed      = col.r;
+    pal[index].rgbGreen    = col.g;
+    pal[index].rgbBlue     = col.b;
+    pal[index].rgbReserved = 0;
+    return true;
+}
+
+SKuint32 skImage::findPaletteIndex(const skPixel& col) const
+{
+    const SKuint32 n   = getPaletteSize();
+    const RGBQUAD* pal = n > 0 ? FreeImage_GetPalette(m_bitmap) : nullptr;
+    if (!pal)
+        return 0;
+
+    SKuint32 best = 0, bestDist = SK_NPOS32;
+    for (SKuint32 i = 0; i < n && bestDist > 0; ++i)
+    {
+        const SKint32 dr = (SKint32)pal[i].rgbRed - col.r;
+        const SKint32 dg = (SKint32)pal[i].rgbGreen - col.g;
+        const SKint32 db = (SKint32)pal[i].rgbBlue - col.b;
+
+        const SKuint32 d = (SKuint32)(dr * dr + dg * dg + db * db);
+        if (d < bestDist)
+        {
+            bestDist = d;
+            best     = i;
+        }
+    }
+    return best;
 }
 
 void skImage::fillRect(const SKuint32 x,
@@ -540,20 +887,17 @@ void skImage::fillRect(const SKuint32 x,
                        const SKuint32 height,
                        const skPixel& col) const
 {
-    const SKuint32 x0 = x;
-    const SKuint32 x1 = x + width;
-    const SKuint32 y0 = y;
-    const SKuint32 y1 = y + height;
+    materialize();
 
-    for (SKuint32 ix = x0; ix < x1; ++ix)
-    {
-        for (SKuint32 iy = y0; iy < y1; ++iy)
-        {
-            const SKuint32 loc = getBufferPos(ix, iy);
-            if (loc <= m_size)
-                setPixel(&m_bytes[loc], col, m_format);
-        }
-    }
+    if (x >= m_width || y >= m_height)
+        return;
+
+    skRasterizer rasterizer(this);
+    rasterizer.fillRect((SKint32)x,
+                        (SKint32)y,
+                        (SKint32)skMin(width, m_width - x),
+                        (SKint32)skMin(height, m_height - y),
+                        col);
 }
 
 
@@ -574,104 +918,187 @@ void skImage::strokeRect(SKuint32       x,
     lineTo(x1, y2, x1, y1, col);
 }
 
-void skImage::lineTo(SKint32        x1,
-                     SKint32        y1,
-                     SKint32        x2,
-                     SKint32        y2,
+void skImage::lineTo(const SKint32  x1,
+                     const SKint32  y1,
+                     const SKint32  x2,
+                     const SKint32  y2,
                      const skPixel& col) const
 {
-    if (x2 == x1)
-    {
-        if (y2 < y1)
-            skSwap(y2, y1);
+    materialize();
 
-        for (SKint32 iy = y1; iy <= y2; ++iy)
-        {
-            const SKuint32 loc = getBufferPos(x1, iy);
-            if (loc <= m_size)
-                setPixel(&m_bytes[loc], col, m_format);
-        }
-    }
-    else if (y2 == y1)
-    {
-        if (x2 < x1)
-            skSwap(x2, x1);
-        for (SKint32 ix = x1; ix <= x2; ++ix)
-        {
-            const SKuint32 loc = getBufferPos(ix, y1);
-            if (loc <= m_size)
-                setPixel(&m_bytes[loc], col, m_format);
-        }
-    }
-    else if (skABS(y2 - y1) > skABS(x2 - x1))
-    {
-        skSwap(x1, y1);
-        skSwap(x2, y2);
+    skRasterizer rasterizer(this);
+    rasterizer.line(x1, y1, x2, y2, col);
+}
 
-        if (x1 > x2)
-        {
-            skSwap(x1, x2);
-            skSwap(y1, y2);
-        }
+void skImage::fillPolygon(const skPointf*   points,
+                          const SKuint32    count,
+                          const skPixel&    col,
+                          const skFillRule  rule,
+                          const skAntiAlias aa) const
+{
+    materialize();
 
-        const SKint32 de = skABS(y2 - y1);
-        const SKint32 sy = y1 > y2 ? -1 : 1;
-        const SKint32 dx = x2 - x1;
+    skRasterizer rasterizer(this, aa);
+    rasterizer.fillPolygon(points, count, col, rule);
+}
+
+void skImage::fillTriangle(const skPointf&   a,
+                           const skPointf&   b,
+                           const skPointf&   c,
+                           const skPixel&    col,
+                           const skAntiAlias aa) const
+{
+    materialize();
 
-        SKint32 e  = -(dx >> 1);
-        SKint32 iy = y1;
-        for (SKint32 ix = x1; ix <= x2; ++ix)
+    const skPointf points[3] = {a, b, c};
+
+    skRasterizer rasterizer(this, aa);
+    rasterizer.fillPolygon(points, 3, col, SK_FILL_EVEN_ODD);
+}
+
+void skImage::fillCircle(const float       cx,
+                         const float       cy,
+                         const float       radius,
+                         const skPixel&    col,
+                         const skAntiAlias aa) const
+{
+    materialize();
+
+    skRasterizer rasterizer(this, aa);
+    rasterizer.fillEllipse(cx, cy, radius, radius, col);
+}
+
+void skImage::fillEllipse(const float       cx,
+                          const float       cy,
+                          const float       rx,
+                          const float       ry,
+                          const skPixel&    col,
+                          const skAntiAlias aa) const
+{
+    materialize();
+
+    skRasterizer rasterizer(this, aa);
+    rasterizer.fillEllipse(cx, cy, rx, ry, col);
+}
+
+
+skImage* skImage::convertToFormat(const skPixelFormat& format,
+                                  const skLumWeights   weights) const
+{
+    materialize();
+
+    if (!m_bytes || m_width <= 0 || m_height <= 0)
+        return nullptr;
+    if (format == SK_INDEXED8 && m_format != SK_INDEXED8)
+        return quantize();
+
+    skImage* cpy = new skImage(m_width, m_height, format);
+    cpy->setFlipY(m_flip);
+    cpy->setPremultiplied(m_premultiplied && ImageUtils::hasAlpha(format));
+
+    if (m_format == SK_INDEXED8 && format != SK_INDEXED8)
+    {
+        const SKuint32 dstBpp = cpy->m_bpp;
+
+        for (SKuint32 y = 0; y < m_height; y++)
         {
-            const SKuint32 loc = getBufferPos(iy, ix);
-            if (loc <= m_size)
-                setPixel(&m_bytes[loc], col, m_format);
+            const SKubyte* sr = m_bytes + (SKsize)y * m_pitch;
+            SKubyte*       dr = cpy->m_bytes + (SKsize)y * cpy->m_pitch;
 
-            e += de;
-            if (e > 0)
+            for (SKuint32 x = 0; x < m_width; x++)
             {
-                iy += sy;
-                e -= dx;
+                skPixel rs;
+                unpackPixel(rs, sr + x);
+                setPixel(dr + (SKsize)x * dstBpp, rs, format);
             }
         }
+        return cpy;
     }
-    else
+
+    if (format == SK_INDEXED8)
     {
-        if (x1 > x2)
+        for (SKuint32 i = 0; i < getPaletteSize(); ++i)
         {
-            skSwap(x1, x2);
-            skSwap(y1, y2);
+            skPixel col;
+            getPaletteColor(i, col);
+            cpy->setPaletteColor(i, col);
         }
+    }
 
-        const SKint32 de = skABS(y2 - y1);
-        const SKint32 sy = y1 > y2 ? -1 : 1;
-        const SKint32 dx = x2 - x1;
+    if (copyLuminance(*cpy, weights))
+        return cpy;
 
-        SKint32 e  = -(dx >> 1);
-        SKint32 iy = y1;
-        for (SKint32 ix = x1; ix <= x2; ++ix)
-        {
-            const SKuint32 loc = getBufferPos(ix, iy);
-            if (loc <= m_size)
-                setPixel(&m_bytes[loc], col, m_format);
+    if (copyDepth(*cpy, weights))
+        return cpy;
 
-            e += de;
-            if (e > 0)
-            {
-                iy += sy;
-                e -= dx;
-            }
-        }
-    }
+    copy(cpy->getBytes(),
+         cpy->getPitch(),
+         m_bytes,
+         m_pitch,
+         m_width,
+         m_height,
+         format,
+         m_format);
+    return cpy;
 }
 
+skImage* skImage::quantize(const SKuint32 maxColors, const bool dither) const
+{
+    skQuantizer quantizer;
+    quantizer.setMaxColors(maxColors);
+    quantizer.setDither(dither);
+    return quantizer.quantize(*this);
+}
 
-skImage* skImage::convertToFormat(const skPixelFormat& format) const
+skMipChain* skImage::buildMipChain(const skMipFilter filter, const bool srgb, const bool premultiply) const
 {
-    if (!m_bytes || m_width <= 0 || m_height <= 0)
+    skMipChain* chain = new skMipChain;
+    chain->setFilter(filter);
+    chain->setSrgb(srgb);
+    chain->setPremultiplyAlpha(premultiply);
+
+    if (!chain->build(*this))
+    {
+        delete chain;
         return nullptr;
-    skImage* cpy = new skImage(m_width, m_height, format);
-    copy(cpy->getBytes(), m_bytes, m_width, m_height, format, m_format);
-    return cpy;
+    }
+    return chain;
+}
+
+skImage* skImage::crop(SKuint32       x,
+                       SKuint32       y,
+                       const SKuint32 width,
+                       const SKuint32 height) const
+{
+    materialize();
+
+    if (!m_bitmap || x >= m_width || y >= m_height)
+        return nullptr;
+
+    const SKuint32 w = skMin(width, m_width - x);
+    const SKuint32 h = skMin(height, m_height - y);
+    if (w == 0 || h == 0)
+        return nullptr;
+
+    // FreeImage_CreateView takes the rectangle from the top of the
+    // bitmap, which is the unflipped origin.
+    if (!m_flip)
+        y = m_height - (y + h);
+
+    FIBITMAP* view = FreeImage_CreateView(m_bitmap, x, y, x + w, y + h);
+    if (!view)
+        return nullptr;
+
+    skImage* img  = new skImage();
+    img->m_bitmap = view;
+    img->_updateFromBitmap();
+
+    img->m_format = m_format;
+    img->m_flip   = m_flip;
+    img->m_view   = true;
+
+    img->m_premultiplied = m_premultiplied;
+    return img;
 }
 
 
@@ -681,30 +1108,41 @@ void skImage::copy(SKubyte*            dst,
                    const SKuint32      h,
                    const skPixelFormat dstFmt,
                    const skPixelFormat srcFmt)
+{
+    copy(dst, w * getSize(dstFmt), src, w * getSize(srcFmt), w, h, dstFmt, srcFmt);
+}
+
+void skImage::copy(SKubyte*            dst,
+                   const SKuint32      dstPitch,
+                   const SKubyte*      src,
+                   const SKuint32      srcPitch,
+                   const SKuint32      w,
+                   const SKuint32      h,
+                   const skPixelFormat dstFmt,
+                   const skPixelFormat srcFmt)
 {
     if (!dst || !src)
         return;
 
-    //if (dstFmt == srcFmt)
-    //{
-    //    skMemcpy(dst, src, (SKsize)w * (SKsize)h * (SKsize)getSize(dstFmt));
-    //    return;
-    //}
-
     const SKuint32 srcBpp = getSize(srcFmt);
     const SKuint32 dstBpp = getSize(dstFmt);
 
     for (SKuint32 y = 0; y < h; y++)
     {
-        for (SKuint32 x = 0; x < w; x++)
-        {
-            const SKubyte* sp = (const SKubyte*)&src[(y * w + x) * srcBpp];
+        const SKubyte* sr = src + (SKsize)y * srcPitch;
+        SKubyte*       dr = dst + (SKsize)y * dstPitch;
 
-            SKubyte* dp = (SKubyte*)&dst[(y * w + x) * dstBpp];
+        if (dstFmt == srcFmt)
+        {
+            skMemcpy(dr, sr, (SKsize)w * dstBpp);
+            continue;
+        }
 
+        for (SKuint32 x = 0; x < w; x++)
+        {
             skPixel rs(0, 0, 0, 255);
-            getPixel(rs, sp, srcFmt);
-            setPixel(dp, rs, dstFmt);
+            getPixel(rs, sr + (SKsize)x * srcBpp, srcFmt);
+            setPixel(dr + (SKsize)x * dstBpp, rs, dstFmt);
         }
     }
 }
@@ -725,7 +1163,18 @@ SKuint32 skImage::getSize(const skPixelFormat& format)
         return 2;
     case SK_LUMINANCE:
     case SK_ALPHA:
+    case SK_INDEXED8:
         return 1;
+    case SK_LUMINANCE16:
+    case SK_LUMINANCE_HALF:
+        return 2;
+    case SK_RGBA16:
+    case SK_RGBA_HALF:
+        return 8;
+    case SK_LUMINANCE_FLOAT:
+        return 4;
+    case SK_RGBA_FLOAT:
+        return 16;
     default:
         return 0;
     }
@@ -26,9 +26,14 @@
 #include "Utils/Config/skConfig.h"
 #include "Utils/skDisableWarnings.h"
 
+class skLut;
+class skMipChain;
+
 class skImage
 {
 private:
+    friend class skRasterizer;
+
     SKuint32      m_width;
     SKuint32      m_height;
     SKuint32      m_pitch;
@@ -36,8 +41,13 @@ private:
     SKsize        m_size;
     SKubyte*      m_bytes;
     bool          m_flip;
+    bool          m_view;
+    bool          m_premultiplied;
     skPixelFormat m_format;
     FIBITMAP*     m_bitmap;
+    SKubyte*      m_source;
+    SKsize        m_sourceSize;
+    int           m_sourceFormat;
 
     void unloadAndReset();
 
@@ -48,7 +58,7 @@ private:
     void calculateFormat();
 
 
-    SKuint32 getBufferPos(const SKuint32& x, const SKuint32& y) const
+    SKsize getBufferPos(const SKuint32& x, const SKuint32& y) const
     {
         if (m_flip)
             return getBufferPosFlipped(x, y);
@@ -56,18 +66,46 @@ private:
     }
 
 
-    SKuint32 getBufferPosNormal(const SKuint32& x, const SKuint32& y) const
+    SKsize getBufferPosNormal(const SKuint32& x, const SKuint32& y) const
     {
-        return (SKuint32)y * m_pitch + x * m_bpp;
+        return (SKsize)y * m_pitch + (SKsize)x * m_bpp;
     }
 
-    SKuint32 getBufferPosFlipped(const SKuint32& x, const SKuint32& y) const
+    SKsize getBufferPosFlipped(const SKuint32& x, const SKuint32& y) const
     {
-        return (SKuint32)(m_height - 1 - y) * m_pitch + x * m_bpp;
+        return (SKsize)(m_height - 1 - y) * m_pitch + (SKsize)x * m_bpp;
     }
 
     void _updateFromBitmap();
 
+    bool loadSource(SKubyte* bytes, SKsize size, bool lazy);
+
+    void materialize() const
+    {
+        // Decoding does not change what the image holds, only when it
+        // is read, so it is allowed from const methods.
+        if (m_source)
+            const_cast<skImage*>(this)->decodeSource();
+    }
+
+    void decodeSource();
+
+    bool loadQoi(const SKubyte* bytes, SKsize size);
+
+    void saveQoi(const char* file) const;
+
+    static bool isQoi(const SKubyte* bytes, SKsize size);
+
+    void transformTo(const skImage& dst, skImageTransform transform) const;
+
+    void transposeSquare() const;
+
+    void boxBlurPass(SKubyte* tmp, SKuint32 radius) const;
+
+    bool copyLuminance(const skImage& dst, skLumWeights weights) const;
+
+    bool copyDepth(const skImage& dst, skLumWeights weights) const;
+
 public:
     skImage();
     skImage(SKuint32 width, SKuint32 height, skPixelFormat format);
@@ -85,6 +123,7 @@ public:
 
     SKuint32 getPitch() const
     {
+        materialize();
         return m_pitch;
     }
 
@@ -95,6 +134,7 @@ public:
 
     SKubyte* getBytes() const
     {
+        materialize();
         return m_bytes;
     }
 
@@ -113,13 +153,57 @@ public:
         m_flip = v;
     }
 
+    bool isFlipY() const
+    {
+        return m_flip;
+    }
+
+    bool isView() const
+    {
+        return m_view;
+    }
+
+    // True when the color channels are already scaled by alpha.
+    bool isPremultiplied() const
+    {
+        return m_premultiplied;
+    }
+
+    // Marks the pixels as premultiplied or not, without touching them.
+    void setPremultiplied(bool v)
+    {
+        m_premultiplied = v;
+    }
+
+    // True while a lazily loaded image still holds only its header
+    // and the encoded file.
+    bool isLazy() const
+    {
+        return m_source != nullptr;
+    }
+
 
+    // Fills every pixel. SK_LUMINANCE images take pixel.a.
     void clear(const skPixel& pixel) const;
 
     void setPixel(const SKuint32& x, const SKuint32& y, const skPixel& pixel) const;
 
     void getPixel(const SKuint32& x, const SKuint32& y, skPixel& pixel) const;
 
+    // Like the static setPixel and getPixel, but SK_INDEXED8 pixels
+    // go through this image's palette.
+    void packPixel(SKubyte* dst, const skPixel& src) const;
+
+    void unpackPixel(skPixel& dest, const SKubyte* src) const;
+
+    SKuint32 getPaletteSize() const;
+
+    bool getPaletteColor(SKuint32 index, skPixel& col) const;
+
+    bool setPaletteColor(SKuint32 index, const skPixel& col) const;
+
+    SKuint32 findPaletteIndex(const skPixel& col) const;
+
     void fillRect(SKuint32       x,
                   SKuint32       y,
                   SKuint32       width,
@@ -138,13 +222,156 @@ public:
                 SKint32        y2,
                 const skPixel& col) const;
 
-    skImage* convertToFormat(const skPixelFormat& format) const;
+    void fillPolygon(const skPointf* points,
+                     SKuint32        count,
+                     const skPixel&  col,
+                     skFillRule      rule = SK_FILL_EVEN_ODD,
+                     skAntiAlias     aa   = SK_AA_NONE) const;
+
+    void fillTriangle(const skPointf& a,
+                      const skPointf& b,
+                      const skPointf& c,
+                      const skPixel&  col,
+                      skAntiAlias     aa = SK_AA_NONE) const;
+
+    void fillCircle(float          cx,
+                    float          cy,
+                    float          radius,
+                    const skPixel& col,
+                    skAntiAlias    aa = SK_AA_NONE) const;
+
+    void fillEllipse(float          cx,
+                     float          cy,
+                     float          rx,
+                     float          ry,
+                     const skPixel& col,
+                     skAntiAlias    aa = SK_AA_NONE) const;
+
+    // Fills the region connected to x, y whose stored channels are all
+    // within tolerance of the seed pixel. Indexed images match exactly.
+    // Returns the number of pixels filled.
+    SKsize floodFill(SKuint32       x,
+                     SKuint32       y,
+                     const skPixel& col,
+                     SKuint32       tolerance    = 0,
+                     skConnectivity connectivity = SK_CONNECT_4) const;
+
+    // Blends col into the image through an SK_ALPHA or SK_LUMINANCE
+    // coverage mask placed at x, y. Coverage c is scaled by col.a, and
+    // stored alpha becomes c + a * (1 - c). Color is mixed by c, which
+    // is exact source-over for premultiplied and opaque targets and
+    // an approximation over translucent straight alpha pixels.
+    bool blitMask(const skImage& mask,
+                  SKint32        x,
+                  SKint32        y,
+                  const skPixel& col) const;
+
+    // Blits count rectangles of a coverage atlas, in order, as blitMask.
+    bool blitMasks(const skImage&     atlas,
+                   const skGlyphQuad* quads,
+                   SKuint32           count,
+                   const skPixel&     col) const;
+
+    // Conversions from a color format to SK_LUMINANCE or
+    // SK_LUMINANCE_ALPHA weight the channels by the given weights.
+    skImage* convertToFormat(const skPixelFormat& format,
+                             skLumWeights         weights = SK_LUM_AVERAGE) const;
+
+    skImage* transform(const skImageTransform& transform) const;
+
+    bool transformInPlace(const skImageTransform& transform);
+
+    void flipHorizontal() const;
+
+    void flipVertical() const;
+
+    bool applyExifOrientation();
+
+    // Returns one channel as an SK_ALPHA image for alpha, or an
+    // SK_LUMINANCE image for a color channel.
+    skImage* extractChannel(skChannel channel) const;
+
+    // Returns an image per channel, with null for the channels the
+    // format does not store. The gray of luminance formats is red.
+    bool splitChannels(skImage* channels[SK_CHANNEL_MAX]) const;
+
+    // Replaces one channel with a single channel image of the same size.
+    bool insertChannel(skChannel channel, const skImage& src) const;
+
+    // Sets channel c to the old value of channel order[c]. Channels
+    // the format does not store read as 0, or 255 for alpha.
+    bool swizzle(const skChannel order[SK_CHANNEL_MAX]) const;
+
+    // Converts SK_RGBA, SK_BGRA, SK_ARGB and SK_ABGR pixels to and
+    // from premultiplied alpha. Both do nothing when the image is
+    // already in the requested state.
+    bool premultiplyAlpha();
+
+    bool unpremultiplyAlpha();
+
+    bool convolve(const float* kernelX,
+                  SKuint32     sizeX,
+                  const float* kernelY,
+                  SKuint32     sizeY) const;
+
+    bool boxBlur(SKuint32 radius) const;
+
+    bool gaussianBlur(float sigma) const;
+
+    bool unsharpMask(float sigma, float amount) const;
 
+    bool computeStatistics(skImageStatistics& stats) const;
+
+    // Compares pixel values, so images of different formats can be
+    // equal. x and y receive the first differing pixel in row order.
+    // Here and in compare, difference and computeSSIM, indexed and
+    // deep images are measured as 8-bit RGBA, so indexed images match
+    // by palette color. Deep images of one format are matched exactly.
+    bool equals(const skImage& other, SKuint32* x = nullptr, SKuint32* y = nullptr) const;
+
+    // Per channel error against an image of the same size. firstX and
+    // firstY are SK_NPOS32 when no pixel differs, and the PSNR of an
+    // identical channel is HUGE_VAL.
+    bool compare(const skImage& other, skImageComparison& result) const;
+
+    // Returns the absolute per channel difference, in this image's
+    // format, or SK_RGBA when either image is indexed or deep.
+    skImage* difference(const skImage& other) const;
+
+    // Mean SSIM of the luminance over every window x window box.
+    bool computeSSIM(const skImage& other, double& ssim, SKuint32 window = 8) const;
+
+    bool applyLut(const skLut& lut) const;
+
+    // Applies one table to the color channels, leaving alpha as it is.
+    bool applyLut(const SKubyte* table) const;
+
+    // Returns an SK_INDEXED8 copy reduced to at most maxColors.
+    skImage* quantize(SKuint32 maxColors = 256, bool dither = false) const;
+
+    // Returns every mip level of this image, down to 1x1.
+    skMipChain* buildMipChain(skMipFilter filter      = SK_MIP_BOX,
+                              bool        srgb        = false,
+                              bool        premultiply = false) const;
+
+    // Returns a view that shares this image's pixels. The view
+    // must be deleted before the image it was taken from.
+    skImage* crop(SKuint32 x, SKuint32 y, SKuint32 width, SKuint32 height) const;
+
+    // A lazy image that was never decoded is written out as the
+    // original file when the target format is the one it came from.
+    // Files ending in .qoi are written by the built-in QOI encoder,
+    // and PNG files by skPngWriter when it supports the format and the
+    // bitmap has no metadata, ICC profile or transparency table.
+    // skPngWriter does not write the pHYs resolution.
     void save(const char* file) const;
 
-    bool load(const char* file);
+    // With lazy set only the header is read, and the encoded bytes
+    // are kept until something needs the pixels. QOI files are read
+    // without FreeImage and always decoded right away.
+    bool load(const char* file, bool lazy = false);
 
-    bool loadFromMemory(void *mem, const SKsize& size);
+    bool loadFromMemory(void* mem, const SKsize& size, bool lazy = false);
 
 
     static void initialize();
@@ -159,6 +386,20 @@ public:
                      skPixelFormat  dstFmt,
                      skPixelFormat  srcFmt);
 
+    static void copy(SKubyte*       dst,
+                     SKuint32       dstPitch,
+                     const SKubyte* src,
+                     SKuint32       srcPitch,
+                     SKuint32       w,
+                     SKuint32       h,
+                     skPixelFormat  dstFmt,
+                     skPixelFormat  srcFmt);
+
+    // Interleaves single channel images of the same size into a new
+    // image. Null color channels are 0 and a null alpha is 255.
+    static skImage* mergeChannels(const skImage* const channels[SK_CHANNEL_MAX],
+                                  skPixelFormat             format);
+
     static SKuint32 getSize(const skPixelFormat& format);
 
     static skPixelFormat getFormat(SKuint32 bpp);
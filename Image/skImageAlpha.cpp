@@ -0,0 +1,290 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Image/skImage.h"
+#include "Image/skImageUtils.h"
+#include "Image/skParallel.h"
+
+
+// Unpremultiplying multiplies each color by reciprocal[a] / 65536,
+// with reciprocal[a] = round(255 * 65536 / a). For SSE2 the factor is
+// split into 16-bit high and low halves and spread over the lanes of
+// a pixel, with alpha itself scaled by one. There is a table for each
+// byte alpha can sit in.
+struct skAlphaTables
+{
+    SKuint32 reciprocal[256];
+    SKuint64 high[4][256];
+    SKuint64 low[4][256];
+
+    skAlphaTables()
+    {
+        reciprocal[0] = 0;
+        for (SKuint32 a = 1; a < 256; ++a)
+            reciprocal[a] = (255 * 65536 + a / 2) / a;
+
+        for (SKuint32 lane = 0; lane < 4; ++lane)
+        {
+            for (SKuint32 a = 0; a < 256; ++a)
+            {
+                high[lane][a] = 0;
+                low[lane][a]  = 0;
+                for (SKuint32 c = 0; c < 4; ++c)
+                {
+                    const SKuint64 hi = c == lane ? 1 : reciprocal[a] >> 16;
+                    const SKuint64 lo = c == lane ? 0 : reciprocal[a] & 0xFFFF;
+                    high[lane][a] |= hi << (c * 16);
+                    low[lane][a] |= lo << (c * 16);
+                }
+            }
+        }
+    }
+};
+
+static const skAlphaTables& getAlphaTables()
+{
+    static const skAlphaTables tables;
+    return tables;
+}
+
+// round(c * a / 255) without a divide.
+static SKubyte premultiplyChannel(const SKuint32 c, const SKuint32 a)
+{
+    const SKuint32 t = c * a + 128;
+    return (SKubyte)((t + (t >> 8)) >> 8);
+}
+
+static SKubyte unpremultiplyChannel(const SKuint32 c, const SKuint32 r)
+{
+    return (SKubyte)skMin<SKuint32>((c * r + 32768) >> 16, 255);
+}
+
+#ifdef SK_IMAGE_SSE2
+
+// Selects the 16-bit lane A of each pixel.
+template <int A>
+static __m128i alphaMask()
+{
+    return _mm_set_epi16(A == 3 ? -1 : 0,
+                         A == 2 ? -1 : 0,
+                         A == 1 ? -1 : 0,
+                         A == 0 ? -1 : 0,
+                         A == 3 ? -1 : 0,
+                         A == 2 ? -1 : 0,
+                         A == 1 ? -1 : 0,
+                         A == 0 ? -1 : 0);
+}
+
+template <int A>
+static SKuint32 premultiplyRowSSE2(SKubyte* row, const SKuint32 w)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i keep = alphaMask<A>();
+    const __m128i one  = _mm_and_si128(keep, _mm_set1_epi16(255));
+    const __m128i bias = _mm_set1_epi16(128);
+
+    SKuint32 x = 0;
+    for (; x + 4 <= w; x += 4)
+    {
+        __m128i*      p = (__m128i*)(row + (SKsize)x * 4);
+        const __m128i v = _mm_loadu_si128(p);
+
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+
+        __m128i alo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(A, A, A, A)), _MM_SHUFFLE(A, A, A, A));
+        __m128i ahi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(A, A, A, A)), _MM_SHUFFLE(A, A, A, A));
+        alo         = _mm_or_si128(_mm_andnot_si128(keep, alo), one);
+        ahi         = _mm_or_si128(_mm_andnot_si128(keep, ahi), one);
+
+        lo = _mm_add_epi16(_mm_mullo_epi16(lo, alo), bias);
+        hi = _mm_add_epi16(_mm_mullo_epi16(hi, ahi), bias);
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+
+        _mm_storeu_si128(p, _mm_packus_epi16(lo, hi));
+    }
+    return x;
+}
+
+// (v * (hi << 16 | lo) + 32768) >> 16 in 16-bit lanes, clamped to 255.
+static __m128i scaleLanes(const __m128i v, const __m128i hi, const __m128i lo)
+{
+    __m128i r = _mm_mullo_epi16(v, hi);
+    r         = _mm_add_epi16(r, _mm_mulhi_epu16(v, lo));
+    r         = _mm_add_epi16(r, _mm_srli_epi16(_mm_mullo_epi16(v, lo), 15));
+    return _mm_sub_epi16(r, _mm_subs_epu16(r, _mm_set1_epi16(255)));
+}
+
+template <int A>
+static SKuint32 unpremultiplyRowSSE2(SKubyte* row, const SKuint32 w, const SKuint64* high, const SKuint64* low)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    SKuint32 x = 0;
+    for (; x + 4 <= w; x += 4)
+    {
+        SKubyte*      px = row + (SKsize)x * 4;
+        const __m128i v  = _mm_loadu_si128((const __m128i*)px);
+
+        const SKuint32 a0 = px[A], a1 = px[4 + A], a2 = px[8 + A], a3 = px[12 + A];
+
+        const __m128i lo = scaleLanes(_mm_unpacklo_epi8(v, zero),
+                                      _mm_set_epi64x((SKint64)high[a1], (SKint64)high[a0]),
+                                      _mm_set_epi64x((SKint64)low[a1], (SKint64)low[a0]));
+        const __m128i hi = scaleLanes(_mm_unpackhi_epi8(v, zero),
+                                      _mm_set_epi64x((SKint64)high[a3], (SKint64)high[a2]),
+                                      _mm_set_epi64x((SKint64)low[a3], (SKint64)low[a2]));
+
+        _mm_storeu_si128((__m128i*)px, _mm_packus_epi16(lo, hi));
+    }
+    return x;
+}
+
+static SKuint32 premultiplyRow(SKubyte* row, const SKuint32 w, const SKint32 alpha)
+{
+    switch (alpha)
+    {
+    case 0:
+        return premultiplyRowSSE2<0>(row, w);
+    case 1:
+        return premultiplyRowSSE2<1>(row, w);
+    case 2:
+        return premultiplyRowSSE2<2>(row, w);
+    default:
+        return premultiplyRowSSE2<3>(row, w);
+    }
+}
+
+static SKuint32 unpremultiplyRow(SKubyte* row, const SKuint32 w, const SKint32 alpha, const skAlphaTables& tables)
+{
+    const SKuint64* high = tables.high[alpha];
+    const SKuint64* low  = tables.low[alpha];
+    switch (alpha)
+    {
+    case 0:
+        return unpremultiplyRowSSE2<0>(row, w, high, low);
+    case 1:
+        return unpremultiplyRowSSE2<1>(row, w, high, low);
+    case 2:
+        return unpremultiplyRowSSE2<2>(row, w, high, low);
+    default:
+        return unpremultiplyRowSSE2<3>(row, w, high, low);
+    }
+}
+
+#endif
+
+static bool getAlphaOffset(const skPixelFormat format, SKint32& alpha)
+{
+    if (format != SK_RGBA && format != SK_BGRA && format != SK_ARGB && format != SK_ABGR)
+        return false;
+
+    SKint32 offs[SK_CHANNEL_MAX];
+    ImageUtils::getChannelOffsets(format, offs);
+    alpha = offs[3];
+    return true;
+}
+
+bool skImage::premultiplyAlpha()
+{
+    materialize();
+
+    SKint32 alpha;
+    if (!m_bytes || !getAlphaOffset(m_format, alpha))
+        return false;
+    if (m_premultiplied)
+        return true;
+
+    const SKuint32 threads = (SKsize)m_width * m_height >= SK_IMAGE_PARALLEL_MIN ? 0 : 1;
+
+    skParallel::forRange(
+        m_height,
+        64,
+        [&](const SKuint32 y0, const SKuint32 y1)
+        {
+            for (SKuint32 y = y0; y < y1; ++y)
+            {
+                SKubyte* row = m_bytes + (SKsize)y * m_pitch;
+
+                SKuint32 x = 0;
+#ifdef SK_IMAGE_SSE2
+                x = premultiplyRow(row, m_width, alpha);
+#endif
+                for (SKubyte* px = row + (SKsize)x * 4; x < m_width; ++x, px += 4)
+                {
+                    const SKuint32 a = px[alpha];
+                    for (SKint32 c = 0; c < 4; ++c)
+                    {
+                        if (c != alpha)
+                            px[c] = premultiplyChannel(px[c], a);
+                    }
+                }
+            }
+        },
+        threads);
+
+    m_premultiplied = true;
+    return true;
+}
+
+bool skImage::unpremultiplyAlpha()
+{
+    materialize();
+
+    SKint32 alpha;
+    if (!m_bytes || !getAlphaOffset(m_format, alpha))
+        return false;
+    if (!m_premultiplied)
+        return true;
+
+    const skAlphaTables& tables  = getAlphaTables();
+    const SKuint32       threads = (SKsize)m_width * m_height >= SK_IMAGE_PARALLEL_MIN ? 0 : 1;
+
+    skParallel::forRange(
+        m_height,
+        64,
+        [&](const SKuint32 y0, const SKuint32 y1)
+        {
+            for (SKuint32 y = y0; y < y1; ++y)
+            {
+                SKubyte* row = m_bytes + (SKsize)y * m_pitch;
+
+                SKuint32 x = 0;
+#ifdef SK_IMAGE_SSE2
+                x = unpremultiplyRow(row, m_width, alpha, tables);
+#endif
+                for (SKubyte* px = row + (SKsize)x * 4; x < m_width; ++x, px += 4)
+                {
+                    const SKuint32 r = tables.reciprocal[px[alpha]];
+                    for (SKint32 c = 0; c < 4; ++c)
+                    {
+                        if (c != alpha)
+                            px[c] = unpremultiplyChannel(px[c], r);
+                    }
+                }
+            }
+        },
+        threads);
+
+    m_premultiplied = false;
+    return true;
+}
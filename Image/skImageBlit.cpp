@@ -0,0 +1,212 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Image/skImage.h"
+#include "Image/skImageUtils.h"
+#include "Image/skParallel.h"
+
+
+// Lerps each stored byte toward the packed color by
+// cover * alpha / 255, rounded as in ImageUtils::blendPixel. The
+// packed alpha is 255, which makes the alpha byte source-over.
+static void blendSpan(SKubyte*       dst,
+                      const SKubyte* cover,
+                      const SKuint32 w,
+                      const SKuint32 bpp,
+                      const SKubyte* color,
+                      const SKuint32 alpha)
+{
+    SKuint32 x = 0;
+#ifdef SK_IMAGE_SSE2
+    if (bpp == 4)
+    {
+        SKuint32 packed;
+        skMemcpy(&packed, color, 4);
+
+        const __m128i zero  = _mm_setzero_si128();
+        const __m128i one   = _mm_set1_epi16(1);
+        const __m128i half  = _mm_set1_epi16(127);
+        const __m128i max   = _mm_set1_epi16(255);
+        const __m128i scale = _mm_set1_epi16((short)alpha);
+        const __m128i solid = _mm_set1_epi32((int)packed);
+        const __m128i src   = _mm_unpacklo_epi8(solid, zero);
+
+        for (; x + 8 <= w; x += 8)
+        {
+            const __m128i m = _mm_loadl_epi64((const __m128i*)(cover + x));
+
+            const int bits = _mm_movemask_epi8(_mm_cmpeq_epi8(m, zero)) & 0xFF;
+            if (bits == 0xFF)
+                continue;
+
+            __m128i* p = (__m128i*)(dst + (SKsize)x * 4);
+            if (alpha == 255 && (_mm_movemask_epi8(_mm_cmpeq_epi8(m, _mm_set1_epi8(-1))) & 0xFF) == 0xFF)
+            {
+                _mm_storeu_si128(p, solid);
+                _mm_storeu_si128(p + 1, solid);
+                continue;
+            }
+
+            // c = (m * alpha + 127) / 255, with x / 255 as (x + 1 + (x >> 8)) >> 8
+            __m128i c = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(m, zero), scale), half);
+            c         = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(c, one), _mm_srli_epi16(c, 8)), 8);
+
+            const __m128i cl = _mm_unpacklo_epi16(c, c);
+            const __m128i ch = _mm_unpackhi_epi16(c, c);
+
+            const __m128i cover4[4] = {
+                _mm_unpacklo_epi32(cl, cl),
+                _mm_unpackhi_epi32(cl, cl),
+                _mm_unpacklo_epi32(ch, ch),
+                _mm_unpackhi_epi32(ch, ch),
+            };
+
+            for (SKuint32 i = 0; i < 2; ++i)
+            {
+                const __m128i d = _mm_loadu_si128(p + i);
+
+                __m128i r[2];
+                for (SKuint32 j = 0; j < 2; ++j)
+                {
+                    const __m128i cv = cover4[i * 2 + j];
+                    const __m128i dv = j ? _mm_unpackhi_epi8(d, zero) : _mm_unpacklo_epi8(d, zero);
+
+                    __m128i t = _mm_add_epi16(_mm_mullo_epi16(src, cv),
+                                              _mm_mullo_epi16(dv, _mm_sub_epi16(max, cv)));
+                    t         = _mm_add_epi16(t, half);
+                    r[j]      = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(t, one), _mm_srli_epi16(t, 8)), 8);
+                }
+                _mm_storeu_si128(p + i, _mm_packus_epi16(r[0], r[1]));
+            }
+        }
+    }
+#endif
+    for (dst += (SKsize)x * bpp; x < w; ++x, dst += bpp)
+    {
+        const SKuint32 c = (cover[x] * alpha + 127) / 255;
+        if (c == 0)
+            continue;
+
+        const SKuint32 ic = 255 - c;
+        for (SKuint32 i = 0; i < bpp; ++i)
+            dst[i] = (SKubyte)((color[i] * c + dst[i] * ic + 127) / 255);
+    }
+}
+
+bool skImage::blitMask(const skImage& mask,
+                       const SKint32  x,
+                       const SKint32  y,
+                       const skPixel& col) const
+{
+    skGlyphQuad quad;
+    quad.x      = x;
+    quad.y      = y;
+    quad.srcX   = 0;
+    quad.srcY   = 0;
+    quad.width  = mask.getWidth();
+    quad.height = mask.getHeight();
+    return blitMasks(mask, &quad, 1, col);
+}
+
+bool skImage::blitMasks(const skImage&     atlas,
+                        const skGlyphQuad* quads,
+                        const SKuint32     count,
+                        const skPixel&     col) const
+{
+    materialize();
+
+    if (!m_bytes || !ImageUtils::isByteFormat(m_format) ||
+        !atlas.getBytes() || atlas.getBPP() != 1 || !ImageUtils::isByteFormat(atlas.getFormat()))
+        return false;
+
+    if (!quads || count == 0 || col.a == 0)
+        return true;
+
+    SKubyte color[4] = {};
+    packPixel(color, col);
+
+    // col.a already scales the coverage, so alpha is composited as
+    // a' = c + a * (255 - c) / 255 rather than lerped toward col.a.
+    SKint32 offs[SK_CHANNEL_MAX];
+    if (ImageUtils::hasAlpha(m_format) && ImageUtils::getChannelOffsets(m_format, offs))
+        color[offs[3]] = 255;
+    else if (m_format == SK_ALPHA)
+        color[0] = 255;
+
+    const SKint64 aw = atlas.getWidth();
+    const SKint64 ah = atlas.getHeight();
+
+    SKsize area = 0;
+    for (SKuint32 i = 0; i < count; ++i)
+        area += (SKsize)quads[i].width * quads[i].height;
+
+    const SKuint32 threads = area >= SK_IMAGE_PARALLEL_MIN ? 0 : 1;
+
+    // Bands of target rows are independent, and each applies the quads
+    // in order so overlapping glyphs blend the same as serially.
+    skParallel::forRange(
+        m_height,
+        64,
+        [&](const SKuint32 y0, const SKuint32 y1)
+        {
+            for (SKuint32 i = 0; i < count; ++i)
+            {
+                const skGlyphQuad& q = quads[i];
+
+                // Clip the source rectangle to the atlas, then to the band.
+                SKint64 sx0 = q.srcX, sy0 = q.srcY;
+                SKint64 sx1 = skMin<SKint64>(sx0 + q.width, aw);
+                SKint64 sy1 = skMin<SKint64>(sy0 + q.height, ah);
+
+                SKint64 dx0 = (SKint64)q.x, dy0 = (SKint64)q.y;
+                if (dx0 < 0)
+                {
+                    sx0 -= dx0;
+                    dx0 = 0;
+                }
+                if (dy0 < (SKint64)y0)
+                {
+                    sy0 += (SKint64)y0 - dy0;
+                    dy0 = y0;
+                }
+
+                sx1 = skMin<SKint64>(sx1, sx0 + (SKint64)m_width - dx0);
+                sy1 = skMin<SKint64>(sy1, sy0 + (SKint64)y1 - dy0);
+                if (sx0 >= sx1 || sy0 >= sy1)
+                    continue;
+
+                const SKuint32 w = (SKuint32)(sx1 - sx0);
+                for (SKint64 sy = sy0; sy < sy1; ++sy)
+                {
+                    const SKuint32 ty = (SKuint32)(dy0 + sy - sy0);
+                    const SKuint32 ay = (SKuint32)sy;
+
+                    const SKubyte* cover = atlas.getBytes() +
+                                           (SKsize)(atlas.isFlipY() ? ah - 1 - ay : ay) * atlas.getPitch() +
+                                           (SKsize)sx0;
+
+                    blendSpan(m_bytes + getBufferPos((SKuint32)dx0, ty), cover, w, m_bpp, color, col.a);
+                }
+            }
+        },
+        threads);
+    return true;
+}
@@ -0,0 +1,357 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Image/skImageCache.h"
+#include "Image/skImage.h"
+#include "Image/skMipChain.h"
+
+const SKuint64 Prime1 = 0x9E3779B185EBCA87ULL;
+const SKuint64 Prime2 = 0xC2B2AE3D27D4EB4FULL;
+const SKuint64 Prime3 = 0x165667B19E3779F9ULL;
+const SKuint64 Prime4 = 0x85EBCA77C2B2AE63ULL;
+const SKuint64 Prime5 = 0x27D4EB2F165667C5ULL;
+
+static SKuint64 rotl(const SKuint64 v, const SKuint32 r)
+{
+    return (v << r) | (v >> (64 - r));
+}
+
+static SKuint64 read64(const SKubyte* p)
+{
+    SKuint64 v = 0;
+    for (SKuint32 i = 0; i < 8; ++i)
+        v |= (SKuint64)p[i] << (i * 8);
+    return v;
+}
+
+static SKuint32 read32(const SKubyte* p)
+{
+    return (SKuint32)p[0] | (SKuint32)p[1] << 8 | (SKuint32)p[2] << 16 | (SKuint32)p[3] << 24;
+}
+
+static SKuint64 hashRound(SKuint64 acc, const SKuint64 input)
+{
+    acc += input * Prime2;
+    acc = rotl(acc, 31);
+    return acc * Prime1;
+}
+
+static SKuint64 mergeRound(SKuint64 acc, const SKuint64 val)
+{
+    acc ^= hashRound(0, val);
+    return acc * Prime1 + Prime4;
+}
+
+SKuint64 skImageCache::hash(const void* mem, const SKsize size, const SKuint64 seed)
+{
+    const SKubyte* p   = (const SKubyte*)mem;
+    const SKubyte* end = p + size;
+    SKuint64       h;
+
+    if (size >= 32)
+    {
+        SKuint64 v1 = seed + Prime1 + Prime2;
+        SKuint64 v2 = seed + Prime2;
+        SKuint64 v3 = seed;
+        SKuint64 v4 = seed - Prime1;
+
+        const SKubyte* limit = end - 32;
+        do
+        {
+            v1 = hashRound(v1, read64(p));
+            v2 = hashRound(v2, read64(p + 8));
+            v3 = hashRound(v3, read64(p + 16));
+            v4 = hashRound(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = mergeRound(h, v1);
+        h = mergeRound(h, v2);
+        h = mergeRound(h, v3);
+        h = mergeRound(h, v4);
+    }
+    else
+        h = seed + Prime5;
+
+    h += (SKuint64)size;
+
+    for (; p + 8 <= end; p += 8)
+    {
+        h ^= hashRound(0, read64(p));
+        h = rotl(h, 27) * Prime1 + Prime4;
+    }
+
+    if (p + 4 <= end)
+    {
+        h ^= (SKuint64)read32(p) * Prime1;
+        h = rotl(h, 23) * Prime2 + Prime3;
+        p += 4;
+    }
+
+    for (; p < end; ++p)
+    {
+        h ^= (SKuint64)*p * Prime5;
+        h = rotl(h, 11) * Prime1;
+    }
+
+    h ^= h >> 33;
+    h *= Prime2;
+    h ^= h >> 29;
+    h *= Prime3;
+    h ^= h >> 32;
+    return h;
+}
+
+skImageHandle::skImageHandle(const std::shared_ptr<const skImage>& image) :
+    m_image(image)
+{
+}
+
+SKuint32 skImageHandle::getWidth() const
+{
+    return m_image ? m_image->getWidth() : 0;
+}
+
+SKuint32 skImageHandle::getHeight() const
+{
+    return m_image ? m_image->getHeight() : 0;
+}
+
+SKuint32 skImageHandle::getPitch() const
+{
+    return m_image ? m_image->getPitch() : 0;
+}
+
+SKuint32 skImageHandle::getBPP() const
+{
+    return m_image ? m_image->getBPP() : 0;
+}
+
+SKsize skImageHandle::getSizeInBytes() const
+{
+    return m_image ? m_image->getSizeInBytes() : 0;
+}
+
+skPixelFormat skImageHandle::getFormat() const
+{
+    return m_image ? m_image->getFormat() : SK_PF_MAX;
+}
+
+bool skImageHandle::isFlipY() const
+{
+    return m_image && m_image->isFlipY();
+}
+
+bool skImageHandle::isPremultiplied() const
+{
+    return m_image && m_image->isPremultiplied();
+}
+
+const SKubyte* skImageHandle::getBytes() const
+{
+    return m_image ? m_image->getBytes() : nullptr;
+}
+
+void skImageHandle::getPixel(const SKuint32 x, const SKuint32 y, skPixel& pixel) const
+{
+    if (m_image)
+        m_image->getPixel(x, y, pixel);
+}
+
+skImage* skImageHandle::convertToFormat(const skPixelFormat format,
+                                        const skLumWeights  weights) const
+{
+    return m_image ? m_image->convertToFormat(format, weights) : nullptr;
+}
+
+skImage* skImageHandle::copy() const
+{
+    return m_image ? m_image->convertToFormat(m_image->getFormat()) : nullptr;
+}
+
+skImageCache::skImageCache(const SKsize budget) :
+    m_bytes(0),
+    m_budget(budget),
+    m_hits(0),
+    m_misses(0),
+    m_evictions(0)
+{
+}
+
+skImageCache::~skImageCache()
+{
+    clear();
+}
+
+void skImageCache::setBudget(const SKsize budget)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_budget = budget;
+    trim(m_budget);
+}
+
+SKsize skImageCache::getBudget() const
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    return m_budget;
+}
+
+void skImageCache::trim(const SKsize budget)
+{
+    while (m_bytes > budget && !m_entries.empty())
+    {
+        const Entry& last = m_entries.back();
+        m_bytes -= last.bytes;
+        m_map.erase(last.key);
+        m_entries.pop_back();
+        ++m_evictions;
+    }
+}
+
+skImage* skImageCache::decode(const void*         mem,
+                              const SKsize        size,
+                              const skPixelFormat format,
+                              const SKuint32      maxWidth,
+                              const SKuint32      maxHeight)
+{
+    skImage* img = new skImage();
+    if (!img->loadFromMemory(const_cast<void*>(mem), size))
+    {
+        delete img;
+        return nullptr;
+    }
+
+    const skPixelFormat target = format == SK_PF_MAX ? img->getFormat() : format;
+
+    const bool fitsX = maxWidth == 0 || img->getWidth() <= maxWidth;
+    const bool fitsY = maxHeight == 0 || img->getHeight() <= maxHeight;
+    if (!fitsX || !fitsY)
+    {
+        skMipChain* chain = img->buildMipChain();
+        delete img;
+        img = nullptr;
+
+        if (chain)
+        {
+            SKuint32 level = 0;
+            while (level + 1 < chain->getLevelCount() &&
+                   ((maxWidth != 0 && chain->getLevelWidth(level) > maxWidth) ||
+                    (maxHeight != 0 && chain->getLevelHeight(level) > maxHeight)))
+                ++level;
+
+            img = chain->getLevel(level);
+            delete chain;
+        }
+        if (!img)
+            return nullptr;
+    }
+
+    if (img->getFormat() != target)
+    {
+        skImage* cvt = img->convertToFormat(target);
+        delete img;
+        img = cvt;
+    }
+    return img;
+}
+
+skImageHandle skImageCache::load(const void*         mem,
+                                 const SKsize        size,
+                                 const skPixelFormat format,
+                                 const SKuint32      maxWidth,
+                                 const SKuint32      maxHeight)
+{
+    if (!mem || size == 0)
+        return skImageHandle();
+
+    const Key key = {hash(mem, size), size, format, maxWidth, maxHeight};
+
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+
+        const EntryMap::iterator it = m_map.find(key);
+        if (it != m_map.end())
+        {
+            m_entries.splice(m_entries.begin(), m_entries, it->second);
+            ++m_hits;
+            return skImageHandle(it->second->image);
+        }
+        ++m_misses;
+    }
+
+    // Decoding happens outside the lock so that other keys are not
+    // held up by it.
+    skImage* img = decode(mem, size, format, maxWidth, maxHeight);
+    if (!img)
+        return skImageHandle();
+
+    const std::shared_ptr<const skImage> image(img);
+    const SKsize                         bytes = img->getSizeInBytes();
+
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    // Another thread may have decoded the same bytes meanwhile.
+    const EntryMap::iterator it = m_map.find(key);
+    if (it != m_map.end())
+    {
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        return skImageHandle(it->second->image);
+    }
+
+    if (bytes > m_budget)
+        return skImageHandle(image);
+
+    trim(m_budget - bytes);
+
+    const Entry entry = {key, image, bytes};
+    m_entries.push_front(entry);
+    m_map[key] = m_entries.begin();
+    m_bytes += bytes;
+    return skImageHandle(image);
+}
+
+void skImageCache::clear()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_map.clear();
+    m_entries.clear();
+    m_bytes = 0;
+}
+
+void skImageCache::getStats(skImageCacheStats& stats) const
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    stats.hits      = m_hits;
+    stats.misses    = m_misses;
+    stats.evictions = m_evictions;
+    stats.entries   = m_entries.size();
+    stats.bytes     = m_bytes;
+    stats.budget    = m_budget;
+}
+
+void skImageCache::resetStats()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_hits      = 0;
+    m_misses    = 0;
+    m_evictions = 0;
+}
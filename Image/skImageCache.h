@@ -0,0 +1,178 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _skImageCache_h_
+#define _skImageCache_h_
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "Image/skImageTypes.h"
+#include "Utils/Config/skConfig.h"
+
+class skImage;
+class skPixel;
+
+// Shared read-only handle to a cached image. It stays valid after
+// the cache drops the entry. Only the read accessors are exposed, since
+// the drawing members of skImage are const and would write into pixels
+// every other holder sees; take a copy to modify them.
+class skImageHandle
+{
+private:
+    friend class skImageCache;
+
+    std::shared_ptr<const skImage> m_image;
+
+    explicit skImageHandle(const std::shared_ptr<const skImage>& image);
+
+public:
+    skImageHandle() = default;
+
+    bool isValid() const
+    {
+        return m_image != nullptr;
+    }
+
+    SKuint32 getWidth() const;
+
+    SKuint32 getHeight() const;
+
+    SKuint32 getPitch() const;
+
+    SKuint32 getBPP() const;
+
+    SKsize getSizeInBytes() const;
+
+    skPixelFormat getFormat() const;
+
+    bool isFlipY() const;
+
+    bool isPremultiplied() const;
+
+    const SKubyte* getBytes() const;
+
+    void getPixel(SKuint32 x, SKuint32 y, skPixel& pixel) const;
+
+    // Returns a private copy in the requested format.
+    skImage* convertToFormat(skPixelFormat format,
+                             skLumWeights  weights = SK_LUM_AVERAGE) const;
+
+    // Returns a private copy in the cached format.
+    skImage* copy() const;
+};
+
+// Keeps decoded images keyed by a hash of the encoded bytes and the
+// requested format and size, evicting the least recently used ones
+// once the decoded bytes exceed the budget. All methods are safe to
+// call from several threads.
+class skImageCache
+{
+private:
+    struct Key
+    {
+        SKuint64      hash;
+        SKsize        size;
+        skPixelFormat format;
+        SKuint32      maxWidth;
+        SKuint32      maxHeight;
+
+        bool operator==(const Key& rhs) const
+        {
+            return hash == rhs.hash &&
+                   size == rhs.size &&
+                   format == rhs.format &&
+                   maxWidth == rhs.maxWidth &&
+                   maxHeight == rhs.maxHeight;
+        }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const
+        {
+            return (size_t)(key.hash ^ ((SKuint64)key.format << 56) ^
+                            ((SKuint64)key.maxWidth << 32) ^ key.maxHeight);
+        }
+    };
+
+    struct Entry
+    {
+        Key                            key;
+        std::shared_ptr<const skImage> image;
+        SKsize                         bytes;
+    };
+
+    typedef std::list<Entry>                                      EntryList;
+    typedef std::unordered_map<Key, EntryList::iterator, KeyHash> EntryMap;
+
+    mutable std::mutex m_lock;
+    EntryList          m_entries;
+    EntryMap           m_map;
+    SKsize             m_bytes;
+    SKsize             m_budget;
+    SKuint64           m_hits;
+    SKuint64           m_misses;
+    SKuint64           m_evictions;
+
+    void trim(SKsize budget);
+
+    static skImage* decode(const void*   mem,
+                           SKsize        size,
+                           skPixelFormat format,
+                           SKuint32      maxWidth,
+                           SKuint32      maxHeight);
+
+public:
+    explicit skImageCache(SKsize budget = 64 * 1024 * 1024);
+    ~skImageCache();
+
+    skImageCache(const skImageCache& rhs) = delete;
+    skImageCache& operator=(const skImageCache& rhs) = delete;
+
+    // Lowering the budget evicts right away.
+    void setBudget(SKsize budget);
+
+    SKsize getBudget() const;
+
+    // Returns the decoded image for mem, decoding it on a miss. A
+    // format of SK_PF_MAX keeps the decoded format. Non-zero bounds
+    // halve the image until it fits, so it may end up smaller than
+    // asked for. Images larger than the budget are returned but not
+    // kept.
+    skImageHandle load(const void*   mem,
+                       SKsize        size,
+                       skPixelFormat format    = SK_PF_MAX,
+                       SKuint32      maxWidth  = 0,
+                       SKuint32      maxHeight = 0);
+
+    void clear();
+
+    void getStats(skImageCacheStats& stats) const;
+
+    void resetStats();
+
+    // 64-bit content hash, compatible with XXH64.
+    static SKuint64 hash(const void* mem, SKsize size, SKuint64 seed = 0);
+};
+
+#endif  //_skImageCache_h_
@@ -0,0 +1,378 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Image/skImage.h"
+#include "Image/skImageUtils.h"
+#include "Image/skParallel.h"
+
+
+// Channel offsets with every byte owned by one channel: luminance is
+// red, SK_ALPHA is only alpha, and aliased offsets are dropped.
+static bool getStoredOffsets(const skPixelFormat format, SKint32 offs[SK_CHANNEL_MAX])
+{
+    if (!ImageUtils::getChannelOffsets(format, offs))
+        return false;
+
+    if (format == SK_ALPHA)
+        offs[0] = offs[1] = offs[2] = -1;
+    else if (format == SK_LUMINANCE)
+        offs[1] = offs[2] = offs[3] = -1;
+    else if (format == SK_LUMINANCE_ALPHA)
+        offs[1] = offs[2] = -1;
+    return true;
+}
+
+static bool isSingleChannel(const skImage& img)
+{
+    return img.getBytes() && img.getBPP() == 1 && ImageUtils::isByteFormat(img.getFormat());
+}
+
+static SKubyte* getRow(const skImage& img, const SKuint32 y)
+{
+    return img.getBytes() + (SKsize)(img.isFlipY() ? img.getHeight() - 1 - y : y) * img.getPitch();
+}
+
+static void extractRow(SKubyte*       dst,
+                       const SKubyte* src,
+                       const SKuint32 w,
+                       const SKuint32 bpp,
+                       const SKint32  offs)
+{
+    SKuint32 x = 0;
+#ifdef SK_IMAGE_SSE2
+    if (bpp == 4)
+    {
+        const __m128i mask  = _mm_set1_epi32(0xFF);
+        const __m128i shift = _mm_cvtsi32_si128(offs * 8);
+
+        for (; x + 16 <= w; x += 16)
+        {
+            const __m128i* p = (const __m128i*)(src + (SKsize)x * 4);
+
+            const __m128i a = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(p + 0), shift), mask);
+            const __m128i b = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(p + 1), shift), mask);
+            const __m128i c = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(p + 2), shift), mask);
+            const __m128i d = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(p + 3), shift), mask);
+
+            _mm_storeu_si128((__m128i*)(dst + x),
+                             _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+        }
+    }
+#endif
+    if (bpp == 1)
+    {
+        skMemcpy(dst, src, w);
+        return;
+    }
+
+    for (src += (SKsize)x * bpp + offs; x < w; ++x, src += bpp)
+        dst[x] = *src;
+}
+
+static void insertRow(SKubyte*       dst,
+                      const SKubyte* src,
+                      const SKuint32 w,
+                      const SKuint32 bpp,
+                      const SKint32  offs)
+{
+    SKuint32 x = 0;
+#ifdef SK_IMAGE_SSE2
+    if (bpp == 4)
+    {
+        const __m128i zero  = _mm_setzero_si128();
+        const __m128i shift = _mm_cvtsi32_si128(offs * 8);
+        const __m128i keep  = _mm_xor_si128(_mm_sll_epi32(_mm_set1_epi32(0xFF), shift), _mm_set1_epi32(-1));
+
+        for (; x + 16 <= w; x += 16)
+        {
+            __m128i*      p  = (__m128i*)(dst + (SKsize)x * 4);
+            const __m128i v  = _mm_loadu_si128((const __m128i*)(src + x));
+            const __m128i lo = _mm_unpacklo_epi8(v, zero);
+            const __m128i hi = _mm_unpackhi_epi8(v, zero);
+
+            const __m128i s[4] = {
+                _mm_unpacklo_epi16(lo, zero),
+                _mm_unpackhi_epi16(lo, zero),
+                _mm_unpacklo_epi16(hi, zero),
+                _mm_unpackhi_epi16(hi, zero),
+            };
+
+            for (SKuint32 i = 0; i < 4; ++i)
+            {
+                const __m128i d = _mm_and_si128(_mm_loadu_si128(p + i), keep);
+                _mm_storeu_si128(p + i, _mm_or_si128(d, _mm_sll_epi32(s[i], shift)));
+            }
+        }
+    }
+#endif
+    if (bpp == 1)
+    {
+        skMemcpy(dst, src, w);
+        return;
+    }
+
+    for (dst += (SKsize)x * bpp + offs; x < w; ++x, dst += bpp)
+        *dst = src[x];
+}
+
+static void fillChannel(SKubyte*       dst,
+                        const SKuint32 w,
+                        const SKuint32 bpp,
+                        const SKint32  offs,
+                        const SKubyte  value)
+{
+    dst += offs;
+    for (SKuint32 x = 0; x < w; ++x, dst += bpp)
+        *dst = value;
+}
+
+skImage* skImage::extractChannel(const skChannel channel) const
+{
+    materialize();
+
+    SKint32 offs[SK_CHANNEL_MAX];
+    if (!m_bytes || channel >= SK_CHANNEL_MAX ||
+        !getStoredOffsets(m_format, offs) || offs[channel] < 0)
+        return nullptr;
+
+    skImage* img = new skImage(m_width, m_height, channel == SK_CHANNEL_A ? SK_ALPHA : SK_LUMINANCE);
+    if (!img->m_bytes)
+    {
+        delete img;
+        return nullptr;
+    }
+    img->setFlipY(m_flip);
+
+    const SKint32  off     = offs[channel];
+    const SKuint32 threads = (SKsize)m_width * m_height >= SK_IMAGE_PARALLEL_MIN ? 0 : 1;
+
+    skParallel::forRange(
+        m_height,
+        64,
+        [&](const SKuint32 y0, const SKuint32 y1)
+        {
+            for (SKuint32 y = y0; y < y1; ++y)
+                extractRow(img->m_bytes + (SKsize)y * img->m_pitch, m_bytes + (SKsize)y * m_pitch, m_width, m_bpp, off);
+        },
+        threads);
+
+    return img;
+}
+
+bool skImage::splitChannels(skImage* channels[SK_CHANNEL_MAX]) const
+{
+    for (SKuint32 c = 0; c < SK_CHANNEL_MAX; ++c)
+        channels[c] = nullptr;
+
+    SKint32 offs[SK_CHANNEL_MAX];
+    if (!getStoredOffsets(m_format, offs))
+        return false;
+
+    for (SKuint32 c = 0; c < SK_CHANNEL_MAX; ++c)
+    {
+        if (offs[c] < 0)
+            continue;
+
+        channels[c] = extractChannel((skChannel)c);
+        if (!channels[c])
+        {
+            for (SKuint32 i = 0; i < c; ++i)
+            {
+                delete channels[i];
+                channels[i] = nullptr;
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+bool skImage::insertChannel(const skChannel channel, const skImage& src) const
+{
+    materialize();
+
+    SKint32 offs[SK_CHANNEL_MAX];
+    if (!m_bytes || channel >= SK_CHANNEL_MAX || !isSingleChannel(src) ||
+        src.getWidth() != m_width || src.getHeight() != m_height ||
+        !getStoredOffsets(m_format, offs) || offs[channel] < 0)
+        return false;
+
+    const SKint32  off     = offs[channel];
+    const SKuint32 threads = (SKsize)m_width * m_height >= SK_IMAGE_PARALLEL_MIN ? 0 : 1;
+
+    skParallel::forRange(
+        m_height,
+        64,
+        [&](const SKuint32 y0, const SKuint32 y1)
+        {
+            for (SKuint32 y = y0; y < y1; ++y)
+                insertRow(getRow(*this, y), getRow(src, y), m_width, m_bpp, off);
+        },
+        threads);
+    return true;
+}
+
+bool skImage::swizzle(const skChannel order[SK_CHANNEL_MAX]) const
+{
+    materialize();
+
+    SKint32 offs[SK_CHANNEL_MAX];
+    if (!m_bytes || !getStoredOffsets(m_format, offs))
+        return false;
+
+    // Each stored byte names the byte it is taken from, or a constant
+    // when the source channel is not stored.
+    SKint32 from[SK_CHANNEL_MAX];
+    SKubyte value[SK_CHANNEL_MAX];
+    bool    identity = true;
+
+    for (SKuint32 i = 0; i < SK_CHANNEL_MAX; ++i)
+    {
+        from[i]  = -1;
+        value[i] = 0;
+    }
+
+    for (SKuint32 c = 0; c < SK_CHANNEL_MAX; ++c)
+    {
+        if (order[c] >= SK_CHANNEL_MAX)
+            return false;
+        if (offs[c] < 0)
+            continue;
+
+        from[offs[c]]  = offs[order[c]];
+        value[offs[c]] = order[c] == SK_CHANNEL_A ? 255 : 0;
+        identity       = identity && from[offs[c]] == offs[c];
+    }
+
+    if (identity)
+        return true;
+
+    bool constant = false;
+    for (SKuint32 i = 0; i < m_bpp; ++i)
+        constant = constant || from[i] < 0;
+
+    const SKuint32 threads = (SKsize)m_width * m_height >= SK_IMAGE_PARALLEL_MIN ? 0 : 1;
+
+    skParallel::forRange(
+        m_height,
+        64,
+        [&](const SKuint32 y0, const SKuint32 y1)
+        {
+            for (SKuint32 y = y0; y < y1; ++y)
+            {
+                SKubyte* row = m_bytes + (SKsize)y * m_pitch;
+
+                SKuint32 x = 0;
+#ifdef SK_IMAGE_SSE2
+                // Each byte of a pixel is moved into place by shifting
+                // the whole 32-bit lane and masking it.
+                if (m_bpp == 4 && !constant)
+                {
+                    const __m128i mask = _mm_set1_epi32(0xFF);
+
+                    __m128i src[4], dst[4];
+                    for (SKuint32 i = 0; i < 4; ++i)
+                    {
+                        src[i] = _mm_cvtsi32_si128(from[i] * 8);
+                        dst[i] = _mm_cvtsi32_si128(i * 8);
+                    }
+
+                    for (; x + 4 <= m_width; x += 4)
+                    {
+                        __m128i*      p = (__m128i*)(row + (SKsize)x * 4);
+                        const __m128i v = _mm_loadu_si128(p);
+
+                        __m128i r = _mm_setzero_si128();
+                        for (SKuint32 i = 0; i < 4; ++i)
+                            r = _mm_or_si128(r, _mm_sll_epi32(_mm_and_si128(_mm_srl_epi32(v, src[i]), mask), dst[i]));
+                        _mm_storeu_si128(p, r);
+                    }
+                }
+#endif
+                for (SKubyte* px = row + (SKsize)x * m_bpp; x < m_width; ++x, px += m_bpp)
+                {
+                    SKubyte tmp[4];
+                    for (SKuint32 i = 0; i < m_bpp; ++i)
+                        tmp[i] = from[i] < 0 ? value[i] : px[from[i]];
+                    skMemcpy(px, tmp, m_bpp);
+                }
+            }
+        },
+        threads);
+    return true;
+}
+
+skImage* skImage::mergeChannels(const skImage* const channels[SK_CHANNEL_MAX],
+                                const skPixelFormat  format)
+{
+    SKint32 offs[SK_CHANNEL_MAX];
+    if (!getStoredOffsets(format, offs))
+        return nullptr;
+
+    SKuint32 w = 0, h = 0;
+    for (SKuint32 c = 0; c < SK_CHANNEL_MAX; ++c)
+    {
+        const skImage* src = channels[c];
+        if (!src)
+            continue;
+        if (!isSingleChannel(*src) || (w && (src->getWidth() != w || src->getHeight() != h)))
+            return nullptr;
+
+        w = src->getWidth();
+        h = src->getHeight();
+    }
+
+    if (w == 0 || h == 0)
+        return nullptr;
+
+    skImage* img = new skImage(w, h, format);
+    if (!img->m_bytes)
+    {
+        delete img;
+        return nullptr;
+    }
+
+    const SKuint32 threads = (SKsize)w * h >= SK_IMAGE_PARALLEL_MIN ? 0 : 1;
+
+    skParallel::forRange(
+        h,
+        64,
+        [&](const SKuint32 y0, const SKuint32 y1)
+        {
+            for (SKuint32 y = y0; y < y1; ++y)
+            {
+                SKubyte* row = getRow(*img, y);
+                for (SKuint32 c = 0; c < SK_CHANNEL_MAX; ++c)
+                {
+                    if (offs[c] < 0)
+                        continue;
+
+                    if (channels[c])
+                        insertRow(row, getRow(*channels[c], y), w, img->m_bpp, offs[c]);
+                    else
+                        fillChannel(row, w, img->m_bpp, offs[c], c == SK_CHANNEL_A ? 255 : 0);
+                }
+            }
+        },
+        threads);
+
+    return img;
+}
@@ -0,0 +1,610 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include <math.h>
+#include <string.h>
+#include <mutex>
+#include "Image/skImage.h"
+#include "Image/skImageUtils.h"
+#include "Image/skParallel.h"
+
+
+struct skCompareBand
+{
+    SKuint64 abs[SK_CHANNEL_MAX];
+    SKuint64 sq[SK_CHANNEL_MAX];
+    SKuint32 max[SK_CHANNEL_MAX];
+    SKuint64 mismatches;
+    SKuint32 firstX;
+    SKuint32 firstY;
+};
+
+// SK_LUMINANCE reports its value as alpha too, which would make it
+// differ from formats that have no alpha.
+static bool getCompareOffsets(const skPixelFormat format, SKint32 offs[SK_CHANNEL_MAX])
+{
+    if (!ImageUtils::getChannelOffsets(format, offs))
+        return false;
+    if (format == SK_LUMINANCE)
+        offs[3] = -1;
+    return true;
+}
+
+// Palette and deep images are compared through 8-bit RGBA.
+static bool needsConversion(const skImage& a, const skImage& b)
+{
+    return !ImageUtils::isByteFormat(a.getFormat()) || !ImageUtils::isByteFormat(b.getFormat());
+}
+
+static const skImage* toComparable(const skImage& img, skImage*& temp)
+{
+    temp = nullptr;
+    if (ImageUtils::isByteFormat(img.getFormat()))
+        return &img;
+
+    temp = img.convertToFormat(SK_RGBA);
+    return temp && temp->getBytes() ? temp : nullptr;
+}
+
+static SKuint32 channelValue(const SKubyte* px, const SKint32 offs)
+{
+    return offs < 0 ? 255 : px[offs];
+}
+
+static void compareRow(skCompareBand& band,
+                       const SKubyte* a,
+                       const SKint32* offsA,
+                       SKuint32       bppA,
+                       const SKubyte* b,
+                       const SKint32* offsB,
+                       SKuint32       bppB,
+                       SKuint32       x,
+                       SKuint32       w,
+                       SKuint32       y)
+{
+    a += (SKsize)x * bppA;
+    b += (SKsize)x * bppB;
+
+    for (; x < w; ++x, a += bppA, b += bppB)
+    {
+        SKuint32 any = 0;
+        for (SKuint32 c = 0; c < SK_CHANNEL_MAX; ++c)
+        {
+            const SKint32  va = (SKint32)channelValue(a, offsA[c]);
+            const SKint32  vb = (SKint32)channelValue(b, offsB[c]);
+            const SKuint32 d  = (SKuint32)skABS(va - vb);
+
+            band.abs[c] += d;
+            band.sq[c] += d * d;
+            band.max[c] = skMax(band.max[c], d);
+            any |= d;
+        }
+
+        if (any)
+        {
+            if (band.mismatches++ == 0)
+            {
+                band.firstX = x;
+                band.firstY = y;
+            }
+        }
+    }
+}
+
+#ifdef SK_IMAGE_SSE2
+
+// Both rows hold the same 4 byte format. Sums are kept per byte lane
+// and mapped to channels by the caller.
+static SKuint32 compareRow4(skCompareBand& band,
+                            SKuint64       lanes[2][4],
+                            SKubyte        laneMax[16],
+                            const SKubyte* a,
+                            const SKubyte* b,
+                            const SKuint32 w,
+                            const SKuint32 y)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i       vmax = _mm_loadu_si128((const __m128i*)laneMax);
+
+    SKuint32 x = 0;
+    while (x + 4 <= w)
+    {
+        // 32 bit lanes gain at most 4 * 255^2 per step.
+        const SKuint32 end = skMin(w & ~3u, x + 16384);
+
+        __m128i vabs = zero;
+        __m128i vsq  = zero;
+
+        for (; x < end; x += 4)
+        {
+            const __m128i va = _mm_loadu_si128((const __m128i*)(a + (SKsize)x * 4));
+            const __m128i vb = _mm_loadu_si128((const __m128i*)(b + (SKsize)x * 4));
+            const __m128i d  = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+
+            vmax = _mm_max_epu8(vmax, d);
+
+            const SKuint32 same = (SKuint32)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(va, vb)));
+            if (same != 0xF)
+            {
+                for (SKuint32 i = 0; i < 4; ++i)
+                {
+                    if (same & (1 << i))
+                        continue;
+                    if (band.mismatches++ == 0)
+                    {
+                        band.firstX = x + i;
+                        band.firstY = y;
+                    }
+                }
+            }
+
+            const __m128i lo = _mm_unpacklo_epi8(d, zero);
+            const __m128i hi = _mm_unpackhi_epi8(d, zero);
+            const __m128i p0 = _mm_unpacklo_epi16(lo, zero);
+            const __m128i p1 = _mm_unpackhi_epi16(lo, zero);
+            const __m128i p2 = _mm_unpacklo_epi16(hi, zero);
+            const __m128i p3 = _mm_unpackhi_epi16(hi, zero);
+
+            vabs = _mm_add_epi32(vabs, _mm_add_epi32(_mm_add_epi32(p0, p1), _mm_add_epi32(p2, p3)));
+            vsq  = _mm_add_epi32(vsq,
+                                _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(p0, p0), _mm_madd_epi16(p1, p1)),
+                                              _mm_add_epi32(_mm_madd_epi16(p2, p2), _mm_madd_epi16(p3, p3))));
+        }
+
+        SKuint32 sa[4], sq[4];
+        _mm_storeu_si128((__m128i*)sa, vabs);
+        _mm_storeu_si128((__m128i*)sq, vsq);
+        for (SKuint32 i = 0; i < 4; ++i)
+        {
+            lanes[0][i] += sa[i];
+            lanes[1][i] += sq[i];
+        }
+    }
+
+    _mm_storeu_si128((__m128i*)laneMax, vmax);
+    return x;
+}
+
+#endif
+
+bool skImage::compare(const skImage& other, skImageComparison& result) const
+{
+    materialize();
+    other.materialize();
+
+    skMemset(&result, 0, sizeof(skImageComparison));
+    result.firstX = SK_NPOS32;
+    result.firstY = SK_NPOS32;
+
+    if (!m_bytes || !other.m_bytes || m_width != other.m_width || m_height != other.m_height)
+        return false;
+
+    if (needsConversion(*this, other))
+    {
+        skImage *ta, *tb;
+
+        const skImage* a  = toComparable(*this, ta);
+        const skImage* b  = toComparable(other, tb);
+        const bool     ok = a && b && a->compare(*b, result);
+        delete ta;
+        delete tb;
+        return ok;
+    }
+
+    SKint32 offsA[SK_CHANNEL_MAX], offsB[SK_CHANNEL_MAX];
+    if (!getCompareOffsets(m_format, offsA) || !getCompareOffsets(other.m_format, offsB))
+        return false;
+
+    const bool packed = m_format == other.m_format && m_bpp == 4;
+
+    skCompareBand total;
+    skMemset(&total, 0, sizeof(skCompareBand));
+    total.firstX = total.firstY = SK_NPOS32;
+
+    std::mutex lock;
+
+    const SKuint32 threads = (SKsize)m_width * m_height >= SK_IMAGE_PARALLEL_MIN ? 0 : 1;
+
+    skParallel::forRange(
+        m_height,
+        64,
+        [&](const SKuint32 y0, const SKuint32 y1)
+        {
+            skCompareBand band;
+            skMemset(&band, 0, sizeof(skCompareBand));
+
+            SKuint64 lanes[2][4] = {};
+            SKubyte  laneMax[16] = {};
+
+            for (SKuint32 y = y0; y < y1; ++y)
+            {
+                const SKubyte* a = m_bytes + (SKsize)(m_flip ? m_height - 1 - y : y) * m_pitch;
+                const SKubyte* b = other.m_bytes + (SKsize)(other.m_flip ? m_height - 1 - y : y) * other.m_pitch;
+
+                SKuint32 x = 0;
+#ifdef SK_IMAGE_SSE2
+                if (packed)
+                    x = compareRow4(band, lanes, laneMax, a, b, m_width, y);
+#endif
+                compareRow(band, a, offsA, m_bpp, b, offsB, other.m_bpp, x, m_width, y);
+            }
+
+            if (packed)
+            {
+                for (SKuint32 c = 0; c < SK_CHANNEL_MAX; ++c)
+                {
+                    const SKint32 lane = offsA[c];
+                    band.abs[c] += lanes[0][lane];
+                    band.sq[c] += lanes[1][lane];
+                    for (SKuint32 i = (SKuint32)lane; i < 16; i += 4)
+                        band.max[c] = skMax<SKuint32>(band.max[c], laneMax[i]);
+                }
+            }
+
+            std::lock_guard<std::mutex> guard(lock);
+            for (SKuint32 c = 0; c < SK_CHANNEL_MAX; ++c)
+            {
+                total.abs[c] += band.abs[c];
+                total.sq[c] += band.sq[c];
+                total.max[c] = skMax(total.max[c], band.max[c]);
+            }
+
+            if (band.mismatches > 0 && band.firstY < total.firstY)
+            {
+                total.firstX = band.firstX;
+                total.firstY = band.firstY;
+            }
+            total.mismatches += band.mismatches;
+        },
+        threads);
+
+    const double count = (double)m_width * m_height;
+    const double peak  = 255.0 * 255.0;
+
+    result.mismatches = total.mismatches;
+    result.firstX     = total.firstX;
+    result.firstY     = total.firstY;
+
+    for (SKuint32 c = 0; c < SK_CHANNEL_MAX; ++c)
+    {
+        result.maxError[c]  = total.max[c];
+        result.meanError[c] = (double)total.abs[c] / count;
+        result.mse[c]       = (double)total.sq[c] / count;
+        result.psnr[c]      = total.sq[c] ? 10.0 * log10(peak / result.mse[c]) : HUGE_VAL;
+    }
+
+    const SKuint64 colorSq = total.sq[0] + total.sq[1] + total.sq[2];
+    result.psnrColor       = colorSq ? 10.0 * log10(peak * 3.0 * count / (double)colorSq) : HUGE_VAL;
+    return true;
+}
+
+bool skImage::equals(const skImage& other, SKuint32* x, SKuint32* y) const
+{
+    materialize();
+    other.materialize();
+
+    if (x)
+        *x = SK_NPOS32;
+    if (y)
+        *y = SK_NPOS32;
+
+    if (!m_bytes || !other.m_bytes || m_width != other.m_width || m_height != other.m_height)
+        return false;
+
+    // Equal indices can still name different palette colors.
+    const bool same = m_format == other.m_format && m_format != SK_INDEXED8;
+
+    if (!same && needsConversion(*this, other))
+    {
+        skImage *ta, *tb;
+
+        const skImage* a  = toComparable(*this, ta);
+        const skImage* b  = toComparable(other, tb);
+        const bool     eq = a && b && a->equals(*b, x, y);
+        delete ta;
+        delete tb;
+        return eq;
+    }
+
+    SKint32 offsA[SK_CHANNEL_MAX], offsB[SK_CHANNEL_MAX];
+    if (!same && (!getCompareOffsets(m_format, offsA) || !getCompareOffsets(other.m_format, offsB)))
+        return false;
+
+    // Rows are compared in order and stop at the first difference, so
+    // this stays on one thread.
+    const SKsize rowBytes = (SKsize)m_width * m_bpp;
+
+    for (SKuint32 r = 0; r < m_height; ++r)
+    {
+        const SKubyte* a = m_bytes + (SKsize)(m_flip ? m_height - 1 - r : r) * m_pitch;
+        const SKubyte* b = other.m_bytes + (SKsize)(other.m_flip ? m_height - 1 - r : r) * other.m_pitch;
+
+        if (same)
+        {
+            if (memcmp(a, b, rowBytes) == 0)
+                continue;
+
+            SKuint32 c = 0;
+            while (memcmp(a + (SKsize)c * m_bpp, b + (SKsize)c * m_bpp, m_bpp) == 0)
+                ++c;
+
+            if (x)
+                *x = c;
+            if (y)
+                *y = r;
+            return false;
+        }
+
+        skCompareBand band;
+        skMemset(&band, 0, sizeof(skCompareBand));
+
+        compareRow(band, a, offsA, m_bpp, b, offsB, other.m_bpp, 0, m_width, r);
+        if (band.mismatches > 0)
+        {
+            if (x)
+                *x = band.firstX;
+            if (y)
+                *y = band.firstY;
+            return false;
+        }
+    }
+    return true;
+}
+
+skImage* skImage::difference(const skImage& other) const
+{
+    materialize();
+    other.materialize();
+
+    if (!m_bytes || !other.m_bytes || m_width != other.m_width || m_height != other.m_height)
+        return nullptr;
+
+    if (needsConversion(*this, other))
+    {
+        skImage *ta, *tb;
+
+        const skImage* a   = toComparable(*this, ta);
+        const skImage* b   = toComparable(other, tb);
+        skImage*       img = a && b ? a->difference(*b) : nullptr;
+        delete ta;
+        delete tb;
+        return img;
+    }
+
+    SKint32 offsA[SK_CHANNEL_MAX], offsB[SK_CHANNEL_MAX];
+    if (!getCompareOffsets(m_format, offsA) || !getCompareOffsets(other.m_format, offsB))
+        return nullptr;
+
+    skImage* img = new skImage(m_width, m_height, m_format);
+    if (!img->m_bytes)
+    {
+        delete img;
+        return nullptr;
+    }
+    img->setFlipY(m_flip);
+
+    const bool     same    = m_format == other.m_format;
+    const SKuint32 threads = (SKsize)m_width * m_height >= SK_IMAGE_PARALLEL_MIN ? 0 : 1;
+
+    skParallel::forRange(
+        m_height,
+        64,
+        [&](const SKuint32 y0, const SKuint32 y1)
+        {
+            for (SKuint32 y = y0; y < y1; ++y)
+            {
+                const SKubyte* a = m_bytes + (SKsize)(m_flip ? m_height - 1 - y : y) * m_pitch;
+                const SKubyte* b = other.m_bytes + (SKsize)(other.m_flip ? m_height - 1 - y : y) * other.m_pitch;
+                SKubyte*       d = img->m_bytes + (SKsize)(m_flip ? m_height - 1 - y : y) * img->m_pitch;
+
+                if (same)
+                {
+                    // Equal layouts diff byte for byte.
+                    const SKsize n = (SKsize)m_width * m_bpp;
+
+                    SKsize i = 0;
+#ifdef SK_IMAGE_SSE2
+                    for (; i + 16 <= n; i += 16)
+                    {
+                        const __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+                        const __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+                        _mm_storeu_si128((__m128i*)(d + i),
+                                         _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va)));
+                    }
+#endif
+                    for (; i < n; ++i)
+                        d[i] = (SKubyte)skABS((SKint32)a[i] - (SKint32)b[i]);
+                    continue;
+                }
+
+                for (SKuint32 x = 0; x < m_width; ++x, a += m_bpp, b += other.m_bpp, d += m_bpp)
+                {
+                    for (SKuint32 c = 0; c < SK_CHANNEL_MAX; ++c)
+                    {
+                        if (offsA[c] < 0)
+                            continue;
+
+                        const SKint32 va = (SKint32)channelValue(a, offsA[c]);
+                        const SKint32 vb = (SKint32)channelValue(b, offsB[c]);
+                        d[offsA[c]]      = (SKubyte)skABS(va - vb);
+                    }
+                }
+            }
+        },
+        threads);
+
+    return img;
+}
+
+// Rec. 601 luma in 8.8 fixed point; the weights sum to 256 so gray
+// values come back unchanged.
+static void lumaRow(SKubyte* dst, const SKubyte* src, const SKint32* offs, const SKuint32 bpp, const SKuint32 w)
+{
+    for (SKuint32 x = 0; x < w; ++x, src += bpp)
+        dst[x] = (SKubyte)((77 * src[offs[0]] + 150 * src[offs[1]] + 29 * src[offs[2]] + 128) >> 8);
+}
+
+bool skImage::computeSSIM(const skImage& other, double& ssim, SKuint32 window) const
+{
+    materialize();
+    other.materialize();
+
+    ssim = 0;
+
+    if (!m_bytes || !other.m_bytes || m_width != other.m_width || m_height != other.m_height)
+        return false;
+
+    if (needsConversion(*this, other))
+    {
+        skImage *ta, *tb;
+
+        const skImage* a  = toComparable(*this, ta);
+        const skImage* b  = toComparable(other, tb);
+        const bool     ok = a && b && a->computeSSIM(*b, ssim, window);
+        delete ta;
+        delete tb;
+        return ok;
+    }
+
+    SKint32 offsA[SK_CHANNEL_MAX], offsB[SK_CHANNEL_MAX];
+    if (!getCompareOffsets(m_format, offsA) || !getCompareOffsets(other.m_format, offsB))
+        return false;
+
+    window = skClamp<SKuint32>(window, 1, 256);
+    window = skMin(window, skMin(m_width, m_height));
+
+    const SKuint32 w       = m_width;
+    const SKuint32 h       = m_height;
+    const SKuint32 threads = (SKsize)w * h >= SK_IMAGE_PARALLEL_MIN ? 0 : 1;
+
+    SKubyte* lumA = new SKubyte[(SKsize)w * h];
+    SKubyte* lumB = new SKubyte[(SKsize)w * h];
+
+    skParallel::forRange(
+        h,
+        64,
+        [&](const SKuint32 y0, const SKuint32 y1)
+        {
+            for (SKuint32 y = y0; y < y1; ++y)
+            {
+                lumaRow(lumA + (SKsize)y * w, m_bytes + (SKsize)(m_flip ? h - 1 - y : y) * m_pitch, offsA, m_bpp, w);
+                lumaRow(lumB + (SKsize)y * w, other.m_bytes + (SKsize)(other.m_flip ? h - 1 - y : y) * other.m_pitch, offsB, other.m_bpp, w);
+            }
+        },
+        threads);
+
+    const double c1 = (0.01 * 255) * (0.01 * 255);
+    const double c2 = (0.03 * 255) * (0.03 * 255);
+    const double n  = (double)window * window;
+    const SKuint32 rows = h - window + 1;
+    const SKuint32 cols = w - window + 1;
+
+    double     sum = 0;
+    std::mutex lock;
+
+    // Each band keeps running column sums over the window height and
+    // slides them down; along a row the window sums slide the same
+    // way, so every box costs a constant amount of work.
+    skParallel::forRange(
+        rows,
+        32,
+        [&](const SKuint32 y0, const SKuint32 y1)
+        {
+            SKuint32* col = new SKuint32[(SKsize)w * 5];
+            SKuint32* sa  = col;
+            SKuint32* sb  = col + w;
+            SKuint32* saa = col + 2 * w;
+            SKuint32* sbb = col + 3 * w;
+            SKuint32* sab = col + 4 * w;
+            skMemset(col, 0, sizeof(SKuint32) * w * 5);
+
+            const auto addRow = [&](const SKuint32 y, const SKint32 sign)
+            {
+                const SKubyte* ra = lumA + (SKsize)y * w;
+                const SKubyte* rb = lumB + (SKsize)y * w;
+                for (SKuint32 x = 0; x < w; ++x)
+                {
+                    const SKuint32 a = ra[x], b = rb[x];
+                    sa[x] += sign * a;
+                    sb[x] += sign * b;
+                    saa[x] += sign * a * a;
+                    sbb[x] += sign * b * b;
+                    sab[x] += sign * a * b;
+                }
+            };
+
+            for (SKuint32 y = y0; y < y0 + window; ++y)
+                addRow(y, 1);
+
+            double local = 0;
+            for (SKuint32 y = y0; y < y1; ++y)
+            {
+                if (y > y0)
+                {
+                    addRow(y - 1, -1);
+                    addRow(y + window - 1, 1);
+                }
+
+                SKuint64 a = 0, b = 0, aa = 0, bb = 0, ab = 0;
+                for (SKuint32 x = 0; x < window; ++x)
+                {
+                    a += sa[x];
+                    b += sb[x];
+                    aa += saa[x];
+                    bb += sbb[x];
+                    ab += sab[x];
+                }
+
+                for (SKuint32 x = 0;; ++x)
+                {
+                    const double ma = (double)a / n;
+                    const double mb = (double)b / n;
+                    const double va = (double)aa / n - ma * ma;
+                    const double vb = (double)bb / n - mb * mb;
+                    const double cv = (double)ab / n - ma * mb;
+
+                    local += ((2 * ma * mb + c1) * (2 * cv + c2)) /
+                             ((ma * ma + mb * mb + c1) * (va + vb + c2));
+
+                    if (x + 1 >= cols)
+                        break;
+
+                    const SKuint32 o = x + window;
+                    a += (SKuint64)sa[o] - sa[x];
+                    b += (SKuint64)sb[o] - sb[x];
+                    aa += (SKuint64)saa[o] - saa[x];
+                    bb += (SKuint64)sbb[o] - sbb[x];
+                    ab += (SKuint64)sab[o] - sab[x];
+                }
+            }
+            delete[] col;
+
+            std::lock_guard<std::mutex> guard(lock);
+            sum += local;
+        },
+        threads);
+
+    delete[] lumA;
+    delete[] lumB;
+
+    ssim = sum / ((double)rows * cols);
+    return true;
+}
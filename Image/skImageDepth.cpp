@@ -0,0 +1,344 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Image/skImage.h"
+#include "Image/skImageUtils.h"
+#include "Image/skParallel.h"
+
+// Conversions involving 16-bit, half or float formats go through a
+// row of float r, g, b, a. The element kernels below convert whole
+// rows in memory order; the channels are then moved in a scalar pass.
+
+static void bytesToFloat(float* dst, const SKubyte* src, const SKsize n)
+{
+    const float scale = 1.f / 255.f;
+
+    SKsize i = 0;
+#ifdef SK_IMAGE_SSE2
+    const __m128  vs   = _mm_set1_ps(scale);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16)
+    {
+        const __m128i v  = _mm_loadu_si128((const __m128i*)(src + i));
+        const __m128i lo = _mm_unpacklo_epi8(v, zero);
+        const __m128i hi = _mm_unpackhi_epi8(v, zero);
+
+        _mm_storeu_ps(dst + i + 0, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), vs));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), vs));
+        _mm_storeu_ps(dst + i + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), vs));
+        _mm_storeu_ps(dst + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), vs));
+    }
+#endif
+    for (; i < n; ++i)
+        dst[i] = src[i] * scale;
+}
+
+static void floatToBytes(SKubyte* dst, const float* src, const SKsize n)
+{
+    SKsize i = 0;
+#ifdef SK_IMAGE_SSE2
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one  = _mm_set1_ps(1.f);
+    const __m128 vs   = _mm_set1_ps(255.f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v[4];
+        for (SKuint32 k = 0; k < 4; ++k)
+        {
+            const __m128 f = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4 * k), zero), one);
+            v[k]           = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(f, vs), half));
+        }
+
+        const __m128i lo = _mm_packs_epi32(v[0], v[1]);
+        const __m128i hi = _mm_packs_epi32(v[2], v[3]);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; i < n; ++i)
+        dst[i] = ImageUtils::unitToByte(src[i]);
+}
+
+static void wordsToFloat(float* dst, const SKuint16* src, const SKsize n)
+{
+    const float scale = 1.f / 65535.f;
+
+    SKsize i = 0;
+#ifdef SK_IMAGE_SSE2
+    const __m128  vs   = _mm_set1_ps(scale);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+
+        _mm_storeu_ps(dst + i + 0, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)), vs));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)), vs));
+    }
+#endif
+    for (; i < n; ++i)
+        dst[i] = src[i] * scale;
+}
+
+static void floatToWords(SKuint16* dst, const float* src, const SKsize n)
+{
+    SKsize i = 0;
+#ifdef SK_IMAGE_SSE2
+    const __m128  zero = _mm_setzero_ps();
+    const __m128  one  = _mm_set1_ps(1.f);
+    const __m128  vs   = _mm_set1_ps(65535.f);
+    const __m128  half = _mm_set1_ps(0.5f);
+    const __m128i bias = _mm_set1_epi32(32768);
+    const __m128i flip = _mm_set1_epi16((short)0x8000);
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i v[2];
+        for (SKuint32 k = 0; k < 2; ++k)
+        {
+            const __m128 f = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4 * k), zero), one);
+            v[k]           = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(f, vs), half)), bias);
+        }
+
+        // SSE2 only packs with signed saturation, so pack around zero.
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(_mm_packs_epi32(v[0], v[1]), flip));
+    }
+#endif
+    for (; i < n; ++i)
+        dst[i] = (SKuint16)(skClamp(src[i], 0.f, 1.f) * 65535.f + 0.5f);
+}
+
+static void halvesToFloat(float* dst, const SKuint16* src, const SKsize n)
+{
+    SKsize i = 0;
+#ifdef SK_IMAGE_F16C
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(dst + i, _mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)(src + i))));
+#endif
+    for (; i < n; ++i)
+        dst[i] = ImageUtils::halfToFloat(src[i]);
+}
+
+static void floatToHalves(SKuint16* dst, const float* src, const SKsize n)
+{
+    SKsize i = 0;
+#ifdef SK_IMAGE_F16C
+    for (; i + 4 <= n; i += 4)
+        _mm_storel_epi64((__m128i*)(dst + i), _mm_cvtps_ph(_mm_loadu_ps(src + i), 0));
+#endif
+    for (; i < n; ++i)
+        dst[i] = ImageUtils::floatToHalf(src[i]);
+}
+
+static void getLumWeightsf(const skLumWeights weights, float w[3])
+{
+    switch (weights)
+    {
+    case SK_LUM_REC601:
+        w[0] = 0.299f, w[1] = 0.587f, w[2] = 0.114f;
+        break;
+    case SK_LUM_REC709:
+        w[0] = 0.2126f, w[1] = 0.7152f, w[2] = 0.0722f;
+        break;
+    case SK_LUM_AVERAGE:
+    default:
+        w[0] = w[1] = w[2] = 1.f / 3.f;
+        break;
+    }
+}
+
+static bool isGray(const skPixelFormat format)
+{
+    return format == SK_LUMINANCE ||
+           format == SK_LUMINANCE_ALPHA ||
+           format == SK_LUMINANCE16 ||
+           format == SK_LUMINANCE_HALF ||
+           format == SK_LUMINANCE_FLOAT;
+}
+
+// Reads w pixels into rgba. The scratch row holds w * 4 floats.
+static void loadRow(float*              rgba,
+                    float*              scratch,
+                    const SKubyte*      src,
+                    const SKuint32      w,
+                    const skPixelFormat format)
+{
+    const SKuint16* words = (const SKuint16*)src;
+
+    float* gray = nullptr;
+    switch (format)
+    {
+    case SK_RGBA16:
+        wordsToFloat(rgba, words, (SKsize)w * 4);
+        return;
+    case SK_RGBA_HALF:
+        halvesToFloat(rgba, words, (SKsize)w * 4);
+        return;
+    case SK_RGBA_FLOAT:
+        skMemcpy(rgba, src, (SKsize)w * 4 * sizeof(float));
+        return;
+    case SK_LUMINANCE16:
+        wordsToFloat(scratch, words, w);
+        gray = scratch;
+        break;
+    case SK_LUMINANCE_HALF:
+        halvesToFloat(scratch, words, w);
+        gray = scratch;
+        break;
+    case SK_LUMINANCE_FLOAT:
+        gray = (float*)src;
+        break;
+    default:
+        break;
+    }
+
+    if (gray)
+    {
+        for (SKuint32 x = 0; x < w; ++x)
+        {
+            rgba[4 * x + 0] = rgba[4 * x + 1] = rgba[4 * x + 2] = gray[x];
+            rgba[4 * x + 3] = 1.f;
+        }
+        return;
+    }
+
+    SKint32 offs[SK_CHANNEL_MAX];
+    if (!ImageUtils::getChannelOffsets(format, offs))
+        return;
+    if (format == SK_LUMINANCE)
+        offs[3] = -1;
+
+    const SKuint32 bpp = skImage::getSize(format);
+    bytesToFloat(scratch, src, (SKsize)w * bpp);
+
+    for (SKuint32 x = 0; x < w; ++x)
+    {
+        const float* p = scratch + (SKsize)x * bpp;
+
+        rgba[4 * x + 0] = p[offs[0]];
+        rgba[4 * x + 1] = p[offs[1]];
+        rgba[4 * x + 2] = p[offs[2]];
+        rgba[4 * x + 3] = offs[3] < 0 ? 1.f : p[offs[3]];
+    }
+}
+
+// Writes w pixels from rgba. Gray formats weight r, g and b.
+static void storeRow(SKubyte*            dst,
+                     float*              scratch,
+                     const float*        rgba,
+                     const SKuint32      w,
+                     const skPixelFormat format,
+                     const float*        weights)
+{
+    SKuint16* words = (SKuint16*)dst;
+
+    // Packed 8-bit gray takes at most the first w * 2 scratch floats.
+    float* gray = format == SK_LUMINANCE_FLOAT ? (float*)dst : scratch + (SKsize)w * 2;
+    if (isGray(format))
+    {
+        for (SKuint32 x = 0; x < w; ++x)
+        {
+            const float* p = rgba + 4 * x;
+            gray[x]        = p[0] * weights[0] + p[1] * weights[1] + p[2] * weights[2];
+        }
+    }
+
+    switch (format)
+    {
+    case SK_RGBA16:
+        floatToWords(words, rgba, (SKsize)w * 4);
+        return;
+    case SK_RGBA_HALF:
+        floatToHalves(words, rgba, (SKsize)w * 4);
+        return;
+    case SK_RGBA_FLOAT:
+        skMemcpy(dst, rgba, (SKsize)w * 4 * sizeof(float));
+        return;
+    case SK_LUMINANCE16:
+        floatToWords(words, gray, w);
+        return;
+    case SK_LUMINANCE_HALF:
+        floatToHalves(words, gray, w);
+        return;
+    case SK_LUMINANCE_FLOAT:
+        return;
+    default:
+        break;
+    }
+
+    SKint32 offs[SK_CHANNEL_MAX];
+    if (!ImageUtils::getChannelOffsets(format, offs))
+        return;
+
+    const SKuint32 bpp = skImage::getSize(format);
+
+    for (SKuint32 x = 0; x < w; ++x)
+    {
+        const float* p = rgba + 4 * x;
+        float*       d = scratch + (SKsize)x * bpp;
+
+        if (format == SK_LUMINANCE || format == SK_LUMINANCE_ALPHA)
+        {
+            d[offs[0]] = gray[x];
+            if (format == SK_LUMINANCE_ALPHA)
+                d[offs[3]] = p[3];
+            continue;
+        }
+
+        d[offs[0]] = p[0];
+        d[offs[1]] = p[1];
+        d[offs[2]] = p[2];
+        if (offs[3] >= 0)
+            d[offs[3]] = p[3];
+    }
+    floatToBytes(dst, scratch, (SKsize)w * bpp);
+}
+
+bool skImage::copyDepth(const skImage& dst, const skLumWeights weights) const
+{
+    if (ImageUtils::isByteFormat(m_format) && ImageUtils::isByteFormat(dst.m_format))
+        return false;
+    if (m_format == SK_INDEXED8 || dst.m_format == SK_INDEXED8)
+        return false;
+    if (!dst.m_bytes || dst.m_width != m_width || dst.m_height != m_height)
+        return false;
+
+    float lum[3];
+    getLumWeightsf(weights, lum);
+
+    const SKuint32 threads = (SKsize)m_width * m_height >= SK_IMAGE_PARALLEL_MIN ? 0 : 1;
+
+    skParallel::forRange(
+        m_height,
+        32,
+        [&](const SKuint32 y0, const SKuint32 y1)
+        {
+            float* rgba    = new float[(SKsize)m_width * 8];
+            float* scratch = rgba + (SKsize)m_width * 4;
+
+            for (SKuint32 y = y0; y < y1; ++y)
+            {
+                loadRow(rgba, scratch, m_bytes + (SKsize)y * m_pitch, m_width, m_format);
+                storeRow(dst.m_bytes + (SKsize)y * dst.m_pitch, scratch, rgba, m_width, dst.m_format, lum);
+            }
+            delete[] rgba;
+        },
+        threads);
+    return true;
+}
@@ -0,0 +1,230 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include <string.h>
+#include "Image/skImage.h"
+#include "Image/skImageUtils.h"
+#include "Utils/skArray.h"
+
+struct skFillSpan
+{
+    SKuint32 x0, x1, y;  // filled pixels [x0, x1] of row y
+};
+
+// Compares raw pixels against the packed seed without unpacking.
+template <SKuint32 BPP>
+struct skFillMatch
+{
+    SKubyte  seed[BPP];
+    SKuint32 tolerance;
+
+    bool operator()(const SKubyte* px) const
+    {
+        for (SKuint32 i = 0; i < BPP; ++i)
+        {
+            const SKint32 d = (SKint32)px[i] - (SKint32)seed[i];
+            if ((SKuint32)(d < 0 ? -d : d) > tolerance)
+                return false;
+        }
+        return true;
+    }
+};
+
+template <SKuint32 BPP>
+struct skFillExact
+{
+    SKubyte seed[BPP];
+
+    bool operator()(const SKubyte* px) const
+    {
+        return memcmp(px, seed, BPP) == 0;
+    }
+};
+
+class skFloodFill
+{
+private:
+    const skImage&      m_image;
+    const SKubyte*      m_packed;
+    const SKuint32      m_width;
+    const SKuint32      m_height;
+    const SKuint32      m_bpp;
+    const bool          m_diagonal;
+    SKuint32*           m_visited;
+    skArray<skFillSpan> m_stack;
+    SKsize              m_count;
+
+    SKubyte* row(const SKuint32 y) const
+    {
+        return m_image.getBytes() + (SKsize)(m_image.isFlipY() ? m_height - 1 - y : y) * m_image.getPitch();
+    }
+
+    bool isVisited(const SKsize i) const
+    {
+        return (m_visited[i >> 5] >> (i & 31)) & 1;
+    }
+
+    void markVisited(SKsize i, const SKsize end)
+    {
+        for (; i < end && (i & 31); ++i)
+            m_visited[i >> 5] |= 1u << (i & 31);
+        for (; i + 32 <= end; i += 32)
+            m_visited[i >> 5] = 0xFFFFFFFF;
+        for (; i < end; ++i)
+            m_visited[i >> 5] |= 1u << (i & 31);
+    }
+
+    // Grows a run from x in both directions, then fills and records it.
+    template <typename Match>
+    SKuint32 fillRun(const Match& match, SKubyte* r, const SKuint32 x, const SKuint32 y)
+    {
+        const SKsize base = (SKsize)y * m_width;
+
+        SKuint32 x0 = x, x1 = x;
+        while (x0 > 0 && !isVisited(base + x0 - 1) && match(r + (SKsize)(x0 - 1) * m_bpp))
+            --x0;
+        while (x1 + 1 < m_width && !isVisited(base + x1 + 1) && match(r + (SKsize)(x1 + 1) * m_bpp))
+            ++x1;
+
+        markVisited(base + x0, base + x1 + 1);
+        ImageUtils::fillSpan(r + (SKsize)x0 * m_bpp, x1 - x0 + 1, m_packed, m_bpp);
+
+        const skFillSpan span = {x0, x1, y};
+        m_stack.push_back(span);
+        m_count += x1 - x0 + 1;
+        return x1;
+    }
+
+    template <typename Match>
+    void scanRow(const Match& match, const skFillSpan& span, const SKuint32 y)
+    {
+        SKubyte*     r    = row(y);
+        const SKsize base = (SKsize)y * m_width;
+
+        SKuint32 x  = m_diagonal && span.x0 > 0 ? span.x0 - 1 : span.x0;
+        SKuint32 x1 = m_diagonal && span.x1 + 1 < m_width ? span.x1 + 1 : span.x1;
+
+        for (; x <= x1; ++x)
+        {
+            if (!isVisited(base + x) && match(r + (SKsize)x * m_bpp))
+                x = fillRun(match, r, x, y);
+        }
+    }
+
+public:
+    skFloodFill(const skImage& image, const SKubyte* packed, const bool diagonal) :
+        m_image(image),
+        m_packed(packed),
+        m_width(image.getWidth()),
+        m_height(image.getHeight()),
+        m_bpp(image.getBPP()),
+        m_diagonal(diagonal),
+        m_visited(nullptr),
+        m_count(0)
+    {
+        const SKsize words = ((SKsize)m_width * m_height + 31) / 32;
+
+        m_visited = new SKuint32[words];
+        memset(m_visited, 0, words * sizeof(SKuint32));
+    }
+
+    ~skFloodFill()
+    {
+        delete[] m_visited;
+    }
+
+    skFloodFill(const skFloodFill&)            = delete;
+    skFloodFill& operator=(const skFloodFill&) = delete;
+
+    template <typename Match>
+    SKsize run(const Match& match, const SKuint32 x, const SKuint32 y)
+    {
+        fillRun(match, row(y), x, y);
+
+        while (!m_stack.empty())
+        {
+            const skFillSpan span = m_stack.back();
+            m_stack.pop_back();
+
+            if (span.y > 0)
+                scanRow(match, span, span.y - 1);
+            if (span.y + 1 < m_height)
+                scanRow(match, span, span.y + 1);
+        }
+        return m_count;
+    }
+};
+
+template <SKuint32 BPP>
+static SKsize fillMatching(skFloodFill&   ff,
+                           const SKubyte* seed,
+                           const SKuint32 tolerance,
+                           const SKuint32 x,
+                           const SKuint32 y)
+{
+    if (tolerance == 0)
+    {
+        skFillExact<BPP> match;
+        memcpy(match.seed, seed, BPP);
+        return ff.run(match, x, y);
+    }
+
+    skFillMatch<BPP> match;
+    memcpy(match.seed, seed, BPP);
+    match.tolerance = tolerance;
+    return ff.run(match, x, y);
+}
+
+SKsize skImage::floodFill(const SKuint32       x,
+                          const SKuint32       y,
+                          const skPixel&       col,
+                          SKuint32             tolerance,
+                          const skConnectivity connectivity) const
+{
+    materialize();
+
+    if (!m_bytes || x >= m_width || y >= m_height || m_bpp > 4 ||
+        (!ImageUtils::isByteFormat(m_format) && m_format != SK_INDEXED8))
+        return 0;
+
+    if (m_format == SK_INDEXED8)
+        tolerance = 0;
+
+    SKubyte packed[4] = {};
+    packPixel(packed, col);
+
+    SKubyte seed[4] = {};
+    skMemcpy(seed, m_bytes + getBufferPos(x, y), m_bpp);
+
+    skFloodFill ff(*this, packed, connectivity == SK_CONNECT_8);
+
+    switch (m_bpp)
+    {
+    case 1:
+        return fillMatching<1>(ff, seed, tolerance, x, y);
+    case 2:
+        return fillMatching<2>(ff, seed, tolerance, x, y);
+    case 3:
+        return fillMatching<3>(ff, seed, tolerance, x, y);
+    default:
+        return fillMatching<4>(ff, seed, tolerance, x, y);
+    }
+}
@@ -0,0 +1,392 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include <math.h>
+#include "Image/skImage.h"
+#include "Image/skImageUtils.h"
+#include "Image/skParallel.h"
+#include "Utils/skLogger.h"
+#include "Utils/skMinMax.h"
+
+// Kernel weights are applied in 2.14 fixed point.
+const SKint32 WeightBits = 14;
+const SKint32 WeightOne  = 1 << WeightBits;
+const SKint32 WeightHalf = 1 << (WeightBits - 1);
+
+// Largest radius that is convolved directly by gaussianBlur, beyond
+// this the blur is approximated with three box passes.
+const SKint32 GaussianDirectRadius = 8;
+
+
+// Computes dst[i] = sum(w[k] * src[k][i]) for n bytes, where src[k]
+// points at the samples for tap k. Both the row pass (src[k] offset
+// by k pixels) and the column pass (src[k] is row k) use it.
+static void convolveTaps(SKubyte*             dst,
+                         const SKubyte* const* src,
+                         const SKint16*       w,
+                         const SKuint32       taps,
+                         const SKuint32       n)
+{
+    SKuint32 i = 0;
+
+#ifdef SK_IMAGE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i half = _mm_set1_epi32(WeightHalf);
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i lo = half;
+        __m128i hi = half;
+
+        SKuint32 k = 0;
+        for (; k + 1 < taps; k += 2)
+        {
+            const __m128i a  = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(src[k] + i)), zero);
+            const __m128i b  = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(src[k + 1] + i)), zero);
+            const __m128i wk = _mm_set1_epi32((SKint32)((SKuint32)(SKuint16)w[k] | (SKuint32)(SKuint16)w[k + 1] << 16));
+
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), wk));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), wk));
+        }
+
+        if (k < taps)
+        {
+            const __m128i a  = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(src[k] + i)), zero);
+            const __m128i wk = _mm_set1_epi32((SKint32)(SKuint32)(SKuint16)w[k]);
+
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, zero), wk));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, zero), wk));
+        }
+
+        lo = _mm_srai_epi32(lo, WeightBits);
+        hi = _mm_srai_epi32(hi, WeightBits);
+
+        const __m128i p = _mm_packs_epi32(lo, hi);
+        _mm_storel_epi64((__m128i*)(dst + i), _mm_packus_epi16(p, p));
+    }
+#endif
+
+    for (; i < n; ++i)
+    {
+        SKint32 s = WeightHalf;
+        for (SKuint32 k = 0; k < taps; ++k)
+            s += (SKint32)w[k] * (SKint32)src[k][i];
+
+        dst[i] = (SKubyte)skClamp<SKint32>(s >> WeightBits, 0, 255);
+    }
+}
+
+// Copies a row into pad with r edge pixels replicated on both sides.
+static void padRow(SKubyte*       pad,
+                   const SKubyte* row,
+                   const SKuint32 w,
+                   const SKuint32 c,
+                   const SKuint32 r)
+{
+    for (SKuint32 k = 0; k < r; ++k)
+    {
+        skMemcpy(pad + (SKsize)k * c, row, c);
+        skMemcpy(pad + (SKsize)(r + w + k) * c, row + (SKsize)(w - 1) * c, c);
+    }
+    skMemcpy(pad + (SKsize)r * c, row, (SKsize)w * c);
+}
+
+static void quantizeKernel(SKint16* dst, const float* src, const SKuint32 n, const bool reverse)
+{
+    for (SKuint32 k = 0; k < n; ++k)
+    {
+        const float v = src[reverse ? n - 1 - k : k] * (float)WeightOne;
+        dst[k]        = (SKint16)skClamp<float>(floorf(v + 0.5f), -32767.f, 32767.f);
+    }
+}
+
+bool skImage::convolve(const float*   kernelX,
+                       const SKuint32 sizeX,
+                       const float*   kernelY,
+                       const SKuint32 sizeY) const
+{
+    materialize();
+
+    if (!m_bytes || !kernelX || !kernelY || m_width == 0 || m_height == 0)
+        return false;
+    if (!ImageUtils::isByteFormat(m_format))
+        return false;
+
+    if ((sizeX & 1) == 0 || (sizeY & 1) == 0)
+    {
+        skLogf(LD_ERROR, "Convolution kernels must have an odd number of taps.\n");
+        return false;
+    }
+
+    const SKuint32 c  = m_bpp;
+    const SKuint32 n  = m_width * c;
+    const SKuint32 rx = sizeX / 2;
+    const SKuint32 ry = sizeY / 2;
+
+    SKint16* wx = new SKint16[sizeX];
+    SKint16* wy = new SKint16[sizeY];
+    quantizeKernel(wx, kernelX, sizeX, false);
+
+    // Buffer rows run bottom up when the image is flipped, so the
+    // vertical kernel is mirrored to keep it in image space.
+    quantizeKernel(wy, kernelY, sizeY, m_flip);
+
+    SKubyte* tmp = new SKubyte[(SKsize)n * m_height];
+
+    const SKuint32 threads = (SKsize)m_width * m_height >= SK_IMAGE_PARALLEL_MIN ? 0 : 1;
+
+    skParallel::forRange(
+        m_height,
+        16,
+        [&](const SKuint32 y0, const SKuint32 y1)
+        {
+            SKubyte*        pad = new SKubyte[(SKsize)(m_width + 2 * rx) * c];
+            const SKubyte** src = new const SKubyte*[sizeX];
+
+            for (SKuint32 k = 0; k < sizeX; ++k)
+                src[k] = pad + (SKsize)k * c;
+
+            for (SKuint32 y = y0; y < y1; ++y)
+            {
+                padRow(pad, m_bytes + (SKsize)y * m_pitch, m_width, c, rx);
+                convolveTaps(tmp + (SKsize)y * n, src, wx, sizeX, n);
+            }
+
+            delete[] src;
+            delete[] pad;
+        },
+        threads);
+
+    skParallel::forRange(
+        m_height,
+        16,
+        [&](const SKuint32 y0, const SKuint32 y1)
+        {
+            const SKubyte** src = new const SKubyte*[sizeY];
+
+            for (SKuint32 y = y0; y < y1; ++y)
+            {
+                for (SKuint32 k = 0; k < sizeY; ++k)
+                {
+                    const SKint64 sy = skClamp<SKint64>((SKint64)y + k - ry, 0, (SKint64)m_height - 1);
+                    src[k]           = tmp + (SKsize)sy * n;
+                }
+                convolveTaps(m_bytes + (SKsize)y * m_pitch, src, wy, sizeY, n);
+            }
+
+            delete[] src;
+        },
+        threads);
+
+    delete[] tmp;
+    delete[] wx;
+    delete[] wy;
+    return true;
+}
+
+void skImage::boxBlurPass(SKubyte* tmp, const SKuint32 radius) const
+{
+    const SKuint32 c = m_bpp;
+    const SKuint32 n = m_width * c;
+    const SKuint32 r = radius;
+
+    // (sum * mul) >> 24 divides by the window size.
+    const SKuint64 d   = 2 * (SKuint64)r + 1;
+    const SKuint64 mul = ((1ULL << 24) + d / 2) / d;
+
+    const SKuint32 threads = (SKsize)m_width * m_height >= SK_IMAGE_PARALLEL_MIN ? 0 : 1;
+
+    skParallel::forRange(
+        m_height,
+        16,
+        [&](const SKuint32 y0, const SKuint32 y1)
+        {
+            SKubyte* pad = new SKubyte[(SKsize)(m_width + 2 * r) * c];
+
+            for (SKuint32 y = y0; y < y1; ++y)
+            {
+                padRow(pad, m_bytes + (SKsize)y * m_pitch, m_width, c, r);
+
+                SKubyte* dst = tmp + (SKsize)y * n;
+                for (SKuint32 ch = 0; ch < c; ++ch)
+                {
+                    SKuint32 sum = 0;
+                    for (SKuint32 k = 0; k < d; ++k)
+                        sum += pad[(SKsize)k * c + ch];
+
+                    const SKubyte* add = pad + (SKsize)d * c + ch;
+                    const SKubyte* sub = pad + ch;
+
+                    for (SKuint32 x = 0; x < m_width; ++x)
+                    {
+                        dst[(SKsize)x * c + ch] = (SKubyte)((sum * mul + (1 << 23)) >> 24);
+                        if (x + 1 < m_width)
+                        {
+                            sum += *add;
+                            sum -= *sub;
+                            add += c;
+                            sub += c;
+                        }
+                    }
+                }
+            }
+            delete[] pad;
+        },
+        threads);
+
+    // The vertical pass slides one window per byte column down the
+    // image, so each worker streams whole rows of its column strip.
+    skParallel::forRange(
+        n,
+        256,
+        [&](const SKuint32 i0, const SKuint32 i1)
+        {
+            const SKuint32 len = i1 - i0;
+            SKuint32*      sum = new SKuint32[len];
+
+            const SKint64 h = (SKint64)m_height;
+
+            for (SKuint32 i = 0; i < len; ++i)
+                sum[i] = 0;
+
+            for (SKint64 k = -(SKint64)r; k <= (SKint64)r; ++k)
+            {
+                const SKubyte* row = tmp + (SKsize)skClamp<SKint64>(k, 0, h - 1) * n + i0;
+                for (SKuint32 i = 0; i < len; ++i)
+                    sum[i] += row[i];
+            }
+
+            for (SKint64 y = 0; y < h; ++y)
+            {
+                SKubyte* dst = m_bytes + (SKsize)y * m_pitch + i0;
+                for (SKuint32 i = 0; i < len; ++i)
+                    dst[i] = (SKubyte)((sum[i] * mul + (1 << 23)) >> 24);
+
+                if (y + 1 < h)
+                {
+                    const SKubyte* add = tmp + (SKsize)skMin<SKint64>(y + r + 1, h - 1) * n + i0;
+                    const SKubyte* sub = tmp + (SKsize)skMax<SKint64>(y - r, 0) * n + i0;
+                    for (SKuint32 i = 0; i < len; ++i)
+                        sum[i] += (SKuint32)add[i] - (SKuint32)sub[i];
+                }
+            }
+            delete[] sum;
+        },
+        threads);
+}
+
+bool skImage::boxBlur(const SKuint32 radius) const
+{
+    materialize();
+
+    if (!m_bytes || m_width == 0 || m_height == 0 || !ImageUtils::isByteFormat(m_format))
+        return false;
+    if (radius == 0)
+        return true;
+
+    SKubyte* tmp = new SKubyte[(SKsize)m_width * m_bpp * m_height];
+    boxBlurPass(tmp, radius);
+    delete[] tmp;
+    return true;
+}
+
+bool skImage::gaussianBlur(const float sigma) const
+{
+    materialize();
+
+    if (!m_bytes || m_width == 0 || m_height == 0 || !ImageUtils::isByteFormat(m_format))
+        return false;
+    if (sigma <= 0)
+        return true;
+
+    const SKint32 radius = (SKint32)ceilf(3.f * sigma);
+
+    if (radius <= GaussianDirectRadius)
+    {
+        const SKuint32 size   = 2 * radius + 1;
+        float*         kernel = new float[size];
+
+        float sum = 0;
+        for (SKint32 k = -radius; k <= radius; ++k)
+        {
+            kernel[k + radius] = expf(-(float)(k * k) / (2.f * sigma * sigma));
+            sum += kernel[k + radius];
+        }
+        for (SKuint32 k = 0; k < size; ++k)
+            kernel[k] /= sum;
+
+        const bool result = convolve(kernel, size, kernel, size);
+        delete[] kernel;
+        return result;
+    }
+
+    // Three box passes whose combined variance matches sigma.
+    const float wIdeal = sqrtf(4.f * sigma * sigma + 1.f);
+
+    SKint32 wl = (SKint32)floorf(wIdeal);
+    if ((wl & 1) == 0)
+        --wl;
+
+    const SKint32 wu = wl + 2;
+    const float   mIdeal =
+        (12.f * sigma * sigma - 3.f * (float)(wl * wl) - 12.f * (float)wl - 9.f) /
+        (-4.f * (float)wl - 4.f);
+    const SKint32 m = (SKint32)floorf(mIdeal + 0.5f);
+
+    SKubyte* tmp = new SKubyte[(SKsize)m_width * m_bpp * m_height];
+    for (SKint32 i = 0; i < 3; ++i)
+        boxBlurPass(tmp, (SKuint32)((i < m ? wl : wu) - 1) / 2);
+    delete[] tmp;
+    return true;
+}
+
+bool skImage::unsharpMask(const float sigma, const float amount) const
+{
+    materialize();
+
+    if (!m_bytes || m_width == 0 || m_height == 0)
+        return false;
+
+    skImage* blur = convertToFormat(m_format);
+    if (!blur || !blur->gaussianBlur(sigma))
+    {
+        delete blur;
+        return false;
+    }
+
+    const SKint32  a = (SKint32)(amount * 256.f);
+    const SKuint32 n = m_width * m_bpp;
+
+    for (SKuint32 y = 0; y < m_height; ++y)
+    {
+        SKubyte*       dst = m_bytes + (SKsize)y * m_pitch;
+        const SKubyte* low = blur->m_bytes + (SKsize)y * blur->m_pitch;
+
+        for (SKuint32 i = 0; i < n; ++i)
+        {
+            const SKint32 v = dst[i] + (((SKint32)dst[i] - (SKint32)low[i]) * a) / 256;
+            dst[i]          = (SKubyte)skClamp<SKint32>(v, 0, 255);
+        }
+    }
+
+    delete blur;
+    return true;
+}
@@ -0,0 +1,157 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Image/skImage.h"
+#include "Image/skImageUtils.h"
+#include "Image/skParallel.h"
+
+// Weights are 1.15 fixed point so they fit the signed 16-bit lanes of
+// _mm_madd_epi16. The average uses 10923 ~ 32768 / 3 without rounding,
+// which reproduces (r + g + b) / 3 exactly for 8-bit inputs.
+const SKint32 LumBits = 15;
+
+static void getLumWeights(const skLumWeights weights, SKint32 w[3], SKint32& bias)
+{
+    switch (weights)
+    {
+    case SK_LUM_REC601:
+        w[0] = 9798, w[1] = 19235, w[2] = 3735;
+        bias = 1 << (LumBits - 1);
+        break;
+    case SK_LUM_REC709:
+        w[0] = 6966, w[1] = 23436, w[2] = 2366;
+        bias = 1 << (LumBits - 1);
+        break;
+    case SK_LUM_AVERAGE:
+    default:
+        w[0] = w[1] = w[2] = 10923;
+        bias = 0;
+        break;
+    }
+}
+
+static void luminanceRow(SKubyte*       dst,
+                         const SKuint32 dstBpp,
+                         const SKubyte* src,
+                         const SKuint32 srcBpp,
+                         const SKuint32 w,
+                         const SKint16* wpos,
+                         const SKint32  bias,
+                         const SKint32  alpha)
+{
+    SKuint32 x = 0;
+
+#ifdef SK_IMAGE_SSE2
+    if (srcBpp == 4)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i bv   = _mm_set1_epi32(bias);
+        const __m128i wv   = _mm_set_epi16(wpos[3], wpos[2], wpos[1], wpos[0], wpos[3], wpos[2], wpos[1], wpos[0]);
+
+        for (; x + 4 <= w; x += 4)
+        {
+            const __m128i px = _mm_loadu_si128((const __m128i*)(src + (SKsize)x * 4));
+
+            const __m128i t = _mm_madd_epi16(_mm_unpacklo_epi8(px, zero), wv);
+            const __m128i u = _mm_madd_epi16(_mm_unpackhi_epi8(px, zero), wv);
+
+            const __m128i a = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(t), _mm_castsi128_ps(u), _MM_SHUFFLE(2, 0, 2, 0)));
+            const __m128i b = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(t), _mm_castsi128_ps(u), _MM_SHUFFLE(3, 1, 3, 1)));
+
+            __m128i l = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(a, b), bv), LumBits);
+            l         = _mm_packs_epi32(l, l);
+            l         = _mm_packus_epi16(l, l);
+
+            SKuint32 packed = (SKuint32)_mm_cvtsi128_si32(l);
+            for (SKuint32 i = 0; i < 4; ++i, packed >>= 8)
+            {
+                SKubyte* dp = dst + (SKsize)(x + i) * dstBpp;
+                if (dstBpp == 1)
+                    dp[0] = (SKubyte)packed;
+                else
+                {
+                    skPixelLA* la = (skPixelLA*)dp;
+                    la->l         = (SKubyte)packed;
+                    la->a         = alpha < 0 ? 255 : src[(SKsize)(x + i) * 4 + alpha];
+                }
+            }
+        }
+    }
+#endif
+
+    for (; x < w; ++x)
+    {
+        const SKubyte* sp = src + (SKsize)x * srcBpp;
+
+        SKint32 l = bias;
+        for (SKuint32 i = 0; i < srcBpp; ++i)
+            l += wpos[i] * sp[i];
+
+        SKubyte* dp = dst + (SKsize)x * dstBpp;
+        if (dstBpp == 1)
+            dp[0] = (SKubyte)(l >> LumBits);
+        else
+        {
+            skPixelLA* la = (skPixelLA*)dp;
+            la->l         = (SKubyte)(l >> LumBits);
+            la->a         = alpha < 0 ? 255 : sp[alpha];
+        }
+    }
+}
+
+bool skImage::copyLuminance(const skImage& dst, const skLumWeights weights) const
+{
+    if (dst.m_format != SK_LUMINANCE && dst.m_format != SK_LUMINANCE_ALPHA)
+        return false;
+
+    SKint32 offs[SK_CHANNEL_MAX];
+    if (m_bpp < 3 || !ImageUtils::getChannelOffsets(m_format, offs))
+        return false;
+
+    SKint32 w[3], bias;
+    getLumWeights(weights, w, bias);
+
+    SKint16 wpos[4] = {0, 0, 0, 0};
+    for (SKuint32 c = 0; c < 3; ++c)
+        wpos[offs[c]] = (SKint16)w[c];
+
+    const SKuint32 threads = (SKsize)m_width * m_height >= SK_IMAGE_PARALLEL_MIN ? 0 : 1;
+
+    skParallel::forRange(
+        m_height,
+        64,
+        [&](const SKuint32 y0, const SKuint32 y1)
+        {
+            for (SKuint32 y = y0; y < y1; ++y)
+            {
+                luminanceRow(dst.m_bytes + (SKsize)y * dst.m_pitch,
+                             dst.m_bpp,
+                             m_bytes + (SKsize)y * m_pitch,
+                             m_bpp,
+                             m_width,
+                             wpos,
+                             bias,
+                             offs[SK_CHANNEL_A]);
+            }
+        },
+        threads);
+    return true;
+}
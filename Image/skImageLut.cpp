@@ -0,0 +1,154 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include <string.h>
+#include "Image/skImage.h"
+#include "Image/skImageUtils.h"
+#include "Image/skLut.h"
+#include "Image/skParallel.h"
+
+
+template <SKuint32 N>
+static void applyTablesN(SKubyte* row, const SKuint32 w, const SKubyte* const* tables)
+{
+    for (SKuint32 x = 0; x < w; ++x, row += N)
+    {
+        for (SKuint32 i = 0; i < N; ++i)
+            row[i] = tables[i][row[i]];
+    }
+}
+
+static void applyTable(SKubyte* row, const SKsize n, const SKubyte* table)
+{
+    SKsize i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        const SKubyte a = table[row[i]];
+        const SKubyte b = table[row[i + 1]];
+        const SKubyte c = table[row[i + 2]];
+        const SKubyte d = table[row[i + 3]];
+
+        row[i]     = a;
+        row[i + 1] = b;
+        row[i + 2] = c;
+        row[i + 3] = d;
+    }
+    for (; i < n; ++i)
+        row[i] = table[row[i]];
+}
+
+bool skImage::applyLut(const skLut& lut) const
+{
+    materialize();
+
+    if (m_format == SK_INDEXED8)
+    {
+        for (SKuint32 i = 0; i < getPaletteSize(); ++i)
+        {
+            skPixel col;
+            getPaletteColor(i, col);
+
+            col.r = lut.getTable(SK_CHANNEL_R)[col.r];
+            col.g = lut.getTable(SK_CHANNEL_G)[col.g];
+            col.b = lut.getTable(SK_CHANNEL_B)[col.b];
+            setPaletteColor(i, col);
+        }
+        return true;
+    }
+
+    SKint32 offs[SK_CHANNEL_MAX];
+    if (!m_bytes || !ImageUtils::getChannelOffsets(m_format, offs))
+        return false;
+
+    // Resolve which table each byte of a pixel goes through.
+    SKubyte identity[256];
+    skLut::identity(identity);
+
+    const SKubyte* tables[4] = {identity, identity, identity, identity};
+
+    if (m_format == SK_ALPHA)
+        tables[0] = lut.getTable(SK_CHANNEL_A);
+    else if (m_format == SK_LUMINANCE)
+        tables[0] = lut.getTable(SK_CHANNEL_R);
+    else
+    {
+        for (SKint32 c = SK_CHANNEL_MAX - 1; c >= 0; --c)
+        {
+            if (offs[c] >= 0)
+                tables[offs[c]] = lut.getTable((skChannel)c);
+        }
+    }
+
+    bool shared = true;
+    for (SKuint32 i = 1; i < m_bpp; ++i)
+    {
+        if (memcmp(tables[i], tables[0], 256) != 0)
+            shared = false;
+    }
+
+    const SKuint32 threads = (SKsize)m_width * m_height >= SK_IMAGE_PARALLEL_MIN ? 0 : 1;
+
+    skParallel::forRange(
+        m_height,
+        64,
+        [&](const SKuint32 y0, const SKuint32 y1)
+        {
+            for (SKuint32 y = y0; y < y1; ++y)
+            {
+                SKubyte* row = m_bytes + (SKsize)y * m_pitch;
+
+                if (shared)
+                {
+                    applyTable(row, (SKsize)m_width * m_bpp, tables[0]);
+                    continue;
+                }
+
+                switch (m_bpp)
+                {
+                case 2:
+                    applyTablesN<2>(row, m_width, tables);
+                    break;
+                case 3:
+                    applyTablesN<3>(row, m_width, tables);
+                    break;
+                case 4:
+                    applyTablesN<4>(row, m_width, tables);
+                    break;
+                default:
+                    break;
+                }
+            }
+        },
+        threads);
+    return true;
+}
+
+bool skImage::applyLut(const SKubyte* table) const
+{
+    materialize();
+
+    if (!table)
+        return false;
+
+    skLut lut;
+    lut.setColorTables(table);
+    return applyLut(lut);
+}
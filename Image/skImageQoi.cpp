@@ -0,0 +1,296 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include <stdio.h>
+#include <string.h>
+#include "FreeImage.h"
+#include "Image/skImage.h"
+#include "Image/skImageUtils.h"
+#include "Utils/skLogger.h"
+
+// The QOI format, https://qoiformat.org/qoi-specification.pdf
+
+const SKubyte  QoiOpIndex  = 0x00;
+const SKubyte  QoiOpDiff   = 0x40;
+const SKubyte  QoiOpLuma   = 0x80;
+const SKubyte  QoiOpRun    = 0xC0;
+const SKubyte  QoiOpRgb    = 0xFE;
+const SKubyte  QoiOpRgba   = 0xFF;
+const SKubyte  QoiMask     = 0xC0;
+const SKuint32 QoiHeader   = 14;
+const SKuint32 QoiMaxRun   = 62;
+const SKuint64 QoiMaxPixel = 400000000;
+const SKubyte  QoiEnd[8]   = {0, 0, 0, 0, 0, 0, 0, 1};
+
+// Pixels are held as r, g, b, a in b[0..3].
+static SKuint32 qoiHash(const skColorUnion& px)
+{
+    return (px.b[0] * 3 + px.b[1] * 5 + px.b[2] * 7 + px.b[3] * 11) & 63;
+}
+
+static SKuint32 readBE32(const SKubyte* p)
+{
+    return (SKuint32)p[0] << 24 | (SKuint32)p[1] << 16 | (SKuint32)p[2] << 8 | p[3];
+}
+
+static void writeBE32(SKubyte* p, const SKuint32 v)
+{
+    p[0] = (SKubyte)(v >> 24);
+    p[1] = (SKubyte)(v >> 16);
+    p[2] = (SKubyte)(v >> 8);
+    p[3] = (SKubyte)v;
+}
+
+bool skImage::isQoi(const SKubyte* bytes, const SKsize size)
+{
+    return bytes && size >= QoiHeader + sizeof(QoiEnd) && memcmp(bytes, "qoif", 4) == 0;
+}
+
+bool skImage::loadQoi(const SKubyte* bytes, const SKsize size)
+{
+    const SKuint32 width = readBE32(bytes + 4);
+    const SKuint32 height = readBE32(bytes + 8);
+    const SKuint32 channels = bytes[12];
+
+    if (width == 0 || height == 0 || (channels != 3 && channels != 4) ||
+        (SKuint64)width * height > QoiMaxPixel)
+    {
+        skLogf(LD_ERROR, "Invalid QOI header.\n");
+        return false;
+    }
+
+    unloadAndReset();
+
+    m_width  = width;
+    m_height = height;
+    m_format = channels == 4 ? SK_RGBA : SK_RGB;
+    calculateBitsPerPixel();
+    allocateBytes();
+    if (!m_bytes)
+        return false;
+
+    SKint32 offs[SK_CHANNEL_MAX];
+    if (!ImageUtils::getChannelOffsets(m_format, offs))
+        return false;
+
+    skColorUnion index[64];
+    skMemset(index, 0, sizeof(index));
+
+    skColorUnion px;
+    px.i    = 0;
+    px.b[3] = 255;
+
+    const SKubyte* p   = bytes + QoiHeader;
+    const SKubyte* end = bytes + size - sizeof(QoiEnd);
+    SKuint32       run = 0;
+
+    for (SKuint32 y = 0; y < m_height; ++y)
+    {
+        SKubyte* row = m_bytes + (SKsize)(m_flip ? m_height - 1 - y : y) * m_pitch;
+
+        for (SKuint32 x = 0; x < m_width; ++x, row += m_bpp)
+        {
+            if (run > 0)
+                --run;
+            else if (p < end)
+            {
+                const SKubyte op = *p++;
+
+                if (op == QoiOpRgb)
+                {
+                    px.b[0] = p[0];
+                    px.b[1] = p[1];
+                    px.b[2] = p[2];
+                    p += 3;
+                }
+                else if (op == QoiOpRgba)
+                {
+                    px.b[0] = p[0];
+                    px.b[1] = p[1];
+                    px.b[2] = p[2];
+                    px.b[3] = p[3];
+                    p += 4;
+                }
+                else if ((op & QoiMask) == QoiOpIndex)
+                    px = index[op];
+                else if ((op & QoiMask) == QoiOpDiff)
+                {
+                    px.b[0] += ((op >> 4) & 3) - 2;
+                    px.b[1] += ((op >> 2) & 3) - 2;
+                    px.b[2] += (op & 3) - 2;
+                }
+                else if ((op & QoiMask) == QoiOpLuma)
+                {
+                    const SKubyte next = *p++;
+                    const SKint32 dg   = (op & 0x3F) - 32;
+
+                    px.b[0] += dg - 8 + ((next >> 4) & 0x0F);
+                    px.b[1] += dg;
+                    px.b[2] += dg - 8 + (next & 0x0F);
+                }
+                else
+                    run = op & 0x3F;
+
+                index[qoiHash(px)] = px;
+            }
+
+            row[offs[0]] = px.b[0];
+            row[offs[1]] = px.b[1];
+            row[offs[2]] = px.b[2];
+            if (offs[3] >= 0)
+                row[offs[3]] = px.b[3];
+        }
+    }
+    return true;
+}
+
+void skImage::saveQoi(const char* file) const
+{
+    SKint32 offs[SK_CHANNEL_MAX];
+    if (!m_bytes || !ImageUtils::getChannelOffsets(m_format, offs))
+    {
+        // Palette and deep formats go through 8-bit RGBA.
+        skImage* tmp = convertToFormat(SK_RGBA);
+        if (tmp && tmp->m_bytes)
+            tmp->saveQoi(file);
+        delete tmp;
+        return;
+    }
+
+    // Alpha only images are written as RGBA (0, 0, 0, a).
+    if (m_format == SK_LUMINANCE)
+        offs[3] = -1;
+    else if (m_format == SK_ALPHA)
+        offs[0] = offs[1] = offs[2] = -1;
+
+    const SKuint32 channels = offs[3] < 0 ? 3 : 4;
+    const SKsize   capacity = (SKsize)m_width * m_height * (channels + 1) + QoiHeader + sizeof(QoiEnd);
+
+    SKubyte* out = new SKubyte[capacity];
+    SKubyte* o   = out;
+
+    skMemcpy(o, "qoif", 4);
+    writeBE32(o + 4, m_width);
+    writeBE32(o + 8, m_height);
+    o[12] = (SKubyte)channels;
+    o[13] = 0;
+    o += QoiHeader;
+
+    skColorUnion index[64];
+    skMemset(index, 0, sizeof(index));
+
+    skColorUnion prev, px;
+    prev.i    = 0;
+    prev.b[3] = 255;
+    px.b[3]   = 255;
+
+    SKuint32 run = 0;
+
+    for (SKuint32 y = 0; y < m_height; ++y)
+    {
+        const SKubyte* row = m_bytes + (SKsize)(m_flip ? m_height - 1 - y : y) * m_pitch;
+
+        for (SKuint32 x = 0; x < m_width; ++x, row += m_bpp)
+        {
+            px.b[0] = offs[0] < 0 ? 0 : row[offs[0]];
+            px.b[1] = offs[1] < 0 ? 0 : row[offs[1]];
+            px.b[2] = offs[2] < 0 ? 0 : row[offs[2]];
+            if (offs[3] >= 0)
+                px.b[3] = row[offs[3]];
+
+            if (px.i == prev.i)
+            {
+                if (++run == QoiMaxRun)
+                {
+                    *o++ = (SKubyte)(QoiOpRun | (run - 1));
+                    run  = 0;
+                }
+                continue;
+            }
+
+            if (run > 0)
+            {
+                *o++ = (SKubyte)(QoiOpRun | (run - 1));
+                run  = 0;
+            }
+
+            const SKuint32 hash = qoiHash(px);
+            if (index[hash].i == px.i)
+                *o++ = (SKubyte)(QoiOpIndex | hash);
+            else
+            {
+                index[hash] = px;
+
+                if (px.b[3] == prev.b[3])
+                {
+                    const signed char dr = (signed char)(px.b[0] - prev.b[0]);
+                    const signed char dg = (signed char)(px.b[1] - prev.b[1]);
+                    const signed char db = (signed char)(px.b[2] - prev.b[2]);
+
+                    const signed char rg = (signed char)(dr - dg);
+                    const signed char bg = (signed char)(db - dg);
+
+                    if (dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2)
+                        *o++ = (SKubyte)(QoiOpDiff | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+                    else if (rg > -9 && rg < 8 && dg > -33 && dg < 32 && bg > -9 && bg < 8)
+                    {
+                        *o++ = (SKubyte)(QoiOpLuma | (dg + 32));
+                        *o++ = (SKubyte)((rg + 8) << 4 | (bg + 8));
+                    }
+                    else
+                    {
+                        *o++ = QoiOpRgb;
+                        *o++ = px.b[0];
+                        *o++ = px.b[1];
+                        *o++ = px.b[2];
+                    }
+                }
+                else
+                {
+                    *o++ = QoiOpRgba;
+                    *o++ = px.b[0];
+                    *o++ = px.b[1];
+                    *o++ = px.b[2];
+                    *o++ = px.b[3];
+                }
+            }
+            prev = px;
+        }
+    }
+
+    if (run > 0)
+        *o++ = (SKubyte)(QoiOpRun | (run - 1));
+
+    skMemcpy(o, QoiEnd, sizeof(QoiEnd));
+    o += sizeof(QoiEnd);
+
+    FILE* fp = fopen(file, "wb");
+    if (!fp)
+        skLogf(LD_ERROR, "Failed to open %s for writing.\n", file);
+    else
+    {
+        const SKsize len = (SKsize)(o - out);
+        if (fwrite(out, 1, len, fp) != len)
+            skLogf(LD_ERROR, "Failed to write %s.\n", file);
+        fclose(fp);
+    }
+    delete[] out;
+}
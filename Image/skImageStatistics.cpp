@@ -0,0 +1,130 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include <math.h>
+#include <mutex>
+#include "Image/skImage.h"
+#include "Image/skImageUtils.h"
+#include "Image/skParallel.h"
+
+
+// Each channel is counted into several interleaved sub-histograms, so
+// runs of equal values do not serialise on one counter's store/load.
+const SKuint32 SubHistograms = 4;
+
+struct skHistogramBand
+{
+    SKuint32 channel[SK_CHANNEL_MAX][SubHistograms][256];
+    SKuint32 luminance[SubHistograms][256];
+};
+
+
+bool skImage::computeStatistics(skImageStatistics& stats) const
+{
+    materialize();
+
+    skMemset(&stats, 0, sizeof(skImageStatistics));
+
+    SKint32 offs[SK_CHANNEL_MAX];
+    if (!m_bytes || m_width == 0 || m_height == 0 ||
+        !ImageUtils::getChannelOffsets(m_format, offs))
+        return false;
+
+    std::mutex lock;
+
+    const SKuint32 threads = (SKsize)m_width * m_height >= SK_IMAGE_PARALLEL_MIN ? 0 : 1;
+
+    skParallel::forRange(
+        m_height,
+        64,
+        [&](const SKuint32 y0, const SKuint32 y1)
+        {
+            skHistogramBand* band = new skHistogramBand;
+            skMemset(band, 0, sizeof(skHistogramBand));
+
+            for (SKuint32 y = y0; y < y1; ++y)
+            {
+                const SKubyte* row = m_bytes + (SKsize)y * m_pitch;
+
+                for (SKuint32 x = 0; x < m_width; ++x, row += m_bpp)
+                {
+                    const SKuint32 s = x & (SubHistograms - 1);
+
+                    const SKuint32 r = row[offs[0]];
+                    const SKuint32 g = row[offs[1]];
+                    const SKuint32 b = row[offs[2]];
+                    const SKuint32 a = offs[3] < 0 ? 255 : row[offs[3]];
+
+                    band->channel[0][s][r]++;
+                    band->channel[1][s][g]++;
+                    band->channel[2][s][b]++;
+                    band->channel[3][s][a]++;
+                    band->luminance[s][(r + g + b) / 3]++;
+                }
+            }
+
+            std::lock_guard<std::mutex> guard(lock);
+            for (SKuint32 v = 0; v < 256; ++v)
+            {
+                for (SKuint32 s = 0; s < SubHistograms; ++s)
+                {
+                    for (SKuint32 c = 0; c < SK_CHANNEL_MAX; ++c)
+                        stats.histogram[c][v] += band->channel[c][s][v];
+                    stats.luminance[v] += band->luminance[s][v];
+                }
+            }
+            delete band;
+        },
+        threads);
+
+    // The moments are exact sums over the histogram bins.
+    stats.count = (SKuint64)m_width * m_height;
+
+    for (SKuint32 c = 0; c < SK_CHANNEL_MAX; ++c)
+    {
+        const SKuint32* hist = stats.histogram[c];
+
+        SKuint64 sum = 0, sq = 0;
+        SKint32  lo = -1, hi = -1;
+
+        for (SKuint32 v = 0; v < 256; ++v)
+        {
+            if (hist[v] == 0)
+                continue;
+
+            if (lo < 0)
+                lo = (SKint32)v;
+            hi = (SKint32)v;
+
+            sum += (SKuint64)hist[v] * v;
+            sq += (SKuint64)hist[v] * v * v;
+        }
+
+        const double mean = (double)sum / (double)stats.count;
+        const double var  = (double)sq / (double)stats.count - mean * mean;
+
+        stats.min[c]    = (SKubyte)lo;
+        stats.max[c]    = (SKubyte)hi;
+        stats.mean[c]   = mean;
+        stats.stddev[c] = var > 0 ? sqrt(var) : 0;
+    }
+    return true;
+}
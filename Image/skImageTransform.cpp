@@ -0,0 +1,511 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "FreeImage.h"
+#include "Image/skImage.h"
+#include "Image/skImageUtils.h"
+#include "Image/skParallel.h"
+#include "Utils/skLogger.h"
+#include "Utils/skMinMax.h"
+
+const SKuint32 TileSize = 32;
+
+template <SKuint32 N>
+static void copyRunN(SKubyte*       dst,
+                     const SKubyte* src,
+                     const SKint64  step,
+                     const SKuint32 n)
+{
+    for (SKuint32 i = 0; i < n; ++i, dst += N, src += step)
+    {
+        for (SKuint32 b = 0; b < N; ++b)
+            dst[b] = src[b];
+    }
+}
+
+static void copyRun(SKubyte*       dst,
+                    const SKubyte* src,
+                    const SKint64  step,
+                    const SKuint32 n,
+                    const SKuint32 bpp)
+{
+    switch (bpp)
+    {
+    case 1:
+        copyRunN<1>(dst, src, step, n);
+        break;
+    case 2:
+        copyRunN<2>(dst, src, step, n);
+        break;
+    case 3:
+        copyRunN<3>(dst, src, step, n);
+        break;
+    case 4:
+        copyRunN<4>(dst, src, step, n);
+        break;
+    default:
+        for (SKuint32 i = 0; i < n; ++i, dst += bpp, src += step)
+            skMemcpy(dst, src, bpp);
+        break;
+    }
+}
+
+template <SKuint32 N>
+static void reverseRowN(SKubyte* row, const SKuint32 w)
+{
+    SKubyte* a = row;
+    SKubyte* b = row + (SKsize)(w - 1) * N;
+    for (; a < b; a += N, b -= N)
+    {
+        for (SKuint32 i = 0; i < N; ++i)
+            skSwap(a[i], b[i]);
+    }
+}
+
+static void reverseRow(SKubyte* row, const SKuint32 w, const SKuint32 bpp)
+{
+    if (w < 2)
+        return;
+
+    switch (bpp)
+    {
+    case 1:
+        reverseRowN<1>(row, w);
+        break;
+    case 2:
+        reverseRowN<2>(row, w);
+        break;
+    case 3:
+        reverseRowN<3>(row, w);
+        break;
+    case 4:
+        reverseRowN<4>(row, w);
+        break;
+    default:
+    {
+        SKubyte* a = row;
+        SKubyte* b = row + (SKsize)(w - 1) * bpp;
+        for (; a < b; a += bpp, b -= bpp)
+        {
+            for (SKuint32 i = 0; i < bpp; ++i)
+                skSwap(a[i], b[i]);
+        }
+        break;
+    }
+    }
+}
+
+static void swapPixel(SKubyte* a, SKubyte* b, const SKuint32 bpp)
+{
+    for (SKuint32 i = 0; i < bpp; ++i)
+        skSwap(a[i], b[i]);
+}
+
+#ifdef SK_IMAGE_SSE2
+
+// Writes the 4x4 block of 32-bit pixels whose destination columns are
+// read from the source as contiguous runs of four (stepY == +-4).
+static void transpose4x4(SKubyte* const* dstRows,
+                         const SKubyte*  src,
+                         const SKint64   stepX,
+                         const SKint64   stepY)
+{
+    __m128i r[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        const SKubyte* sp = src + i * stepX;
+        if (stepY > 0)
+            r[i] = _mm_loadu_si128((const __m128i*)sp);
+        else
+        {
+            r[i] = _mm_loadu_si128((const __m128i*)(sp - 12));
+            r[i] = _mm_shuffle_epi32(r[i], _MM_SHUFFLE(0, 1, 2, 3));
+        }
+    }
+
+    const __m128i t0 = _mm_unpacklo_epi32(r[0], r[1]);
+    const __m128i t1 = _mm_unpacklo_epi32(r[2], r[3]);
+    const __m128i t2 = _mm_unpackhi_epi32(r[0], r[1]);
+    const __m128i t3 = _mm_unpackhi_epi32(r[2], r[3]);
+
+    _mm_storeu_si128((__m128i*)dstRows[0], _mm_unpacklo_epi64(t0, t1));
+    _mm_storeu_si128((__m128i*)dstRows[1], _mm_unpackhi_epi64(t0, t1));
+    _mm_storeu_si128((__m128i*)dstRows[2], _mm_unpacklo_epi64(t2, t3));
+    _mm_storeu_si128((__m128i*)dstRows[3], _mm_unpackhi_epi64(t2, t3));
+}
+
+#endif
+
+void skImage::flipHorizontal() const
+{
+    materialize();
+
+    if (!m_bytes || m_width < 2)
+        return;
+
+    const SKuint32 threads = (SKsize)m_width * m_height >= SK_IMAGE_PARALLEL_MIN ? 0 : 1;
+
+    skParallel::forRange(
+        m_height,
+        64,
+        [this](const SKuint32 y0, const SKuint32 y1)
+        {
+            for (SKuint32 y = y0; y < y1; ++y)
+                reverseRow(m_bytes + (SKsize)y * m_pitch, m_width, m_bpp);
+        },
+        threads);
+}
+
+void skImage::flipVertical() const
+{
+    materialize();
+
+    if (!m_bytes || m_height < 2)
+        return;
+
+    const SKsize   rowBytes = (SKsize)m_width * m_bpp;
+    const SKuint32 half     = m_height / 2;
+    const SKuint32 threads  = (SKsize)m_width * m_height >= SK_IMAGE_PARALLEL_MIN ? 0 : 1;
+
+    skParallel::forRange(
+        half,
+        64,
+        [this, rowBytes](const SKuint32 y0, const SKuint32 y1)
+        {
+            SKubyte* tmp = new SKubyte[rowBytes];
+            for (SKuint32 y = y0; y < y1; ++y)
+            {
+                SKubyte* a = m_bytes + (SKsize)y * m_pitch;
+                SKubyte* b = m_bytes + (SKsize)(m_height - 1 - y) * m_pitch;
+
+                skMemcpy(tmp, a, rowBytes);
+                skMemcpy(a, b, rowBytes);
+                skMemcpy(b, tmp, rowBytes);
+            }
+            delete[] tmp;
+        },
+        threads);
+}
+
+void skImage::transposeSquare() const
+{
+    const SKuint32 n      = m_width;
+    const SKuint32 blocks = (n + TileSize - 1) / TileSize;
+
+    const SKuint32 threads = (SKsize)n * n >= SK_IMAGE_PARALLEL_MIN ? 0 : 1;
+
+    // Block row bi owns the pairs (bi, bj >= bi), so no two threads
+    // ever touch the same pixels.
+    skParallel::forEach(
+        blocks,
+        [this, n, blocks](const SKuint32 bi)
+        {
+            const SKuint32 y0 = bi * TileSize;
+            const SKuint32 y1 = skMin(y0 + TileSize, n);
+
+            for (SKuint32 bj = bi; bj < blocks; ++bj)
+            {
+                const SKuint32 x0 = bj * TileSize;
+                const SKuint32 x1 = skMin(x0 + TileSize, n);
+
+                for (SKuint32 y = y0; y < y1; ++y)
+                {
+                    for (SKuint32 x = bi == bj ? y + 1 : x0; x < x1; ++x)
+                    {
+                        swapPixel(m_bytes + getBufferPos(x, y),
+                                  m_bytes + getBufferPos(y, x),
+                                  m_bpp);
+                    }
+                }
+            }
+        },
+        threads);
+}
+
+void skImage::transformTo(const skImage& dst, const skImageTransform transform) const
+{
+    const SKint64 w = m_width;
+    const SKint64 h = m_height;
+
+    // Source coordinate of destination pixel (x', y'):
+    //   x = a[0] + a[1] x' + a[2] y'
+    //   y = b[0] + b[1] x' + b[2] y'
+    SKint64 a[3] = {0, 1, 0};
+    SKint64 b[3] = {0, 0, 1};
+
+    switch (transform)
+    {
+    case SK_FLIP_HORIZONTAL:
+        a[0] = w - 1, a[1] = -1;
+        break;
+    case SK_FLIP_VERTICAL:
+        b[0] = h - 1, b[2] = -1;
+        break;
+    case SK_ROTATE_90:
+        a[1] = 0, a[2] = 1;
+        b[0] = h - 1, b[1] = -1, b[2] = 0;
+        break;
+    case SK_ROTATE_180:
+        a[0] = w - 1, a[1] = -1;
+        b[0] = h - 1, b[2] = -1;
+        break;
+    case SK_ROTATE_270:
+        a[0] = w - 1, a[1] = 0, a[2] = -1;
+        b[1] = 1, b[2] = 0;
+        break;
+    case SK_TRANSPOSE:
+        a[1] = 0, a[2] = 1;
+        b[1] = 1, b[2] = 0;
+        break;
+    case SK_TRANSVERSE:
+        a[0] = w - 1, a[1] = 0, a[2] = -1;
+        b[0] = h - 1, b[1] = -1, b[2] = 0;
+        break;
+    case SK_TRANSFORM_NONE:
+        break;
+    }
+
+    // Fold the source addressing into a byte origin and two steps,
+    // one per destination axis.
+    const SKint64 bpp = m_bpp;
+    const SKint64 ry  = m_flip ? -(SKint64)m_pitch : (SKint64)m_pitch;
+    const SKint64 ro  = m_flip ? (h - 1) * (SKint64)m_pitch : 0;
+
+    const SKint64 start = ro + a[0] * bpp + b[0] * ry;
+    const SKint64 stepX = a[1] * bpp + b[1] * ry;
+    const SKint64 stepY = a[2] * bpp + b[2] * ry;
+
+    const SKuint32 dw     = dst.m_width;
+    const SKuint32 dh     = dst.m_height;
+    const SKuint32 tilesX = (dw + TileSize - 1) / TileSize;
+    const SKuint32 tilesY = (dh + TileSize - 1) / TileSize;
+
+    const SKuint32 threads = (SKsize)dw * dh >= SK_IMAGE_PARALLEL_MIN ? 0 : 1;
+
+    skParallel::forEach(
+        tilesY,
+        [&](const SKuint32 ty)
+        {
+            const SKuint32 y0 = ty * TileSize;
+            const SKuint32 y1 = skMin(y0 + TileSize, dh);
+
+            for (SKuint32 tx = 0; tx < tilesX; ++tx)
+            {
+                const SKuint32 x0 = tx * TileSize;
+                const SKuint32 x1 = skMin(x0 + TileSize, dw);
+
+                SKuint32 y = y0;
+#ifdef SK_IMAGE_SSE2
+                if (bpp == 4 && (stepY == 4 || stepY == -4))
+                {
+                    for (; y + 4 <= y1; y += 4)
+                    {
+                        SKubyte* rows[4];
+                        for (SKuint32 j = 0; j < 4; ++j)
+                            rows[j] = dst.m_bytes + dst.getBufferPos(x0, y + j);
+
+                        SKuint32 x = x0;
+                        for (; x + 4 <= x1; x += 4)
+                        {
+                            transpose4x4(rows, m_bytes + start + (SKint64)x * stepX + (SKint64)y * stepY, stepX, stepY);
+                            for (SKuint32 j = 0; j < 4; ++j)
+                                rows[j] += 16;
+                        }
+
+                        for (SKuint32 j = 0; j < 4 && x < x1; ++j)
+                        {
+                            const SKubyte* sp = m_bytes + start + (SKint64)x * stepX + (SKint64)(y + j) * stepY;
+                            copyRun(rows[j], sp, stepX, x1 - x, m_bpp);
+                        }
+                    }
+                }
+#endif
+                for (; y < y1; ++y)
+                {
+                    SKubyte*       dp = dst.m_bytes + dst.getBufferPos(x0, y);
+                    const SKubyte* sp = m_bytes + start + (SKint64)x0 * stepX + (SKint64)y * stepY;
+                    copyRun(dp, sp, stepX, x1 - x0, m_bpp);
+                }
+            }
+        },
+        threads);
+}
+
+skImage* skImage::transform(const skImageTransform& transform) const
+{
+    materialize();
+
+    if (!m_bytes || m_width == 0 || m_height == 0)
+        return nullptr;
+
+    const bool swapAxes = transform == SK_ROTATE_90 ||
+                          transform == SK_ROTATE_270 ||
+                          transform == SK_TRANSPOSE ||
+                          transform == SK_TRANSVERSE;
+
+    skImage* img = new skImage(swapAxes ? m_height : m_width,
+                               swapAxes ? m_width : m_height,
+                               m_format);
+    img->setFlipY(m_flip);
+    img->setPremultiplied(m_premultiplied);
+
+    if (!img->m_bytes)
+    {
+        delete img;
+        return nullptr;
+    }
+
+    if (m_format == SK_INDEXED8)
+    {
+        for (SKuint32 i = 0; i < getPaletteSize(); ++i)
+        {
+            skPixel col;
+            getPaletteColor(i, col);
+            img->setPaletteColor(i, col);
+        }
+    }
+
+    transformTo(*img, transform);
+    return img;
+}
+
+bool skImage::transformInPlace(const skImageTransform& transform)
+{
+    materialize();
+
+    if (!m_bytes)
+        return false;
+
+    switch (transform)
+    {
+    case SK_TRANSFORM_NONE:
+        return true;
+    case SK_FLIP_HORIZONTAL:
+        flipHorizontal();
+        return true;
+    case SK_FLIP_VERTICAL:
+        flipVertical();
+        return true;
+    case SK_ROTATE_180:
+        flipHorizontal();
+        flipVertical();
+        return true;
+    default:
+        break;
+    }
+
+    if (m_width == m_height)
+    {
+        transposeSquare();
+
+        if (transform == SK_ROTATE_90 || transform == SK_TRANSVERSE)
+            flipHorizontal();
+        if (transform == SK_ROTATE_270 || transform == SK_TRANSVERSE)
+            flipVertical();
+        return true;
+    }
+
+    if (m_view)
+    {
+        skLogf(LD_ERROR, "A non-square view cannot be rotated in place.\n");
+        return false;
+    }
+
+    skImage* img = this->transform(transform);
+    if (!img)
+        return false;
+
+    // The rotated bitmap is freshly allocated; carry the metadata and
+    // the ICC profile over so they survive the swap.
+    if (m_bitmap && img->m_bitmap)
+    {
+        FreeImage_CloneMetadata(img->m_bitmap, m_bitmap);
+
+        const FIICCPROFILE* icc = FreeImage_GetICCProfile(m_bitmap);
+        if (icc && icc->size > 0 && icc->data)
+        {
+            FIICCPROFILE* copy = FreeImage_CreateICCProfile(img->m_bitmap, icc->data, (long)icc->size);
+            if (copy)
+                copy->flags = icc->flags;
+        }
+    }
+
+    skSwap(m_bitmap, img->m_bitmap);
+    skSwap(m_bytes, img->m_bytes);
+    skSwap(m_width, img->m_width);
+    skSwap(m_height, img->m_height);
+    skSwap(m_pitch, img->m_pitch);
+    skSwap(m_size, img->m_size);
+    delete img;
+    return true;
+}
+
+bool skImage::applyExifOrientation()
+{
+    materialize();
+
+    if (!m_bitmap)
+        return false;
+
+    FITAG* tag = nullptr;
+    if (!FreeImage_GetMetadata(FIMD_EXIF_MAIN, m_bitmap, "Orientation", &tag) || !tag)
+        return false;
+
+    const void* value = FreeImage_GetTagValue(tag);
+    if (!value || FreeImage_GetTagType(tag) != FIDT_SHORT)
+        return false;
+
+    skImageTransform transform;
+    switch (*(const WORD*)value)
+    {
+    case 2:
+        transform = SK_FLIP_HORIZONTAL;
+        break;
+    case 3:
+        transform = SK_ROTATE_180;
+        break;
+    case 4:
+        transform = SK_FLIP_VERTICAL;
+        break;
+    case 5:
+        transform = SK_TRANSPOSE;
+        break;
+    case 6:
+        transform = SK_ROTATE_90;
+        break;
+    case 7:
+        transform = SK_TRANSVERSE;
+        break;
+    case 8:
+        transform = SK_ROTATE_270;
+        break;
+    default:
+        return false;
+    }
+
+    if (!transformInPlace(transform))
+        return false;
+
+    // The tag travels with the rotated bitmap; drop it so the
+    // orientation cannot be applied twice.
+    FreeImage_SetMetadata(FIMD_EXIF_MAIN, m_bitmap, "Orientation", nullptr);
+    return true;
+}
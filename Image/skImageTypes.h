@@ -37,9 +37,162 @@ typedef enum SKPixelFormat
     SK_BGRA,
     SK_ARGB,
     SK_ABGR,
+    SK_INDEXED8,
+    SK_LUMINANCE16,
+    SK_RGBA16,
+    SK_LUMINANCE_HALF,
+    SK_RGBA_HALF,
+    SK_LUMINANCE_FLOAT,
+    SK_RGBA_FLOAT,
     SK_PF_MAX,
 } skPixelFormat;
 
+typedef enum SKChannel
+{
+    SK_CHANNEL_R,
+    SK_CHANNEL_G,
+    SK_CHANNEL_B,
+    SK_CHANNEL_A,
+    SK_CHANNEL_MAX,
+} skChannel;
+
+typedef enum SKLumWeights
+{
+    SK_LUM_AVERAGE,
+    SK_LUM_REC601,
+    SK_LUM_REC709,
+} skLumWeights;
+
+typedef enum SKFillRule
+{
+    SK_FILL_EVEN_ODD,
+    SK_FILL_NON_ZERO,
+} skFillRule;
+
+typedef enum SKConnectivity
+{
+    SK_CONNECT_4,
+    SK_CONNECT_8,
+} skConnectivity;
+
+typedef enum SKAntiAlias
+{
+    SK_AA_NONE = 1,
+    SK_AA_4X   = 4,
+    SK_AA_8X   = 8,
+} skAntiAlias;
+
+typedef enum SKImageTransform
+{
+    SK_TRANSFORM_NONE,
+    SK_FLIP_HORIZONTAL,
+    SK_FLIP_VERTICAL,
+    SK_ROTATE_90,
+    SK_ROTATE_180,
+    SK_ROTATE_270,
+    SK_TRANSPOSE,
+    SK_TRANSVERSE,
+} skImageTransform;
+
+typedef enum SKBlockFormat
+{
+    SK_BC1,
+    SK_BC3,
+    SK_BC4,
+    SK_BC5,
+} skBlockFormat;
+
+typedef enum SKBlockQuality
+{
+    SK_BLOCK_FAST,
+    SK_BLOCK_QUALITY,
+} skBlockQuality;
+
+typedef enum SKMipFilter
+{
+    SK_MIP_BOX,
+    SK_MIP_KAISER,
+} skMipFilter;
+
+typedef enum SKPlanarFormat
+{
+    SK_PLANAR_I420,
+    SK_PLANAR_NV12,
+} skPlanarFormat;
+
+typedef enum SKYuvMatrix
+{
+    SK_YUV_BT601,
+    SK_YUV_BT709,
+} skYuvMatrix;
+
+typedef enum SKYuvRange
+{
+    SK_YUV_LIMITED,
+    SK_YUV_FULL,
+} skYuvRange;
+
+typedef enum SKPngFilter
+{
+    SK_PNG_FILTER_NONE,
+    SK_PNG_FILTER_SUB,
+    SK_PNG_FILTER_UP,
+    SK_PNG_FILTER_AVERAGE,
+    SK_PNG_FILTER_PAETH,
+    SK_PNG_FILTER_ADAPTIVE,
+} skPngFilter;
+
+typedef enum SKPyramidLayout
+{
+    SK_PYRAMID_DZI,
+    SK_PYRAMID_XYZ,
+} skPyramidLayout;
+
+typedef struct skPointf
+{
+    float x, y;
+} skPointf;
+
+typedef struct skGlyphQuad
+{
+    SKint32  x, y;
+    SKuint32 srcX, srcY;
+    SKuint32 width, height;
+} skGlyphQuad;
+
+typedef struct skImageStatistics
+{
+    SKuint32 histogram[SK_CHANNEL_MAX][256];
+    SKuint32 luminance[256];
+    SKubyte  min[SK_CHANNEL_MAX];
+    SKubyte  max[SK_CHANNEL_MAX];
+    double   mean[SK_CHANNEL_MAX];
+    double   stddev[SK_CHANNEL_MAX];
+    SKuint64 count;
+} skImageStatistics;
+
+typedef struct skImageComparison
+{
+    SKuint64 mismatches;
+    SKuint32 firstX;
+    SKuint32 firstY;
+    SKuint32 maxError[SK_CHANNEL_MAX];
+    double   meanError[SK_CHANNEL_MAX];
+    double   mse[SK_CHANNEL_MAX];
+    double   psnr[SK_CHANNEL_MAX];
+    double   psnrColor;
+} skImageComparison;
+
+typedef struct skImageCacheStats
+{
+    SKuint64 hits;
+    SKuint64 misses;
+    SKuint64 evictions;
+    SKsize   entries;
+    SKsize   bytes;
+    SKsize   budget;
+} skImageCacheStats;
+
 
 typedef union skColorUnion
 {
@@ -0,0 +1,319 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _skImageUtils_h_
+#define _skImageUtils_h_
+
+#include <stddef.h>
+#include "FreeImage.h"
+#include "Image/skImage.h"
+#include "Utils/skMemoryUtils.h"
+#include "Utils/skMinMax.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SK_IMAGE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// GCC and Clang only define __F16C__ when it is enabled; MSVC has no
+// F16C macro, but every AVX2 target has it.
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define SK_IMAGE_F16C 1
+#include <immintrin.h>
+#endif
+
+// Images smaller than this many pixels are processed on the calling thread.
+#define SK_IMAGE_PARALLEL_MIN 0x40000
+
+class ImageUtils
+{
+public:
+    static int getFormat(const int format)
+    {
+        int out = (int)FIF_UNKNOWN;
+        switch (format)
+        {
+        case FIF_BMP:
+            out = FIF_BMP;
+            break;
+        case FIF_JPEG:
+            out = FIF_JPEG;
+            break;
+        case FIF_J2K:
+            out = FIF_J2K;
+            break;
+        case FIF_PNG:
+            out = FIF_PNG;
+            break;
+        case FIF_PSD:
+            out = FIF_PSD;
+            break;
+        case FIF_TARGA:
+            out = FIF_TARGA;
+            break;
+        case FIF_XPM:
+            out = FIF_XPM;
+            break;
+        case FIF_TIFF:
+            out = FIF_TIFF;
+            break;
+        case FIF_HDR:
+            out = FIF_HDR;
+            break;
+        case FIF_EXR:
+            out = FIF_EXR;
+            break;
+        case FIF_PFM:
+            out = FIF_PFM;
+            break;
+        default:
+            break;
+        }
+        return out;
+    }
+
+    // The FreeImage storage type for a format. Half formats are stored
+    // in 16-bit bitmaps and are only told apart by the skImage format.
+    static FREE_IMAGE_TYPE getImageType(const skPixelFormat format)
+    {
+        switch (format)
+        {
+        case SK_LUMINANCE16:
+        case SK_LUMINANCE_HALF:
+            return FIT_UINT16;
+        case SK_RGBA16:
+        case SK_RGBA_HALF:
+            return FIT_RGBA16;
+        case SK_LUMINANCE_FLOAT:
+            return FIT_FLOAT;
+        case SK_RGBA_FLOAT:
+            return FIT_RGBAF;
+        default:
+            return FIT_BITMAP;
+        }
+    }
+
+    // True for the formats with one byte per channel and no palette,
+    // which is what the filter, LUT and statistics kernels work on.
+    static bool isByteFormat(const skPixelFormat format)
+    {
+        return format < SK_INDEXED8;
+    }
+
+    static bool hasAlpha(const skPixelFormat format)
+    {
+        switch (format)
+        {
+        case SK_LUMINANCE_ALPHA:
+        case SK_RGBA:
+        case SK_BGRA:
+        case SK_ARGB:
+        case SK_ABGR:
+        case SK_RGBA16:
+        case SK_RGBA_HALF:
+        case SK_RGBA_FLOAT:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    static float halfToFloat(const SKuint16 h)
+    {
+        const SKuint32 ShiftedExp = 0x7C00 << 13;
+
+        SKuint32       o   = (SKuint32)(h & 0x7FFF) << 13;
+        const SKuint32 exp = o & ShiftedExp;
+        o += (127 - 15) << 23;
+
+        float f;
+        if (exp == ShiftedExp)
+            o += (128 - 16) << 23;
+        else if (exp == 0)
+        {
+            // Denormal, renormalized through the float unit.
+            const SKuint32 Magic = 113 << 23;
+
+            float m;
+            o += 1 << 23;
+            skMemcpy(&f, &o, sizeof f);
+            skMemcpy(&m, &Magic, sizeof m);
+            f -= m;
+            skMemcpy(&o, &f, sizeof o);
+        }
+
+        o |= (SKuint32)(h & 0x8000) << 16;
+        skMemcpy(&f, &o, sizeof f);
+        return f;
+    }
+
+    // Rounds to nearest even, like the F16C instructions.
+    static SKuint16 floatToHalf(const float f)
+    {
+        SKuint32 x;
+        skMemcpy(&x, &f, sizeof x);
+
+        const SKuint32 sign = x & 0x80000000;
+        x ^= sign;
+
+        SKuint32 o;
+        if (x >= (127 + 16) << 23)
+            o = x > 0x7F800000 ? 0x7E00 : 0x7C00;
+        else if (x < 113 << 23)
+        {
+            const SKuint32 Magic = ((127 - 15) + (23 - 10) + 1) << 23;
+
+            float v, m;
+            skMemcpy(&v, &x, sizeof v);
+            skMemcpy(&m, &Magic, sizeof m);
+            v += m;
+            skMemcpy(&o, &v, sizeof o);
+            o -= Magic;
+        }
+        else
+        {
+            const SKuint32 odd = (x >> 13) & 1;
+            x += ((SKuint32)(15 - 127) << 23) + 0xFFF + odd;
+            o = x >> 13;
+        }
+        return (SKuint16)(o | sign >> 16);
+    }
+
+    static SKubyte unitToByte(const float v)
+    {
+        return (SKubyte)(skClamp(v, 0.f, 1.f) * 255.f + 0.5f);
+    }
+
+    // Byte offsets of the r, g, b and a channels inside a pixel of the
+    // given format, using the same mapping as skImage::getPixel. A
+    // negative offset marks a channel the format does not store.
+    static bool getChannelOffsets(const skPixelFormat format, SKint32 offs[SK_CHANNEL_MAX])
+    {
+        switch (format)
+        {
+        case SK_RGB:
+            offs[0] = (SKint32)offsetof(skPixelRGB, r);
+            offs[1] = (SKint32)offsetof(skPixelRGB, g);
+            offs[2] = (SKint32)offsetof(skPixelRGB, b);
+            offs[3] = -1;
+            return true;
+        case SK_BGR:
+            offs[0] = (SKint32)offsetof(skPixelRGB, b);
+            offs[1] = (SKint32)offsetof(skPixelRGB, g);
+            offs[2] = (SKint32)offsetof(skPixelRGB, r);
+            offs[3] = -1;
+            return true;
+        case SK_RGBA:
+            offs[0] = (SKint32)offsetof(skPixelRGBA, r);
+            offs[1] = (SKint32)offsetof(skPixelRGBA, g);
+            offs[2] = (SKint32)offsetof(skPixelRGBA, b);
+            offs[3] = (SKint32)offsetof(skPixelRGBA, a);
+            return true;
+        case SK_BGRA:
+            offs[0] = (SKint32)offsetof(skPixelRGBA, b);
+            offs[1] = (SKint32)offsetof(skPixelRGBA, g);
+            offs[2] = (SKint32)offsetof(skPixelRGBA, r);
+            offs[3] = (SKint32)offsetof(skPixelRGBA, a);
+            return true;
+        case SK_ARGB:
+            offs[0] = (SKint32)offsetof(skPixelRGBA, a);
+            offs[1] = (SKint32)offsetof(skPixelRGBA, r);
+            offs[2] = (SKint32)offsetof(skPixelRGBA, g);
+            offs[3] = (SKint32)offsetof(skPixelRGBA, b);
+            return true;
+        case SK_ABGR:
+            offs[0] = (SKint32)offsetof(skPixelRGBA, a);
+            offs[1] = (SKint32)offsetof(skPixelRGBA, b);
+            offs[2] = (SKint32)offsetof(skPixelRGBA, g);
+            offs[3] = (SKint32)offsetof(skPixelRGBA, r);
+            return true;
+        case SK_LUMINANCE_ALPHA:
+            offs[0] = (SKint32)offsetof(skPixelLA, l);
+            offs[1] = offs[0];
+            offs[2] = offs[0];
+            offs[3] = (SKint32)offsetof(skPixelLA, a);
+            return true;
+        case SK_LUMINANCE:
+        case SK_ALPHA:
+            offs[0] = offs[1] = offs[2] = offs[3] = 0;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Writes the packed pixel once, then doubles the filled part of
+    // the span onto itself so the fill runs as block copies.
+    static void fillSpan(SKubyte*       dst,
+                         const SKuint32 count,
+                         const SKubyte* px,
+                         const SKuint32 bpp)
+    {
+        if (!dst || !px || count == 0 || bpp == 0)
+            return;
+
+        if (bpp == 1)
+        {
+            skMemset(dst, px[0], count);
+            return;
+        }
+
+        const SKsize total = (SKsize)count * (SKsize)bpp;
+        const SKsize block = (SKsize)bpp * 1024;
+
+        skMemcpy(dst, px, bpp);
+
+        SKsize filled = bpp;
+        while (filled < total)
+        {
+            SKsize n = skMin(filled, total - filled);
+            n        = skMin(n, block);
+
+            skMemcpy(dst + filled, dst, n);
+            filled += n;
+        }
+    }
+
+    // Mixes src into dst by an 8-bit coverage value.
+    static void blendPixel(const skImage& image,
+                           SKubyte*       dst,
+                           const skPixel& src,
+                           const SKuint32 coverage)
+    {
+        if (coverage >= 255)
+            image.packPixel(dst, src);
+        else if (coverage > 0)
+        {
+            skPixel dp;
+            image.unpackPixel(dp, dst);
+
+            const SKuint32 ic = 255 - coverage;
+
+            dp.r = (SKubyte)((src.r * coverage + dp.r * ic + 127) / 255);
+            dp.g = (SKubyte)((src.g * coverage + dp.g * ic + 127) / 255);
+            dp.b = (SKubyte)((src.b * coverage + dp.b * ic + 127) / 255);
+            dp.a = (SKubyte)((src.a * coverage + dp.a * ic + 127) / 255);
+            image.packPixel(dst, dp);
+        }
+    }
+};
+
+#endif  //_skImageUtils_h_
@@ -0,0 +1,298 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Image/skIntegralImage.h"
+#include <string.h>
+#include "Image/skImage.h"
+#include "Image/skImageUtils.h"
+#include "Image/skParallel.h"
+
+// Columns are summed in strips of this many entries per thread.
+const SKuint32 ColumnStrip = 1024;
+
+skIntegralImage::skIntegralImage() :
+    m_width(0),
+    m_height(0),
+    m_channels(0),
+    m_wide(false),
+    m_data(nullptr)
+{
+    for (SKuint32 c = 0; c < SK_CHANNEL_MAX; ++c)
+        m_offsets[c] = -1;
+}
+
+skIntegralImage::~skIntegralImage()
+{
+    clear();
+}
+
+void skIntegralImage::clear()
+{
+    if (m_wide)
+        delete[] (SKuint64*)m_data;
+    else
+        delete[] (SKuint32*)m_data;
+
+    m_data     = nullptr;
+    m_width    = 0;
+    m_height   = 0;
+    m_channels = 0;
+    m_wide     = false;
+
+    for (SKuint32 c = 0; c < SK_CHANNEL_MAX; ++c)
+        m_offsets[c] = -1;
+}
+
+// Running sums of one row, written after the leading zero entry.
+template <typename T>
+static void prefixRow(T* dst, const SKubyte* src, const SKuint32 w, const SKuint32 bpp)
+{
+    dst += bpp;
+
+    SKuint32 x = 0;
+#ifdef SK_IMAGE_SSE2
+    if (bpp == 4)
+    {
+        const __m128i zero = _mm_setzero_si128();
+
+        if (sizeof(T) == 4)
+        {
+            __m128i acc = zero;
+            for (; x < w; ++x, src += 4, dst += 4)
+            {
+                const __m128i px = _mm_cvtsi32_si128(*(const int*)src);
+                acc              = _mm_add_epi32(acc, _mm_unpacklo_epi16(_mm_unpacklo_epi8(px, zero), zero));
+                _mm_storeu_si128((__m128i*)dst, acc);
+            }
+        }
+        else
+        {
+            __m128i lo = zero, hi = zero;
+            for (; x < w; ++x, src += 4, dst += 4)
+            {
+                const __m128i px = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(*(const int*)src), zero), zero);
+
+                lo = _mm_add_epi64(lo, _mm_unpacklo_epi32(px, zero));
+                hi = _mm_add_epi64(hi, _mm_unpackhi_epi32(px, zero));
+                _mm_storeu_si128((__m128i*)dst, lo);
+                _mm_storeu_si128((__m128i*)dst + 1, hi);
+            }
+        }
+        return;
+    }
+#endif
+
+    T acc[4] = {};
+    for (; x < w; ++x, src += bpp, dst += bpp)
+    {
+        for (SKuint32 i = 0; i < bpp; ++i)
+        {
+            acc[i] += src[i];
+            dst[i] = acc[i];
+        }
+    }
+}
+
+// Adds the row above into a strip of a row.
+template <typename T>
+static void addRow(T* dst, const T* above, const SKsize count)
+{
+    SKsize i = 0;
+#ifdef SK_IMAGE_SSE2
+    const SKsize lanes = 16 / sizeof(T);
+    for (; i + lanes * 2 <= count; i += lanes * 2)
+    {
+        const __m128i* a = (const __m128i*)(above + i);
+        __m128i*       d = (__m128i*)(dst + i);
+
+        const __m128i d0 = _mm_loadu_si128(d), d1 = _mm_loadu_si128(d + 1);
+        const __m128i a0 = _mm_loadu_si128(a), a1 = _mm_loadu_si128(a + 1);
+
+        if (sizeof(T) == 4)
+        {
+            _mm_storeu_si128(d, _mm_add_epi32(d0, a0));
+            _mm_storeu_si128(d + 1, _mm_add_epi32(d1, a1));
+        }
+        else
+        {
+            _mm_storeu_si128(d, _mm_add_epi64(d0, a0));
+            _mm_storeu_si128(d + 1, _mm_add_epi64(d1, a1));
+        }
+    }
+#endif
+    for (; i < count; ++i)
+        dst[i] += above[i];
+}
+
+template <typename T>
+void skIntegralImage::build(const skImage& image, const SKuint32 threads)
+{
+    const SKsize stride = getStride();
+    T*           data   = new T[stride * ((SKsize)m_height + 1)];
+
+    memset(data, 0, stride * sizeof(T));
+    m_data = data;
+
+    // Rows are independent, so the first pass splits by rows.
+    skParallel::forRange(
+        m_height,
+        64,
+        [&](const SKuint32 y0, const SKuint32 y1)
+        {
+            for (SKuint32 y = y0; y < y1; ++y)
+            {
+                T* row = data + stride * ((SKsize)y + 1);
+                memset(row, 0, m_channels * sizeof(T));
+
+                const SKuint32 sy = image.isFlipY() ? m_height - 1 - y : y;
+                prefixRow(row, image.getBytes() + (SKsize)sy * image.getPitch(), m_width, m_channels);
+            }
+        },
+        threads);
+
+    // The second pass runs down the rows, split into column strips.
+    const SKuint32 strips = (SKuint32)((stride + ColumnStrip - 1) / ColumnStrip);
+
+    skParallel::forEach(
+        strips,
+        [&](const SKuint32 s)
+        {
+            const SKsize first = (SKsize)s * ColumnStrip;
+            const SKsize count = skMin<SKsize>(ColumnStrip, stride - first);
+
+            for (SKuint32 y = 2; y <= m_height; ++y)
+            {
+                T* row = data + stride * y + first;
+                addRow(row, row - stride, count);
+            }
+        },
+        threads);
+}
+
+bool skIntegralImage::build(const skImage& image, const bool wide)
+{
+    clear();
+
+    const skPixelFormat format = image.getFormat();
+    if (!image.getBytes() || !ImageUtils::isByteFormat(format) ||
+        !ImageUtils::getChannelOffsets(format, m_offsets))
+    {
+        for (SKuint32 c = 0; c < SK_CHANNEL_MAX; ++c)
+            m_offsets[c] = -1;
+        return false;
+    }
+
+    // Every byte of the pixel is one channel.
+    if (format == SK_ALPHA)
+        m_offsets[0] = m_offsets[1] = m_offsets[2] = -1;
+    else if (format == SK_LUMINANCE)
+        m_offsets[1] = m_offsets[2] = m_offsets[3] = -1;
+    else if (format == SK_LUMINANCE_ALPHA)
+        m_offsets[1] = m_offsets[2] = -1;
+
+    m_width    = image.getWidth();
+    m_height   = image.getHeight();
+    m_channels = image.getBPP();
+    m_wide     = wide || (SKuint64)m_width * m_height * 255 > 0xFFFFFFFF;
+
+    const SKuint32 threads = (SKsize)m_width * m_height >= SK_IMAGE_PARALLEL_MIN ? 0 : 1;
+
+    if (m_wide)
+        build<SKuint64>(image, threads);
+    else
+        build<SKuint32>(image, threads);
+    return true;
+}
+
+bool skIntegralImage::clip(SKuint32& x, SKuint32& y, SKuint32& width, SKuint32& height) const
+{
+    if (!m_data || x >= m_width || y >= m_height)
+        return false;
+
+    width  = skMin(width, m_width - x);
+    height = skMin(height, m_height - y);
+    return width > 0 && height > 0;
+}
+
+template <typename T>
+SKuint64 skIntegralImage::sum(const SKuint32 x0,
+                              const SKuint32 y0,
+                              const SKuint32 x1,
+                              const SKuint32 y1,
+                              const SKint32  offs) const
+{
+    const T*     data   = (const T*)m_data;
+    const SKsize stride = getStride();
+
+    const T* top    = data + stride * y0 + offs;
+    const T* bottom = data + stride * y1 + offs;
+
+    // Unsigned wrap keeps 32-bit differences exact.
+    const T r = bottom[(SKsize)x1 * m_channels] - bottom[(SKsize)x0 * m_channels] -
+                top[(SKsize)x1 * m_channels] + top[(SKsize)x0 * m_channels];
+    return (SKuint64)r;
+}
+
+SKuint64 skIntegralImage::getSum(SKuint32        x,
+                                 SKuint32        y,
+                                 SKuint32        width,
+                                 SKuint32        height,
+                                 const skChannel channel) const
+{
+    if (channel >= SK_CHANNEL_MAX || m_offsets[channel] < 0 || !clip(x, y, width, height))
+        return 0;
+
+    if (m_wide)
+        return sum<SKuint64>(x, y, x + width, y + height, m_offsets[channel]);
+    return sum<SKuint32>(x, y, x + width, y + height, m_offsets[channel]);
+}
+
+void skIntegralImage::getSums(const SKuint32 x,
+                              const SKuint32 y,
+                              const SKuint32 width,
+                              const SKuint32 height,
+                              SKuint64       sums[SK_CHANNEL_MAX]) const
+{
+    for (SKuint32 c = 0; c < SK_CHANNEL_MAX; ++c)
+        sums[c] = getSum(x, y, width, height, (skChannel)c);
+}
+
+double skIntegralImage::getMean(SKuint32        x,
+                                SKuint32        y,
+                                SKuint32        width,
+                                SKuint32        height,
+                                const skChannel channel) const
+{
+    const SKuint64 s = getSum(x, y, width, height, channel);
+    if (!clip(x, y, width, height))
+        return 0.0;
+    return (double)s / ((double)width * height);
+}
+
+void skIntegralImage::getMeans(const SKuint32 x,
+                               const SKuint32 y,
+                               const SKuint32 width,
+                               const SKuint32 height,
+                               double         means[SK_CHANNEL_MAX]) const
+{
+    for (SKuint32 c = 0; c < SK_CHANNEL_MAX; ++c)
+        means[c] = getMean(x, y, width, height, (skChannel)c);
+}
@@ -0,0 +1,131 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _skIntegralImage_h_
+#define _skIntegralImage_h_
+
+#include "Image/skImageTypes.h"
+#include "Utils/Config/skConfig.h"
+
+class skImage;
+
+// Summed-area table of an 8-bit image. Each stored channel is summed
+// in pixel byte order over (width + 1) x (height + 1) entries, with a
+// zero first row and column, so any rectangle sum takes four reads.
+// Entries are 32-bit when the image sum cannot overflow, else 64-bit.
+class skIntegralImage
+{
+private:
+    SKuint32 m_width;
+    SKuint32 m_height;
+    SKuint32 m_channels;
+    SKint32  m_offsets[SK_CHANNEL_MAX];
+    bool     m_wide;
+    void*    m_data;
+
+    template <typename T>
+    void build(const skImage& image, SKuint32 threads);
+
+    template <typename T>
+    SKuint64 sum(SKuint32 x0, SKuint32 y0, SKuint32 x1, SKuint32 y1, SKint32 offs) const;
+
+    bool clip(SKuint32& x, SKuint32& y, SKuint32& width, SKuint32& height) const;
+
+public:
+    skIntegralImage();
+    ~skIntegralImage();
+
+    skIntegralImage(const skIntegralImage& rhs) = delete;
+    skIntegralImage& operator=(const skIntegralImage& rhs) = delete;
+
+    SKuint32 getWidth() const
+    {
+        return m_width;
+    }
+
+    SKuint32 getHeight() const
+    {
+        return m_height;
+    }
+
+    SKuint32 getChannelCount() const
+    {
+        return m_channels;
+    }
+
+    bool isWide() const
+    {
+        return m_wide;
+    }
+
+    // Entries per table row, (width + 1) * channels.
+    SKsize getStride() const
+    {
+        return ((SKsize)m_width + 1) * m_channels;
+    }
+
+    // Valid when isWide is false.
+    const SKuint32* getData32() const
+    {
+        return m_wide ? nullptr : (const SKuint32*)m_data;
+    }
+
+    // Valid when isWide is true.
+    const SKuint64* getData64() const
+    {
+        return m_wide ? (const SKuint64*)m_data : nullptr;
+    }
+
+    // Builds the table from any 8-bit format other than SK_INDEXED8.
+    // Luminance is summed as the red channel. The wide option forces
+    // 64-bit entries.
+    bool build(const skImage& image, bool wide = false);
+
+    void clear();
+
+    // Rectangles are clipped to the image. Channels the format does
+    // not store sum to zero.
+    SKuint64 getSum(SKuint32  x,
+                    SKuint32  y,
+                    SKuint32  width,
+                    SKuint32  height,
+                    skChannel channel) const;
+
+    void getSums(SKuint32 x,
+                 SKuint32 y,
+                 SKuint32 width,
+                 SKuint32 height,
+                 SKuint64 sums[SK_CHANNEL_MAX]) const;
+
+    double getMean(SKuint32  x,
+                   SKuint32  y,
+                   SKuint32  width,
+                   SKuint32  height,
+                   skChannel channel) const;
+
+    void getMeans(SKuint32 x,
+                  SKuint32 y,
+                  SKuint32 width,
+                  SKuint32 height,
+                  double   means[SK_CHANNEL_MAX]) const;
+};
+
+#endif  //_skIntegralImage_h_
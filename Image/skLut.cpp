@@ -0,0 +1,126 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Image/skLut.h"
+#include <math.h>
+#include "Utils/skMemoryUtils.h"
+#include "Utils/skMinMax.h"
+
+
+static SKubyte toByte(const float v)
+{
+    return (SKubyte)skClamp<float>(floorf(v * 255.f + 0.5f), 0.f, 255.f);
+}
+
+skLut::skLut()
+{
+    for (SKuint32 c = 0; c < SK_CHANNEL_MAX; ++c)
+        identity(m_tables[c]);
+}
+
+void skLut::setTable(const skChannel channel, const SKubyte* table)
+{
+    if (channel < SK_CHANNEL_MAX && table)
+        skMemcpy(m_tables[channel], table, 256);
+}
+
+void skLut::setColorTables(const SKubyte* table)
+{
+    setTable(SK_CHANNEL_R, table);
+    setTable(SK_CHANNEL_G, table);
+    setTable(SK_CHANNEL_B, table);
+}
+
+bool skLut::isIdentity(const skChannel channel) const
+{
+    for (SKuint32 i = 0; i < 256; ++i)
+    {
+        if (m_tables[channel][i] != i)
+            return false;
+    }
+    return true;
+}
+
+void skLut::identity(SKubyte* table)
+{
+    for (SKuint32 i = 0; i < 256; ++i)
+        table[i] = (SKubyte)i;
+}
+
+void skLut::invert(SKubyte* table)
+{
+    for (SKuint32 i = 0; i < 256; ++i)
+        table[i] = (SKubyte)(255 - i);
+}
+
+void skLut::gamma(SKubyte* table, const float gamma)
+{
+    const float e = gamma > 0 ? 1.f / gamma : 1.f;
+    for (SKuint32 i = 0; i < 256; ++i)
+        table[i] = toByte(powf((float)i / 255.f, e));
+}
+
+void skLut::srgbToLinear(SKubyte* table)
+{
+    for (SKuint32 i = 0; i < 256; ++i)
+    {
+        const float v = (float)i / 255.f;
+        table[i]      = toByte(v <= 0.04045f ? v / 12.92f : powf((v + 0.055f) / 1.055f, 2.4f));
+    }
+}
+
+void skLut::linearToSrgb(SKubyte* table)
+{
+    for (SKuint32 i = 0; i < 256; ++i)
+    {
+        const float v = (float)i / 255.f;
+        table[i]      = toByte(v <= 0.0031308f ? v * 12.92f : 1.055f * powf(v, 1.f / 2.4f) - 0.055f);
+    }
+}
+
+void skLut::levels(SKubyte*      table,
+                   const SKubyte inBlack,
+                   const SKubyte inWhite,
+                   const float   gamma,
+                   const SKubyte outBlack,
+                   const SKubyte outWhite)
+{
+    const float lo = (float)inBlack;
+    const float hi = skMax<float>((float)inWhite, lo + 1.f);
+    const float e  = gamma > 0 ? 1.f / gamma : 1.f;
+
+    for (SKuint32 i = 0; i < 256; ++i)
+    {
+        float v = skClamp<float>(((float)i - lo) / (hi - lo), 0.f, 1.f);
+
+        v        = powf(v, e);
+        table[i] = toByte(((float)outBlack + v * ((float)outWhite - (float)outBlack)) / 255.f);
+    }
+}
+
+void skLut::contrast(SKubyte* table, const float contrast, const float brightness)
+{
+    for (SKuint32 i = 0; i < 256; ++i)
+    {
+        const float v = ((float)i - 127.5f) * contrast + 127.5f + brightness;
+        table[i]      = toByte(v / 255.f);
+    }
+}
@@ -0,0 +1,74 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _skLut_h_
+#define _skLut_h_
+
+#include "Image/skImageTypes.h"
+#include "Utils/Config/skConfig.h"
+
+class skLut
+{
+private:
+    SKubyte m_tables[SK_CHANNEL_MAX][256];
+
+public:
+    skLut();
+
+    const SKubyte* getTable(const skChannel channel) const
+    {
+        return m_tables[channel];
+    }
+
+    SKubyte* getTable(const skChannel channel)
+    {
+        return m_tables[channel];
+    }
+
+    void setTable(skChannel channel, const SKubyte* table);
+
+    // Sets the r, g and b tables, leaving alpha as it is.
+    void setColorTables(const SKubyte* table);
+
+    bool isIdentity(skChannel channel) const;
+
+    static void identity(SKubyte* table);
+
+    static void invert(SKubyte* table);
+
+    // out = in ^ (1 / gamma), with in and out normalized to [0, 1].
+    static void gamma(SKubyte* table, float gamma);
+
+    static void srgbToLinear(SKubyte* table);
+
+    static void linearToSrgb(SKubyte* table);
+
+    static void levels(SKubyte* table,
+                       SKubyte  inBlack,
+                       SKubyte  inWhite,
+                       float    gamma,
+                       SKubyte  outBlack,
+                       SKubyte  outWhite);
+
+    static void contrast(SKubyte* table, float contrast, float brightness);
+};
+
+#endif  //_skLut_h_
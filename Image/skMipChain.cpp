@@ -0,0 +1,445 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Image/skMipChain.h"
+#include <math.h>
+#include "Image/skImage.h"
+#include "Image/skImageUtils.h"
+#include "Image/skParallel.h"
+#include "Utils/skMinMax.h"
+
+
+// Box chains are built from TileSize squares of one level, which are
+// halved down to a single pixel while they are still in cache.
+const SKuint32 TileShift = 6;
+const SKuint32 TileSize  = 1 << TileShift;
+
+// Kaiser chains use eight taps around each pair of source pixels.
+const SKint32 KaiserTaps = 8;
+
+const SKuint32 SrgbTableSize = 4096;
+
+struct skMipCodec
+{
+    SKint32 offs[SK_CHANNEL_MAX];
+    bool    srgb;
+    bool    premultiply;
+    float   toLinear[256];
+    SKubyte toSrgb[SrgbTableSize];
+
+    void decode(float* dst, const SKubyte* src) const
+    {
+        const float a = offs[3] < 0 ? 1.f : src[offs[3]] * (1.f / 255.f);
+        for (SKuint32 k = 0; k < 3; ++k)
+        {
+            const float c = srgb ? toLinear[src[offs[k]]] : src[offs[k]] * (1.f / 255.f);
+            dst[k]        = premultiply ? c * a : c;
+        }
+        dst[3] = a;
+    }
+
+    void encode(SKubyte* dst, const float* src) const
+    {
+        const float a = skClamp(src[3], 0.f, 1.f);
+        for (SKuint32 k = 0; k < 3; ++k)
+        {
+            float c = src[k];
+            if (premultiply)
+                c = a > 0.f ? c / a : 0.f;
+            c = skClamp(c, 0.f, 1.f);
+
+            dst[offs[k]] = srgb ? toSrgb[(SKuint32)(c * (SrgbTableSize - 1) + 0.5f)]
+                                : (SKubyte)(c * 255.f + 0.5f);
+        }
+
+        // Alpha is written last, so aliased offsets keep it for SK_ALPHA.
+        if (offs[3] >= 0)
+            dst[offs[3]] = (SKubyte)(a * 255.f + 0.5f);
+    }
+};
+
+static void initializeCodec(skMipCodec& codec)
+{
+    for (SKuint32 i = 0; i < 256; ++i)
+    {
+        const float c = i / 255.f;
+
+        codec.toLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    for (SKuint32 i = 0; i < SrgbTableSize; ++i)
+    {
+        const float c = i / (float)(SrgbTableSize - 1);
+        const float s = c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.f / 2.4f) - 0.055f;
+
+        codec.toSrgb[i] = (SKubyte)(skClamp(s, 0.f, 1.f) * 255.f + 0.5f);
+    }
+}
+
+static float besselI0(const float x)
+{
+    float sum = 1.f, term = 1.f;
+    for (SKuint32 k = 1; k < 16; ++k)
+    {
+        term *= (x * 0.5f / k) * (x * 0.5f / k);
+        sum += term;
+    }
+    return sum;
+}
+
+// Kaiser windowed sinc sampled at the source pixels around an output
+// pixel, two destination pixels wide on each side.
+static void kaiserWeights(float weights[KaiserTaps])
+{
+    const float Pi    = 3.14159265358979f;
+    const float Alpha = 4.f;
+    const float Width = 2.f;
+
+    float sum = 0;
+    for (SKint32 k = 0; k < KaiserTaps; ++k)
+    {
+        const float t = (k - KaiserTaps / 2 + 0.5f) * 0.5f;
+        const float r = t / Width;
+        const float w = besselI0(Alpha * sqrtf(skMax(1.f - r * r, 0.f))) / besselI0(Alpha);
+
+        weights[k] = w * sinf(Pi * t) / (Pi * t);
+        sum += weights[k];
+    }
+
+    for (SKint32 k = 0; k < KaiserTaps; ++k)
+        weights[k] /= sum;
+}
+
+
+skMipChain::skMipChain() :
+    m_filter(SK_MIP_BOX),
+    m_srgb(false),
+    m_premultiply(false),
+    m_premultiplied(false),
+    m_format(SK_RGBA),
+    m_bpp(0),
+    m_levels(0),
+    m_bytes(nullptr)
+{
+    m_offsets[0] = 0;
+}
+
+skMipChain::~skMipChain()
+{
+    delete[] m_bytes;
+}
+
+bool skMipChain::build(const skImage& image)
+{
+    if (!image.getBytes() || image.getWidth() == 0 || image.getHeight() == 0)
+        return false;
+
+    SKint32 offs[SK_CHANNEL_MAX];
+    if (!ImageUtils::getChannelOffsets(image.getFormat(), offs))
+    {
+        skImage* rgba = image.convertToFormat(SK_RGBA);
+        if (!rgba)
+            return false;
+
+        const bool result = build(*rgba);
+        delete rgba;
+        return result;
+    }
+
+    delete[] m_bytes;
+
+    m_format = image.getFormat();
+    m_bpp    = image.getBPP();
+    m_levels = 0;
+
+    m_premultiplied = image.isPremultiplied();
+
+    SKuint32 w = image.getWidth();
+    SKuint32 h = image.getHeight();
+    for (;;)
+    {
+        m_width[m_levels]       = w;
+        m_height[m_levels]      = h;
+        m_offsets[m_levels + 1] = m_offsets[m_levels] + (SKsize)w * h * m_bpp;
+        ++m_levels;
+
+        if (w == 1 && h == 1)
+            break;
+
+        w = skMax<SKuint32>(w >> 1, 1);
+        h = skMax<SKuint32>(h >> 1, 1);
+    }
+
+    m_bytes = new SKubyte[m_offsets[m_levels]];
+
+    const SKuint32 pitch = getLevelPitch(0);
+    for (SKuint32 y = 0; y < m_height[0]; ++y)
+    {
+        const SKuint32 sy = image.isFlipY() ? m_height[0] - 1 - y : y;
+        skMemcpy(m_bytes + (SKsize)y * pitch, image.getBytes() + (SKsize)sy * image.getPitch(), pitch);
+    }
+
+    const SKuint32 threads = (SKsize)m_width[0] * m_height[0] >= SK_IMAGE_PARALLEL_MIN ? 0 : 1;
+    if (m_filter == SK_MIP_KAISER)
+        buildKaiser(threads);
+    else
+        buildBox(threads);
+    return true;
+}
+
+void skMipChain::buildBox(const SKuint32 threads)
+{
+    skMipCodec* codec = new skMipCodec;
+    ImageUtils::getChannelOffsets(m_format, codec->offs);
+    if (m_format == SK_LUMINANCE)
+        codec->offs[3] = -1;
+
+    codec->srgb        = m_srgb;
+    codec->premultiply = m_premultiply && !m_premultiplied;
+    initializeCodec(*codec);
+
+    // The last level of each pass is kept in float for the next one,
+    // so precision is only lost when a level is stored.
+    float* carry[2] = {nullptr, nullptr};
+
+    for (SKuint32 base = 0; base + 1 < m_levels;)
+    {
+        const SKuint32 steps  = skMin(TileShift, m_levels - 1 - base);
+        const SKuint32 last   = base + steps;
+        const bool     keep   = last + 1 < m_levels;
+        const float*   source = carry[0];
+
+        if (keep)
+            carry[1] = new float[(SKsize)m_width[last] * m_height[last] * 4];
+
+        const SKuint32 tilesX = (m_width[base] + TileSize - 1) >> TileShift;
+        const SKuint32 tilesY = (m_height[base] + TileSize - 1) >> TileShift;
+
+        skParallel::forEach(
+            tilesX * tilesY,
+            [&](const SKuint32 tile)
+            {
+                float buf[2][TileSize * TileSize * 4];
+
+                const SKuint32 x0 = (tile % tilesX) << TileShift;
+                const SKuint32 y0 = (tile / tilesX) << TileShift;
+
+                SKuint32 tw = skMin(TileSize, m_width[base] - x0);
+                SKuint32 th = skMin(TileSize, m_height[base] - y0);
+
+                for (SKuint32 y = 0; y < th; ++y)
+                {
+                    float* dst = buf[0] + (SKsize)y * TileSize * 4;
+                    if (source)
+                        skMemcpy(dst, source + ((SKsize)(y0 + y) * m_width[base] + x0) * 4, tw * 4 * sizeof(float));
+                    else
+                    {
+                        const SKubyte* src = getLevelBytes(base) + (SKsize)(y0 + y) * getLevelPitch(base) + (SKsize)x0 * m_bpp;
+                        for (SKuint32 x = 0; x < tw; ++x)
+                            codec->decode(dst + x * 4, src + (SKsize)x * m_bpp);
+                    }
+                }
+
+                const float* prev = buf[0];
+                float*       next = buf[1];
+
+                for (SKuint32 k = 1; k <= steps; ++k)
+                {
+                    const SKuint32 level = base + k;
+                    const SKuint32 pw = tw, ph = th;
+                    const SKuint32 ox = x0 >> k, oy = y0 >> k;
+
+                    tw = skMin(TileSize >> k, m_width[level] - ox);
+                    th = skMin(TileSize >> k, m_height[level] - oy);
+
+                    // Level sizes round down, so pixel pairs only clamp
+                    // at a dimension of one.
+                    for (SKuint32 y = 0; y < th; ++y)
+                    {
+                        const float* r0 = prev + (SKsize)(2 * y) * TileSize * 4;
+                        const float* r1 = prev + (SKsize)skMin(2 * y + 1, ph - 1) * TileSize * 4;
+                        float*       d  = next + (SKsize)y * TileSize * 4;
+
+                        SKubyte* out = getLevelBytes(level) + (SKsize)(oy + y) * getLevelPitch(level) + (SKsize)ox * m_bpp;
+
+                        for (SKuint32 x = 0; x < tw; ++x, out += m_bpp)
+                        {
+                            const SKuint32 a = 8 * x;
+                            const SKuint32 b = 4 * skMin(2 * x + 1, pw - 1);
+
+                            for (SKuint32 c = 0; c < 4; ++c)
+                                d[4 * x + c] = (r0[a + c] + r0[b + c] + r1[a + c] + r1[b + c]) * 0.25f;
+
+                            codec->encode(out, d + 4 * x);
+                        }
+
+                        if (k == steps && keep)
+                            skMemcpy(carry[1] + ((SKsize)(oy + y) * m_width[level] + ox) * 4, d, tw * 4 * sizeof(float));
+                    }
+
+                    prev = next;
+                    next = next == buf[1] ? buf[0] : buf[1];
+                }
+            },
+            threads);
+
+        delete[] carry[0];
+        carry[0] = carry[1];
+        carry[1] = nullptr;
+        base     = last;
+    }
+
+    delete[] carry[0];
+    delete codec;
+}
+
+void skMipChain::buildKaiser(const SKuint32 threads)
+{
+    skMipCodec* codec = new skMipCodec;
+    ImageUtils::getChannelOffsets(m_format, codec->offs);
+    if (m_format == SK_LUMINANCE)
+        codec->offs[3] = -1;
+
+    codec->srgb        = m_srgb;
+    codec->premultiply = m_premultiply && !m_premultiplied;
+    initializeCodec(*codec);
+
+    float weights[KaiserTaps];
+    kaiserWeights(weights);
+
+    float* prev = new float[(SKsize)m_width[0] * m_height[0] * 4];
+
+    skParallel::forRange(
+        m_height[0],
+        16,
+        [&](const SKuint32 y0, const SKuint32 y1)
+        {
+            for (SKuint32 y = y0; y < y1; ++y)
+            {
+                const SKubyte* src = getLevelBytes(0) + (SKsize)y * getLevelPitch(0);
+                float*         dst = prev + (SKsize)y * m_width[0] * 4;
+
+                for (SKuint32 x = 0; x < m_width[0]; ++x)
+                    codec->decode(dst + x * 4, src + (SKsize)x * m_bpp);
+            }
+        },
+        threads);
+
+    for (SKuint32 level = 1; level < m_levels; ++level)
+    {
+        const SKint32  pw = (SKint32)m_width[level - 1];
+        const SKint32  ph = (SKint32)m_height[level - 1];
+        const SKuint32 w  = m_width[level];
+        const SKuint32 h  = m_height[level];
+
+        float* tmp  = new float[(SKsize)w * ph * 4];
+        float* next = new float[(SKsize)w * h * 4];
+
+        // Horizontal pass, edges clamped.
+        skParallel::forRange(
+            (SKuint32)ph,
+            16,
+            [&](const SKuint32 y0, const SKuint32 y1)
+            {
+                for (SKuint32 y = y0; y < y1; ++y)
+                {
+                    const float* src = prev + (SKsize)y * pw * 4;
+                    float*       dst = tmp + (SKsize)y * w * 4;
+
+                    for (SKuint32 x = 0; x < w; ++x)
+                    {
+                        float acc[4] = {0, 0, 0, 0};
+                        for (SKint32 k = 0; k < KaiserTaps; ++k)
+                        {
+                            const SKint32 sx = skClamp<SKint32>(2 * (SKint32)x + k - KaiserTaps / 2 + 1, 0, pw - 1);
+                            for (SKuint32 c = 0; c < 4; ++c)
+                                acc[c] += src[sx * 4 + c] * weights[k];
+                        }
+                        for (SKuint32 c = 0; c < 4; ++c)
+                            dst[x * 4 + c] = acc[c];
+                    }
+                }
+            },
+            threads);
+
+        // Vertical pass, stored as it goes.
+        skParallel::forRange(
+            h,
+            16,
+            [&](const SKuint32 y0, const SKuint32 y1)
+            {
+                for (SKuint32 y = y0; y < y1; ++y)
+                {
+                    float*   dst = next + (SKsize)y * w * 4;
+                    SKubyte* out = getLevelBytes(level) + (SKsize)y * getLevelPitch(level);
+
+                    for (SKuint32 x = 0; x < w * 4; ++x)
+                        dst[x] = 0;
+
+                    for (SKint32 k = 0; k < KaiserTaps; ++k)
+                    {
+                        const SKint32 sy  = skClamp<SKint32>(2 * (SKint32)y + k - KaiserTaps / 2 + 1, 0, ph - 1);
+                        const float*  src = tmp + (SKsize)sy * w * 4;
+
+                        for (SKuint32 x = 0; x < w * 4; ++x)
+                            dst[x] += src[x] * weights[k];
+                    }
+
+                    for (SKuint32 x = 0; x < w; ++x, out += m_bpp)
+                    {
+                        // Negative lobes can ring below zero alpha.
+                        dst[x * 4 + 3] = skClamp(dst[x * 4 + 3], 0.f, 1.f);
+                        codec->encode(out, dst + x * 4);
+                    }
+                }
+            },
+            threads);
+
+        delete[] tmp;
+        delete[] prev;
+        prev = next;
+    }
+
+    delete[] prev;
+    delete codec;
+}
+
+skImage* skMipChain::getLevel(const SKuint32 level) const
+{
+    if (level >= m_levels)
+        return nullptr;
+
+    skImage* img = new skImage(m_width[level], m_height[level], m_format);
+    if (!img->getBytes())
+    {
+        delete img;
+        return nullptr;
+    }
+    img->setPremultiplied(m_premultiplied);
+
+    const SKuint32 pitch = getLevelPitch(level);
+    for (SKuint32 y = 0; y < m_height[level]; ++y)
+    {
+        const SKuint32 dy = img->isFlipY() ? m_height[level] - 1 - y : y;
+        skMemcpy(img->getBytes() + (SKsize)dy * img->getPitch(), getLevelBytes(level) + (SKsize)y * pitch, pitch);
+    }
+    return img;
+}
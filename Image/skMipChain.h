@@ -0,0 +1,138 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _skMipChain_h_
+#define _skMipChain_h_
+
+#include "Image/skImageTypes.h"
+#include "Utils/Config/skConfig.h"
+
+class skImage;
+
+// Holds every mip level of an image in one allocation. Levels are
+// stored top row first with tightly packed rows, and are addressed
+// through an offset table.
+class skMipChain
+{
+public:
+    static const SKuint32 MaxLevels = 32;
+
+private:
+    skMipFilter   m_filter;
+    bool          m_srgb;
+    bool          m_premultiply;
+    bool          m_premultiplied;
+    skPixelFormat m_format;
+    SKuint32      m_bpp;
+    SKuint32      m_levels;
+    SKuint32      m_width[MaxLevels];
+    SKuint32      m_height[MaxLevels];
+    SKsize        m_offsets[MaxLevels + 1];
+    SKubyte*      m_bytes;
+
+    void buildBox(SKuint32 threads);
+
+    void buildKaiser(SKuint32 threads);
+
+public:
+    skMipChain();
+    ~skMipChain();
+
+    skMipChain(const skMipChain& rhs) = delete;
+    skMipChain& operator=(const skMipChain& rhs) = delete;
+
+    void setFilter(skMipFilter filter)
+    {
+        m_filter = filter;
+    }
+
+    // Filters color in linear light, reading and writing sRGB values.
+    void setSrgb(bool srgb)
+    {
+        m_srgb = srgb;
+    }
+
+    // Weights color by alpha while filtering, so transparent pixels
+    // do not bleed into their neighbours. Sources that are already
+    // premultiplied are filtered as they are and give premultiplied
+    // levels.
+    void setPremultiplyAlpha(bool premultiply)
+    {
+        m_premultiply = premultiply;
+    }
+
+    skPixelFormat getFormat() const
+    {
+        return m_format;
+    }
+
+    SKuint32 getBPP() const
+    {
+        return m_bpp;
+    }
+
+    SKuint32 getLevelCount() const
+    {
+        return m_levels;
+    }
+
+    SKuint32 getLevelWidth(const SKuint32 level) const
+    {
+        return m_width[level];
+    }
+
+    SKuint32 getLevelHeight(const SKuint32 level) const
+    {
+        return m_height[level];
+    }
+
+    SKuint32 getLevelPitch(const SKuint32 level) const
+    {
+        return m_width[level] * m_bpp;
+    }
+
+    SKsize getLevelOffset(const SKuint32 level) const
+    {
+        return m_offsets[level];
+    }
+
+    SKubyte* getLevelBytes(const SKuint32 level) const
+    {
+        return m_bytes + m_offsets[level];
+    }
+
+    const SKubyte* getBytes() const
+    {
+        return m_bytes;
+    }
+
+    SKsize getSizeInBytes() const
+    {
+        return m_offsets[m_levels];
+    }
+
+    bool build(const skImage& image);
+
+    // Returns a copy of one level as an image.
+    skImage* getLevel(SKuint32 level) const;
+};
+
+#endif  //_skMipChain_h_
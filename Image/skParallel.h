@@ -0,0 +1,108 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _skParallel_h_
+#define _skParallel_h_
+
+#include <atomic>
+#include <thread>
+#include "Utils/Config/skConfig.h"
+
+class skParallel
+{
+public:
+    static SKuint32 getThreadCount()
+    {
+        const SKuint32 n = (SKuint32)std::thread::hardware_concurrency();
+        return n > 0 ? n : 1;
+    }
+
+    // Calls fn(begin, end) over [0, count) in chunks of grain items.
+    // Chunks are handed out dynamically to the worker threads; a
+    // thread count of zero uses every hardware thread.
+    template <typename Fn>
+    static void forRange(const SKuint32 count,
+                         SKuint32       grain,
+                         const Fn&      fn,
+                         SKuint32       threads = 0)
+    {
+        if (count == 0)
+            return;
+        if (grain == 0)
+            grain = 1;
+        if (threads == 0)
+            threads = getThreadCount();
+
+        const SKuint32 chunks = (count + grain - 1) / grain;
+        if (threads > chunks)
+            threads = chunks;
+
+        if (threads <= 1)
+        {
+            fn((SKuint32)0, count);
+            return;
+        }
+
+        std::atomic<SKuint32> next(0);
+
+        auto worker = [&]()
+        {
+            for (;;)
+            {
+                const SKuint32 chunk = next++;
+                if (chunk >= chunks)
+                    break;
+
+                const SKuint32 begin = chunk * grain;
+                const SKuint32 end   = count - begin > grain ? begin + grain : count;
+                fn(begin, end);
+            }
+        };
+
+        std::thread* pool = new std::thread[threads - 1];
+        for (SKuint32 i = 0; i < threads - 1; ++i)
+            pool[i] = std::thread(worker);
+
+        worker();
+
+        for (SKuint32 i = 0; i < threads - 1; ++i)
+            pool[i].join();
+        delete[] pool;
+    }
+
+    template <typename Fn>
+    static void forEach(const SKuint32 count,
+                        const Fn&      fn,
+                        const SKuint32 threads = 0)
+    {
+        forRange(
+            count,
+            1,
+            [&fn](const SKuint32 begin, const SKuint32 end)
+            {
+                for (SKuint32 i = begin; i < end; ++i)
+                    fn(i);
+            },
+            threads);
+    }
+};
+
+#endif  //_skParallel_h_
@@ -0,0 +1,517 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Image/skPlanarImage.h"
+#include <math.h>
+#include "Image/skImage.h"
+#include "Image/skImageUtils.h"
+#include "Image/skParallel.h"
+
+
+// Coefficients are 3.13 fixed point, small enough for the signed
+// 16-bit lanes of _mm_madd_epi16 with limited range scaling applied.
+const SKint32 YuvBits  = 13;
+const SKint32 YuvRound = 1 << (YuvBits - 1);
+
+struct skYuvDecode
+{
+    SKint16 yc, vr, ug, vg, ub;
+    SKint16 yo;
+};
+
+struct skYuvEncode
+{
+    SKint32 yr, yg, yb, yBias;
+    SKint32 ur, ug, ub;
+    SKint32 vr, vg, vb;
+};
+
+static void getKr(const skYuvMatrix matrix, float& kr, float& kb)
+{
+    if (matrix == SK_YUV_BT709)
+        kr = 0.2126f, kb = 0.0722f;
+    else
+        kr = 0.299f, kb = 0.114f;
+}
+
+static SKint32 toFixed(const float v)
+{
+    return (SKint32)floorf(v * (1 << YuvBits) + 0.5f);
+}
+
+static void getDecode(skYuvDecode& d, const skYuvMatrix matrix, const skYuvRange range)
+{
+    float kr, kb;
+    getKr(matrix, kr, kb);
+
+    const float kg = 1.f - kr - kb;
+    const float ys = range == SK_YUV_LIMITED ? 255.f / 219.f : 1.f;
+    const float cs = range == SK_YUV_LIMITED ? 255.f / 224.f : 1.f;
+
+    d.yc = (SKint16)toFixed(ys);
+    d.vr = (SKint16)toFixed(2.f * (1.f - kr) * cs);
+    d.ub = (SKint16)toFixed(2.f * (1.f - kb) * cs);
+    d.ug = (SKint16)-toFixed(2.f * kb * (1.f - kb) / kg * cs);
+    d.vg = (SKint16)-toFixed(2.f * kr * (1.f - kr) / kg * cs);
+    d.yo = range == SK_YUV_LIMITED ? 16 : 0;
+}
+
+static void getEncode(skYuvEncode& e, const skYuvMatrix matrix, const skYuvRange range)
+{
+    float kr, kb;
+    getKr(matrix, kr, kb);
+
+    const float kg = 1.f - kr - kb;
+    const float ys = range == SK_YUV_LIMITED ? 219.f / 255.f : 1.f;
+    const float cs = range == SK_YUV_LIMITED ? 224.f / 255.f : 1.f;
+
+    e.yr    = toFixed(kr * ys);
+    e.yg    = toFixed(kg * ys);
+    e.yb    = toFixed(kb * ys);
+    e.yBias = ((range == SK_YUV_LIMITED ? 16 : 0) << YuvBits) + YuvRound;
+
+    e.ur = toFixed(-kr / (2.f * (1.f - kb)) * cs);
+    e.ug = toFixed(-kg / (2.f * (1.f - kb)) * cs);
+    e.ub = toFixed(0.5f * cs);
+    e.vr = toFixed(0.5f * cs);
+    e.vg = toFixed(-kg / (2.f * (1.f - kr)) * cs);
+    e.vb = toFixed(-kb / (2.f * (1.f - kr)) * cs);
+}
+
+static SKubyte clampByte(const SKint32 v)
+{
+    return (SKubyte)skClamp<SKint32>(v, 0, 255);
+}
+
+static void decodeRow(SKubyte*           dst,
+                      const SKuint32     bpp,
+                      const SKint32*     offs,
+                      const SKubyte*     py,
+                      const SKubyte*     pu,
+                      const SKubyte*     pv,
+                      const SKuint32     uvStep,
+                      const SKuint32     w,
+                      const skYuvDecode& d)
+{
+    SKuint32 x = 0;
+
+#ifdef SK_IMAGE_SSE2
+    if (bpp == 4)
+    {
+        const __m128i zero  = _mm_setzero_si128();
+        const __m128i yo    = _mm_set1_epi16(d.yo);
+        const __m128i c128  = _mm_set1_epi16(128);
+        const __m128i one   = _mm_set1_epi16(1);
+        const __m128i cr[2] = {_mm_set1_epi32((SKuint16)d.yc), _mm_set1_epi32((SKuint16)d.vr | YuvRound << 16)};
+        const __m128i cg[2] = {_mm_set1_epi32((SKuint16)d.yc | (SKuint32)(SKuint16)d.ug << 16),
+                               _mm_set1_epi32((SKuint16)d.vg | YuvRound << 16)};
+        const __m128i cb[2] = {_mm_set1_epi32((SKuint16)d.yc | (SKuint32)(SKuint16)d.ub << 16),
+                               _mm_set1_epi32(YuvRound << 16)};
+        const __m128i sr    = _mm_cvtsi32_si128(8 * offs[0]);
+        const __m128i sg    = _mm_cvtsi32_si128(8 * offs[1]);
+        const __m128i sb    = _mm_cvtsi32_si128(8 * offs[2]);
+        const __m128i alpha = _mm_set1_epi32((SKint32)(255u << (8 * offs[3])));
+
+        for (; x + 8 <= w; x += 8)
+        {
+            const __m128i y = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(py + x)), zero), yo);
+
+            __m128i u, v;
+            if (uvStep == 2)
+            {
+                const __m128i uv = _mm_loadl_epi64((const __m128i*)(pu + x));
+
+                u = _mm_and_si128(uv, _mm_set1_epi16(0xFF));
+                v = _mm_srli_epi16(uv, 8);
+                u = _mm_unpacklo_epi16(u, u);
+                v = _mm_unpacklo_epi16(v, v);
+            }
+            else
+            {
+                SKint32 u4, v4;
+                skMemcpy(&u4, pu + x / 2, 4);
+                skMemcpy(&v4, pv + x / 2, 4);
+
+                u = _mm_cvtsi32_si128(u4);
+                v = _mm_cvtsi32_si128(v4);
+                u = _mm_unpacklo_epi8(_mm_unpacklo_epi8(u, u), zero);
+                v = _mm_unpacklo_epi8(_mm_unpacklo_epi8(v, v), zero);
+            }
+            u = _mm_sub_epi16(u, c128);
+            v = _mm_sub_epi16(v, c128);
+
+            const __m128i a[2] = {_mm_unpacklo_epi16(y, u), _mm_unpackhi_epi16(y, u)};
+            const __m128i b[2] = {_mm_unpacklo_epi16(v, one), _mm_unpackhi_epi16(v, one)};
+
+            __m128i r32[2], g32[2], b32[2];
+            for (SKuint32 k = 0; k < 2; ++k)
+            {
+                r32[k] = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(a[k], cr[0]), _mm_madd_epi16(b[k], cr[1])), YuvBits);
+                g32[k] = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(a[k], cg[0]), _mm_madd_epi16(b[k], cg[1])), YuvBits);
+                b32[k] = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(a[k], cb[0]), _mm_madd_epi16(b[k], cb[1])), YuvBits);
+            }
+
+            // Saturate to bytes, then widen again to place each channel.
+            const __m128i r8 = _mm_packus_epi16(_mm_packs_epi32(r32[0], r32[1]), zero);
+            const __m128i g8 = _mm_packus_epi16(_mm_packs_epi32(g32[0], g32[1]), zero);
+            const __m128i b8 = _mm_packus_epi16(_mm_packs_epi32(b32[0], b32[1]), zero);
+
+            const __m128i r16 = _mm_unpacklo_epi8(r8, zero);
+            const __m128i g16 = _mm_unpacklo_epi8(g8, zero);
+            const __m128i b16 = _mm_unpacklo_epi8(b8, zero);
+
+            for (SKuint32 k = 0; k < 2; ++k)
+            {
+                const __m128i r = k ? _mm_unpackhi_epi16(r16, zero) : _mm_unpacklo_epi16(r16, zero);
+                const __m128i g = k ? _mm_unpackhi_epi16(g16, zero) : _mm_unpacklo_epi16(g16, zero);
+                const __m128i c = k ? _mm_unpackhi_epi16(b16, zero) : _mm_unpacklo_epi16(b16, zero);
+
+                __m128i px = _mm_or_si128(_mm_sll_epi32(r, sr), _mm_sll_epi32(g, sg));
+                px         = _mm_or_si128(px, _mm_or_si128(_mm_sll_epi32(c, sb), alpha));
+                _mm_storeu_si128((__m128i*)(dst + (SKsize)(x + 4 * k) * 4), px);
+            }
+        }
+    }
+#endif
+
+    for (; x < w; ++x)
+    {
+        const SKint32 y = py[x] - d.yo;
+        const SKint32 u = pu[(x / 2) * uvStep] - 128;
+        const SKint32 v = pv[(x / 2) * uvStep] - 128;
+
+        SKubyte* p = dst + (SKsize)x * bpp;
+
+        p[offs[0]] = clampByte((d.yc * y + d.vr * v + YuvRound) >> YuvBits);
+        p[offs[1]] = clampByte((d.yc * y + d.ug * u + d.vg * v + YuvRound) >> YuvBits);
+        p[offs[2]] = clampByte((d.yc * y + d.ub * u + YuvRound) >> YuvBits);
+        if (offs[3] >= 0)
+            p[offs[3]] = 255;
+    }
+}
+
+static void encodeLumaRow(SKubyte*           dst,
+                          const SKubyte*     src,
+                          const SKuint32     bpp,
+                          const SKint32*     offs,
+                          const SKuint32     w,
+                          const skYuvEncode& e)
+{
+    SKuint32 x = 0;
+
+#ifdef SK_IMAGE_SSE2
+    if (bpp == 4)
+    {
+        const __m128i mask = _mm_set1_epi32(0xFF);
+        const __m128i crg  = _mm_set1_epi32(e.yr | e.yg << 16);
+        const __m128i cb   = _mm_set1_epi32(e.yb);
+        const __m128i bias = _mm_set1_epi32(e.yBias);
+        const __m128i sr   = _mm_cvtsi32_si128(8 * offs[0]);
+        const __m128i sg   = _mm_cvtsi32_si128(8 * offs[1]);
+        const __m128i sb   = _mm_cvtsi32_si128(8 * offs[2]);
+
+        for (; x + 4 <= w; x += 4)
+        {
+            const __m128i px = _mm_loadu_si128((const __m128i*)(src + (SKsize)x * 4));
+            const __m128i r  = _mm_and_si128(_mm_srl_epi32(px, sr), mask);
+            const __m128i g  = _mm_and_si128(_mm_srl_epi32(px, sg), mask);
+            const __m128i b  = _mm_and_si128(_mm_srl_epi32(px, sb), mask);
+
+            // r and g share a lane pair, b pairs with a zero.
+            __m128i y = _mm_madd_epi16(_mm_or_si128(r, _mm_slli_epi32(g, 16)), crg);
+            y         = _mm_add_epi32(y, _mm_madd_epi16(b, cb));
+            y         = _mm_srai_epi32(_mm_add_epi32(y, bias), YuvBits);
+
+            const __m128i y16 = _mm_packs_epi32(y, y);
+            const SKint32 y4  = _mm_cvtsi128_si32(_mm_packus_epi16(y16, y16));
+            skMemcpy(dst + x, &y4, 4);
+        }
+    }
+#endif
+
+    for (; x < w; ++x)
+    {
+        const SKubyte* p = src + (SKsize)x * bpp;
+
+        dst[x] = clampByte((e.yr * p[offs[0]] + e.yg * p[offs[1]] + e.yb * p[offs[2]] + e.yBias) >> YuvBits);
+    }
+}
+
+static void encodeChromaRow(SKubyte*           pu,
+                            SKubyte*           pv,
+                            const SKuint32     uvStep,
+                            const SKubyte*     r0,
+                            const SKubyte*     r1,
+                            const SKuint32     bpp,
+                            const SKint32*     offs,
+                            const SKuint32     w,
+                            const skYuvEncode& e)
+{
+    const SKuint32 cw   = (w + 1) / 2;
+    const SKint32  bias = (128 << (YuvBits + 2)) + (1 << (YuvBits + 1));
+
+    for (SKuint32 cx = 0; cx < cw; ++cx)
+    {
+        // Odd widths repeat the last column.
+        const SKubyte* p[4] = {
+            r0 + (SKsize)(2 * cx) * bpp,
+            r0 + (SKsize)skMin(2 * cx + 1, w - 1) * bpp,
+            r1 + (SKsize)(2 * cx) * bpp,
+            r1 + (SKsize)skMin(2 * cx + 1, w - 1) * bpp,
+        };
+
+        SKint32 rs = 0, gs = 0, bs = 0;
+        for (SKuint32 k = 0; k < 4; ++k)
+        {
+            rs += p[k][offs[0]];
+            gs += p[k][offs[1]];
+            bs += p[k][offs[2]];
+        }
+
+        pu[cx * uvStep] = clampByte((e.ur * rs + e.ug * gs + e.ub * bs + bias) >> (YuvBits + 2));
+        pv[cx * uvStep] = clampByte((e.vr * rs + e.vg * gs + e.vb * bs + bias) >> (YuvBits + 2));
+    }
+}
+
+static bool getImageOffsets(const skImage& image, SKint32 offs[SK_CHANNEL_MAX])
+{
+    return image.getBPP() >= 3 &&
+           ImageUtils::isByteFormat(image.getFormat()) &&
+           ImageUtils::getChannelOffsets(image.getFormat(), offs);
+}
+
+
+skPlanarImage::skPlanarImage() :
+    m_width(0),
+    m_height(0),
+    m_format(SK_PLANAR_I420),
+    m_bytes(nullptr)
+{
+    skMemset(m_planes, 0, sizeof m_planes);
+}
+
+skPlanarImage::skPlanarImage(const SKuint32       width,
+                             const SKuint32       height,
+                             const skPlanarFormat format) :
+    m_width(0),
+    m_height(0),
+    m_format(format),
+    m_bytes(nullptr)
+{
+    skMemset(m_planes, 0, sizeof m_planes);
+
+    if (width == 0 || height == 0)
+        return;
+
+    setup(width, height, format);
+
+    // Rows are padded to 32 bytes so every row starts aligned.
+    SKsize size = 0;
+    for (SKuint32 i = 0; i < getPlaneCount(); ++i)
+    {
+        Plane& plane = m_planes[i];
+        plane.pitch  = (plane.width * (format == SK_PLANAR_NV12 && i == 1 ? 2 : 1) + 31) & ~31u;
+        size += (SKsize)plane.pitch * plane.height;
+    }
+
+    m_bytes = new SKubyte[size];
+
+    SKubyte* bytes = m_bytes;
+    for (SKuint32 i = 0; i < getPlaneCount(); ++i)
+    {
+        m_planes[i].bytes = bytes;
+        bytes += (SKsize)m_planes[i].pitch * m_planes[i].height;
+    }
+}
+
+skPlanarImage::~skPlanarImage()
+{
+    delete[] m_bytes;
+}
+
+void skPlanarImage::setup(const SKuint32 width, const SKuint32 height, const skPlanarFormat format)
+{
+    m_width  = width;
+    m_height = height;
+    m_format = format;
+
+    m_planes[0].width  = width;
+    m_planes[0].height = height;
+
+    for (SKuint32 i = 1; i < getPlaneCount(); ++i)
+    {
+        m_planes[i].width  = (width + 1) / 2;
+        m_planes[i].height = (height + 1) / 2;
+    }
+}
+
+SKuint32 skPlanarImage::getPlaneCount(const skPlanarFormat& format)
+{
+    return format == SK_PLANAR_NV12 ? 2 : 3;
+}
+
+bool skPlanarImage::wrap(const SKuint32       width,
+                         const SKuint32       height,
+                         const skPlanarFormat format,
+                         SKubyte* const*      planes,
+                         const SKuint32*      pitches)
+{
+    if (width == 0 || height == 0 || !planes || !pitches)
+        return false;
+
+    delete[] m_bytes;
+    m_bytes = nullptr;
+
+    skMemset(m_planes, 0, sizeof m_planes);
+    setup(width, height, format);
+
+    for (SKuint32 i = 0; i < getPlaneCount(); ++i)
+    {
+        m_planes[i].bytes = planes[i];
+        m_planes[i].pitch = pitches[i];
+    }
+    return true;
+}
+
+bool skPlanarImage::toImage(const skImage&    dst,
+                            const skYuvMatrix matrix,
+                            const skYuvRange  range) const
+{
+    SKint32 offs[SK_CHANNEL_MAX];
+    if (!m_planes[0].bytes || !dst.getBytes() || !getImageOffsets(dst, offs))
+        return false;
+    if (dst.getWidth() != m_width || dst.getHeight() != m_height)
+        return false;
+
+    skYuvDecode d;
+    getDecode(d, matrix, range);
+
+    const Plane&   py     = m_planes[0];
+    const Plane&   pu     = m_planes[1];
+    const Plane&   pv     = m_format == SK_PLANAR_NV12 ? m_planes[1] : m_planes[2];
+    const SKuint32 uvStep = m_format == SK_PLANAR_NV12 ? 2 : 1;
+    const SKuint32 vOff   = m_format == SK_PLANAR_NV12 ? 1 : 0;
+
+    skParallel::forRange(
+        m_height,
+        32,
+        [&](const SKuint32 y0, const SKuint32 y1)
+        {
+            for (SKuint32 y = y0; y < y1; ++y)
+            {
+                const SKuint32 dy = dst.isFlipY() ? m_height - 1 - y : y;
+
+                decodeRow(dst.getBytes() + (SKsize)dy * dst.getPitch(),
+                          dst.getBPP(),
+                          offs,
+                          py.bytes + (SKsize)y * py.pitch,
+                          pu.bytes + (SKsize)(y / 2) * pu.pitch,
+                          pv.bytes + (SKsize)(y / 2) * pv.pitch + vOff,
+                          uvStep,
+                          m_width,
+                          d);
+            }
+        },
+        (SKsize)m_width * m_height >= SK_IMAGE_PARALLEL_MIN ? 0 : 1);
+    return true;
+}
+
+bool skPlanarImage::fromImage(const skImage&    src,
+                              const skYuvMatrix matrix,
+                              const skYuvRange  range)
+{
+    if (!m_planes[0].bytes || !src.getBytes())
+        return false;
+    if (src.getWidth() != m_width || src.getHeight() != m_height)
+        return false;
+
+    SKint32 offs[SK_CHANNEL_MAX];
+    if (!getImageOffsets(src, offs))
+    {
+        skImage* rgba = src.convertToFormat(SK_RGBA);
+        if (!rgba)
+            return false;
+
+        const bool result = fromImage(*rgba, matrix, range);
+        delete rgba;
+        return result;
+    }
+
+    skYuvEncode e;
+    getEncode(e, matrix, range);
+
+    const Plane&   py     = m_planes[0];
+    const Plane&   pu     = m_planes[1];
+    const Plane&   pv     = m_format == SK_PLANAR_NV12 ? m_planes[1] : m_planes[2];
+    const SKuint32 uvStep = m_format == SK_PLANAR_NV12 ? 2 : 1;
+    const SKuint32 vOff   = m_format == SK_PLANAR_NV12 ? 1 : 0;
+
+    const SKuint32 h = m_height;
+
+    // Each task takes whole row pairs, so it owns its chroma rows.
+    skParallel::forRange(
+        (h + 1) / 2,
+        16,
+        [&](const SKuint32 c0, const SKuint32 c1)
+        {
+            for (SKuint32 cy = c0; cy < c1; ++cy)
+            {
+                const SKubyte* rows[2];
+                for (SKuint32 k = 0; k < 2; ++k)
+                {
+                    const SKuint32 y  = skMin(2 * cy + k, h - 1);
+                    const SKuint32 sy = src.isFlipY() ? h - 1 - y : y;
+
+                    rows[k] = src.getBytes() + (SKsize)sy * src.getPitch();
+                    if (2 * cy + k < h)
+                        encodeLumaRow(py.bytes + (SKsize)y * py.pitch, rows[k], src.getBPP(), offs, m_width, e);
+                }
+
+                encodeChromaRow(pu.bytes + (SKsize)cy * pu.pitch,
+                                pv.bytes + (SKsize)cy * pv.pitch + vOff,
+                                uvStep,
+                                rows[0],
+                                rows[1],
+                                src.getBPP(),
+                                offs,
+                                m_width,
+                                e);
+            }
+        },
+        (SKsize)m_width * m_height >= SK_IMAGE_PARALLEL_MIN ? 0 : 1);
+    return true;
+}
+
+skImage* skPlanarImage::convertToImage(const skPixelFormat format,
+                                       const skYuvMatrix   matrix,
+                                       const skYuvRange    range) const
+{
+    if (!m_planes[0].bytes)
+        return nullptr;
+
+    skImage* img = new skImage(m_width, m_height, format);
+    if (!toImage(*img, matrix, range))
+    {
+        delete img;
+        return nullptr;
+    }
+    return img;
+}
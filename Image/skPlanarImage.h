@@ -0,0 +1,115 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _skPlanarImage_h_
+#define _skPlanarImage_h_
+
+#include "Image/skImageTypes.h"
+#include "Utils/Config/skConfig.h"
+
+class skImage;
+
+// A YUV 4:2:0 frame stored as separate planes, each with its own
+// pitch. I420 has Y, U and V planes; NV12 has Y and interleaved UV.
+// Chroma planes are half the luma size, rounded up.
+class skPlanarImage
+{
+public:
+    static const SKuint32 MaxPlanes = 3;
+
+    struct Plane
+    {
+        SKubyte* bytes;
+        SKuint32 width;
+        SKuint32 height;
+        SKuint32 pitch;
+    };
+
+private:
+    SKuint32       m_width;
+    SKuint32       m_height;
+    skPlanarFormat m_format;
+    Plane          m_planes[MaxPlanes];
+    SKubyte*       m_bytes;
+
+    void setup(SKuint32 width, SKuint32 height, skPlanarFormat format);
+
+public:
+    skPlanarImage();
+    skPlanarImage(SKuint32 width, SKuint32 height, skPlanarFormat format);
+    ~skPlanarImage();
+
+    skPlanarImage(const skPlanarImage& rhs) = delete;
+    skPlanarImage& operator=(const skPlanarImage& rhs) = delete;
+
+    SKuint32 getWidth() const
+    {
+        return m_width;
+    }
+
+    SKuint32 getHeight() const
+    {
+        return m_height;
+    }
+
+    skPlanarFormat getFormat() const
+    {
+        return m_format;
+    }
+
+    SKuint32 getPlaneCount() const
+    {
+        return getPlaneCount(m_format);
+    }
+
+    const Plane& getPlane(const SKuint32 index) const
+    {
+        return m_planes[index];
+    }
+
+    // Points the planes at memory owned by the caller, such as a
+    // decoded video frame, without copying it.
+    bool wrap(SKuint32        width,
+              SKuint32        height,
+              skPlanarFormat  format,
+              SKubyte* const* planes,
+              const SKuint32* pitches);
+
+    // Converts into an existing image of the same size, which must
+    // be an 8-bit RGB or RGBA layout.
+    bool toImage(const skImage& dst,
+                 skYuvMatrix    matrix = SK_YUV_BT601,
+                 skYuvRange     range  = SK_YUV_LIMITED) const;
+
+    // Converts from an image of the same size. Chroma is the average
+    // of each 2x2 block.
+    bool fromImage(const skImage& src,
+                   skYuvMatrix    matrix = SK_YUV_BT601,
+                   skYuvRange     range  = SK_YUV_LIMITED);
+
+    skImage* convertToImage(skPixelFormat format = SK_RGBA,
+                            skYuvMatrix   matrix = SK_YUV_BT601,
+                            skYuvRange    range  = SK_YUV_LIMITED) const;
+
+    static SKuint32 getPlaneCount(const skPlanarFormat& format);
+};
+
+#endif  //_skPlanarImage_h_
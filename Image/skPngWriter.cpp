@@ -0,0 +1,501 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include <stdio.h>
+#include "Image/skPngWriter.h"
+#include "Image/skImage.h"
+#include "Image/skImageUtils.h"
+#include "Image/skParallel.h"
+#include "Utils/skLogger.h"
+#include "ZLib/zlib.h"
+
+const SKuint32 WindowSize   = 0x8000;
+const SKubyte  Signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+
+struct skPngLayout
+{
+    SKubyte  colorType;
+    SKubyte  bitDepth;
+    SKuint32 channels;
+    SKuint32 pixelBytes;
+    SKuint32 rowBytes;
+    SKint32  offs[SK_CHANNEL_MAX];
+};
+
+struct skPngBand
+{
+    SKubyte* bytes;
+    SKsize   size;
+    SKsize   rawSize;
+    uLong    adler;
+    bool     ok;
+};
+
+static bool getLayout(const skImage& image, skPngLayout& layout)
+{
+    const skPixelFormat format = image.getFormat();
+
+    layout.bitDepth = 8;
+    switch (format)
+    {
+    case SK_LUMINANCE:
+    case SK_ALPHA:
+        layout.colorType = 0;
+        layout.channels  = 1;
+        break;
+    case SK_LUMINANCE_ALPHA:
+        layout.colorType = 4;
+        layout.channels  = 2;
+        break;
+    case SK_RGB:
+    case SK_BGR:
+        layout.colorType = 2;
+        layout.channels  = 3;
+        break;
+    case SK_RGBA:
+    case SK_BGRA:
+    case SK_ARGB:
+    case SK_ABGR:
+        layout.colorType = 6;
+        layout.channels  = 4;
+        break;
+    case SK_INDEXED8:
+        layout.colorType = 3;
+        layout.channels  = 1;
+        break;
+    case SK_LUMINANCE16:
+        layout.colorType = 0;
+        layout.channels  = 1;
+        layout.bitDepth  = 16;
+        break;
+    case SK_RGBA16:
+        layout.colorType = 6;
+        layout.channels  = 4;
+        layout.bitDepth  = 16;
+        break;
+    default:
+        return false;
+    }
+
+    if (!ImageUtils::getChannelOffsets(format, layout.offs))
+    {
+        for (SKuint32 c = 0; c < SK_CHANNEL_MAX; ++c)
+            layout.offs[c] = (SKint32)c;
+    }
+    else if (layout.channels == 2)
+        layout.offs[1] = layout.offs[3];
+
+    layout.pixelBytes = layout.channels * layout.bitDepth / 8;
+    layout.rowBytes   = image.getWidth() * layout.pixelBytes;
+    return true;
+}
+
+// Writes one row in PNG sample order, with 16-bit samples big endian.
+static void packRow(SKubyte* dst, const SKubyte* src, const skPngLayout& layout, const SKuint32 w, const SKuint32 bpp)
+{
+    if (layout.bitDepth == 16)
+    {
+        const SKuint32 n = w * layout.channels;
+        for (SKuint32 i = 0; i < n; ++i, dst += 2, src += 2)
+        {
+            SKuint16 v;
+            skMemcpy(&v, src, 2);
+            dst[0] = (SKubyte)(v >> 8);
+            dst[1] = (SKubyte)v;
+        }
+        return;
+    }
+
+    if (layout.channels == 1)
+    {
+        skMemcpy(dst, src, w);
+        return;
+    }
+
+    for (SKuint32 x = 0; x < w; ++x, src += bpp)
+    {
+        for (SKuint32 c = 0; c < layout.channels; ++c)
+            *dst++ = src[layout.offs[c]];
+    }
+}
+
+static SKubyte paeth(const SKint32 a, const SKint32 b, const SKint32 c)
+{
+    const SKint32 p  = a + b - c;
+    const SKint32 pa = skABS(p - a);
+    const SKint32 pb = skABS(p - b);
+    const SKint32 pc = skABS(p - c);
+    if (pa <= pb && pa <= pc)
+        return (SKubyte)a;
+    return (SKubyte)(pb <= pc ? b : c);
+}
+
+static void applyFilter(SKubyte*       dst,
+                        const SKubyte* cur,
+                        const SKubyte* prev,
+                        const SKuint32 n,
+                        const SKuint32 bpp,
+                        const SKuint32 filter)
+{
+    dst[0] = (SKubyte)filter;
+    ++dst;
+
+    SKuint32 i = 0;
+    switch (filter)
+    {
+    case SK_PNG_FILTER_SUB:
+        for (; i < bpp; ++i)
+            dst[i] = cur[i];
+        for (; i < n; ++i)
+            dst[i] = (SKubyte)(cur[i] - cur[i - bpp]);
+        break;
+    case SK_PNG_FILTER_UP:
+        for (; i < n; ++i)
+            dst[i] = (SKubyte)(cur[i] - prev[i]);
+        break;
+    case SK_PNG_FILTER_AVERAGE:
+        for (; i < bpp; ++i)
+            dst[i] = (SKubyte)(cur[i] - (prev[i] >> 1));
+        for (; i < n; ++i)
+            dst[i] = (SKubyte)(cur[i] - ((cur[i - bpp] + prev[i]) >> 1));
+        break;
+    case SK_PNG_FILTER_PAETH:
+        for (; i < bpp; ++i)
+            dst[i] = (SKubyte)(cur[i] - prev[i]);
+        for (; i < n; ++i)
+            dst[i] = (SKubyte)(cur[i] - paeth(cur[i - bpp], prev[i], prev[i - bpp]));
+        break;
+    default:
+        skMemcpy(dst, cur, n);
+        break;
+    }
+}
+
+// The adaptive choice is the usual heuristic: the filter whose output
+// has the smallest sum of absolute signed bytes.
+static void filterRow(SKubyte*          dst,
+                      SKubyte*          scratch,
+                      const SKubyte*    cur,
+                      const SKubyte*    prev,
+                      const SKuint32    n,
+                      const SKuint32    bpp,
+                      const skPngFilter filter)
+{
+    if (filter != SK_PNG_FILTER_ADAPTIVE)
+    {
+        applyFilter(dst, cur, prev, n, bpp, filter);
+        return;
+    }
+
+    SKuint64 best = 0;
+    for (SKuint32 f = SK_PNG_FILTER_NONE; f <= SK_PNG_FILTER_PAETH; ++f)
+    {
+        applyFilter(scratch, cur, prev, n, bpp, f);
+
+        SKuint64 sum = 0;
+        for (SKuint32 i = 1; i <= n; ++i)
+            sum += (SKuint64)skABS((SKint32)(signed char)scratch[i]);
+
+        if (f == SK_PNG_FILTER_NONE || sum < best)
+        {
+            best = sum;
+            skMemcpy(dst, scratch, (SKsize)n + 1);
+        }
+    }
+}
+
+static bool writeChunk(FILE*          fp,
+                       const char*    type,
+                       const SKubyte* head,
+                       const SKsize   headSize,
+                       const SKubyte* data,
+                       const SKsize   size,
+                       const SKubyte* tail,
+                       const SKsize   tailSize)
+{
+    const SKsize total = headSize + size + tailSize;
+
+    SKubyte len[4] = {
+        (SKubyte)(total >> 24),
+        (SKubyte)(total >> 16),
+        (SKubyte)(total >> 8),
+        (SKubyte)total,
+    };
+
+    uLong crc = crc32(0, (const Bytef*)type, 4);
+    if (headSize)
+        crc = crc32(crc, head, (uInt)headSize);
+    if (size)
+        crc = crc32(crc, data, (uInt)size);
+    if (tailSize)
+        crc = crc32(crc, tail, (uInt)tailSize);
+
+    const SKubyte end[4] = {
+        (SKubyte)(crc >> 24),
+        (SKubyte)(crc >> 16),
+        (SKubyte)(crc >> 8),
+        (SKubyte)crc,
+    };
+
+    return fwrite(len, 1, 4, fp) == 4 &&
+           fwrite(type, 1, 4, fp) == 4 &&
+           (headSize == 0 || fwrite(head, 1, headSize, fp) == headSize) &&
+           (size == 0 || fwrite(data, 1, size, fp) == size) &&
+           (tailSize == 0 || fwrite(tail, 1, tailSize, fp) == tailSize) &&
+           fwrite(end, 1, 4, fp) == 4;
+}
+
+static void writeBE32(SKubyte* p, const SKuint32 v)
+{
+    p[0] = (SKubyte)(v >> 24);
+    p[1] = (SKubyte)(v >> 16);
+    p[2] = (SKubyte)(v >> 8);
+    p[3] = (SKubyte)v;
+}
+
+static bool deflateBand(skPngBand&     band,
+                        const SKubyte* dict,
+                        const SKuint32 dictSize,
+                        const SKubyte* data,
+                        const SKsize   size,
+                        const SKint32  level,
+                        const SKint32  strategy,
+                        const bool     last)
+{
+    z_stream zs;
+    skMemset(&zs, 0, sizeof(z_stream));
+
+    if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, strategy) != Z_OK)
+        return false;
+
+    if (dictSize > 0)
+        deflateSetDictionary(&zs, dict, dictSize);
+
+    SKsize capacity = deflateBound(&zs, (uLong)size) + 64;
+    band.bytes      = new SKubyte[capacity];
+
+    zs.next_in   = (Bytef*)data;
+    zs.avail_in  = (uInt)size;
+    zs.next_out  = band.bytes;
+    zs.avail_out = (uInt)capacity;
+
+    // Bands other than the last end on a sync flush, which leaves
+    // the stream open and byte aligned.
+    for (;;)
+    {
+        const int result = deflate(&zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+        if (result == Z_STREAM_ERROR)
+        {
+            deflateEnd(&zs);
+            return false;
+        }
+
+        if (last ? result == Z_STREAM_END : zs.avail_in == 0 && zs.avail_out > 0)
+            break;
+
+        const SKsize used  = capacity - zs.avail_out;
+        SKubyte*     grown = new SKubyte[capacity * 2];
+        skMemcpy(grown, band.bytes, used);
+        delete[] band.bytes;
+
+        band.bytes   = grown;
+        zs.next_out  = band.bytes + used;
+        zs.avail_out = (uInt)(capacity * 2 - used);
+        capacity *= 2;
+    }
+
+    band.size    = zs.total_out;
+    band.rawSize = size;
+    band.adler   = adler32(adler32(0, nullptr, 0), data, (uInt)size);
+
+    deflateEnd(&zs);
+    return true;
+}
+
+skPngWriter::skPngWriter() :
+    m_filter(SK_PNG_FILTER_ADAPTIVE),
+    m_level(6),
+    m_threads(0)
+{
+}
+
+void skPngWriter::setLevel(const SKint32 level)
+{
+    m_level = skClamp<SKint32>(level, 0, 9);
+}
+
+bool skPngWriter::isSupported(const skPixelFormat format)
+{
+    return ImageUtils::isByteFormat(format) ||
+           format == SK_INDEXED8 ||
+           format == SK_LUMINANCE16 ||
+           format == SK_RGBA16;
+}
+
+bool skPngWriter::save(const skImage& image, const char* file) const
+{
+    skPngLayout layout;
+    if (!file || !image.getBytes() || !getLayout(image, layout))
+        return false;
+
+    const SKuint32 w      = image.getWidth();
+    const SKuint32 h      = image.getHeight();
+    const SKuint32 n      = layout.rowBytes;
+    const SKuint32 stride = n + 1;
+    const SKuint32 bpp    = skMax<SKuint32>(layout.pixelBytes, 1);
+
+    const SKuint32 bandRows = skMax<SKuint32>(BandSize / stride, 1);
+    const SKuint32 bands    = (h + bandRows - 1) / bandRows;
+    const SKuint32 primeMax = (WindowSize + stride - 1) / stride;
+
+    const SKint32  strategy = m_filter == SK_PNG_FILTER_NONE ? Z_DEFAULT_STRATEGY : Z_FILTERED;
+    const SKuint32 threads  = (SKsize)w * h >= SK_IMAGE_PARALLEL_MIN ? m_threads : 1;
+
+    skPngBand* out = new skPngBand[bands];
+    skMemset(out, 0, sizeof(skPngBand) * bands);
+
+    skParallel::forEach(
+        bands,
+        [&](const SKuint32 i)
+        {
+            const SKuint32 r0 = i * bandRows;
+            const SKuint32 r1 = skMin(h, r0 + bandRows);
+
+            // Rows before the band are filtered again to rebuild the
+            // window it continues from.
+            const SKuint32 prime = skMin(r0, primeMax);
+            const SKuint32 first = r0 - prime;
+            const SKuint32 rows  = r1 - first;
+
+            SKubyte* filtered = new SKubyte[(SKsize)rows * stride];
+            SKubyte* rowA     = new SKubyte[(SKsize)n * 2 + stride];
+            SKubyte* rowB     = rowA + n;
+            SKubyte* scratch  = rowB + n;
+
+            SKubyte* cur  = rowA;
+            SKubyte* prev = rowB;
+            if (first > 0)
+                packRow(prev, image.getBytes() + (SKsize)(image.isFlipY() ? h - first : first - 1) * image.getPitch(), layout, w, image.getBPP());
+            else
+                skMemset(prev, 0, n);
+
+            for (SKuint32 y = first; y < r1; ++y)
+            {
+                packRow(cur, image.getBytes() + (SKsize)(image.isFlipY() ? h - 1 - y : y) * image.getPitch(), layout, w, image.getBPP());
+                filterRow(filtered + (SKsize)(y - first) * stride, scratch, cur, prev, n, bpp, m_filter);
+                skSwap(cur, prev);
+            }
+
+            const SKsize   primed   = (SKsize)prime * stride;
+            const SKuint32 dictSize = (SKuint32)skMin<SKsize>(primed, WindowSize);
+
+            out[i].ok = deflateBand(out[i],
+                                    filtered + primed - dictSize,
+                                    dictSize,
+                                    filtered + primed,
+                                    (SKsize)(r1 - r0) * stride,
+                                    m_level,
+                                    strategy,
+                                    i + 1 == bands);
+
+            delete[] rowA;
+            delete[] filtered;
+        },
+        threads);
+
+    bool result = true;
+    for (SKuint32 i = 0; i < bands && result; ++i)
+        result = out[i].ok;
+
+    FILE* fp = result ? fopen(file, "wb") : nullptr;
+    if (fp)
+    {
+        SKubyte header[13];
+        writeBE32(header, w);
+        writeBE32(header + 4, h);
+        header[8]  = layout.bitDepth;
+        header[9]  = layout.colorType;
+        header[10] = 0;
+        header[11] = 0;
+        header[12] = 0;
+
+        result = fwrite(Signature, 1, 8, fp) == 8 &&
+                 writeChunk(fp, "IHDR", nullptr, 0, header, 13, nullptr, 0);
+
+        if (result && layout.colorType == 3)
+        {
+            SKubyte        palette[256 * 3];
+            const SKuint32 count = skMin<SKuint32>(image.getPaletteSize(), 256);
+
+            for (SKuint32 c = 0; c < count; ++c)
+            {
+                skPixel col;
+                image.getPaletteColor(c, col);
+                palette[c * 3 + 0] = col.r;
+                palette[c * 3 + 1] = col.g;
+                palette[c * 3 + 2] = col.b;
+            }
+
+            result = writeChunk(fp, "PLTE", nullptr, 0, palette, (SKsize)count * 3, nullptr, 0);
+        }
+
+        // zlib header for a 32K window, with the level hint in FLEVEL.
+        const SKubyte flevel = m_level < 2 ? 0 : m_level < 6 ? 1 : m_level == 6 ? 2 : 3;
+
+        SKubyte zhead[2] = {0x78, (SKubyte)(flevel << 6)};
+        zhead[1] |= (SKubyte)((31 - (zhead[0] * 256 + zhead[1]) % 31) % 31);
+
+        uLong adler = out[0].adler;
+        for (SKuint32 i = 1; i < bands; ++i)
+            adler = adler32_combine(adler, out[i].adler, (z_off_t)out[i].rawSize);
+
+        SKubyte ztail[4];
+        writeBE32(ztail, (SKuint32)adler);
+
+        for (SKuint32 i = 0; i < bands && result; ++i)
+        {
+            result = writeChunk(fp,
+                                "IDAT",
+                                zhead,
+                                i == 0 ? 2 : 0,
+                                out[i].bytes,
+                                out[i].size,
+                                ztail,
+                                i + 1 == bands ? 4 : 0);
+        }
+
+        result = result && writeChunk(fp, "IEND", nullptr, 0, nullptr, 0, nullptr, 0);
+        fclose(fp);
+
+        if (!result)
+            skLogf(LD_ERROR, "Failed to write %s.\n", file);
+    }
+    else if (result)
+    {
+        skLogf(LD_ERROR, "Failed to open %s for writing.\n", file);
+        result = false;
+    }
+
+    for (SKuint32 i = 0; i < bands; ++i)
+        delete[] out[i].bytes;
+    delete[] out;
+    return result;
+}
@@ -0,0 +1,72 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _skPngWriter_h_
+#define _skPngWriter_h_
+
+#include "Image/skImageTypes.h"
+#include "Utils/Config/skConfig.h"
+
+class skImage;
+
+// Writes PNG files by filtering and deflating bands of rows on
+// separate threads. Each band is primed with the 32K of filtered data
+// before it and ends on a byte boundary, so the bands join into one
+// zlib stream that any decoder reads.
+class skPngWriter
+{
+public:
+    // Uncompressed bytes per band.
+    static const SKuint32 BandSize = 0x40000;
+
+private:
+    skPngFilter m_filter;
+    SKint32     m_level;
+    SKuint32    m_threads;
+
+public:
+    skPngWriter();
+
+    skPngWriter(const skPngWriter& rhs) = delete;
+    skPngWriter& operator=(const skPngWriter& rhs) = delete;
+
+    void setFilter(skPngFilter filter)
+    {
+        m_filter = filter;
+    }
+
+    // zlib level, 0 to 9.
+    void setLevel(SKint32 level);
+
+    // Zero uses every hardware thread.
+    void setThreads(SKuint32 threads)
+    {
+        m_threads = threads;
+    }
+
+    // Formats other than the 8-bit ones, SK_LUMINANCE16, SK_RGBA16 and
+    // SK_INDEXED8 are not written, and false is returned.
+    bool save(const skImage& image, const char* file) const;
+
+    static bool isSupported(skPixelFormat format);
+};
+
+#endif  //_skPngWriter_h_
@@ -0,0 +1,362 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Image/skQuantizer.h"
+#include "Image/skImage.h"
+#include "Image/skImageUtils.h"
+#include "Image/skParallel.h"
+#include "Utils/skMinMax.h"
+
+
+skQuantizer::skQuantizer() :
+    m_maxColors(256),
+    m_dither(false),
+    m_count(nullptr),
+    m_sum(nullptr),
+    m_paletteSize(0),
+    m_cache(nullptr)
+{
+}
+
+skQuantizer::~skQuantizer()
+{
+    delete[] m_count;
+    delete[] m_sum;
+    delete[] m_cache;
+}
+
+void skQuantizer::setMaxColors(const SKuint32 maxColors)
+{
+    m_maxColors = skClamp<SKuint32>(maxColors, 2, 256);
+}
+
+void skQuantizer::buildHistogram(const skImage& img, const SKint32* offs)
+{
+    skMemset(m_count, 0, sizeof(SKuint32) * Bins);
+    skMemset(m_sum, 0, sizeof(SKuint64) * Bins * 3);
+
+    const SKuint32 bpp = img.getBPP();
+
+    for (SKuint32 y = 0; y < img.getHeight(); ++y)
+    {
+        const SKubyte* row = img.getBytes() + (SKsize)y * img.getPitch();
+
+        for (SKuint32 x = 0; x < img.getWidth(); ++x, row += bpp)
+        {
+            const SKuint32 r = row[offs[0]];
+            const SKuint32 g = row[offs[1]];
+            const SKuint32 b = row[offs[2]];
+            const SKuint32 i = bin(r, g, b);
+
+            m_count[i]++;
+            m_sum[i * 3 + 0] += r;
+            m_sum[i * 3 + 1] += g;
+            m_sum[i * 3 + 2] += b;
+        }
+    }
+}
+
+void skQuantizer::shrink(Box& box) const
+{
+    SKuint32 lo[3] = {Side, Side, Side};
+    SKuint32 hi[3] = {0, 0, 0};
+
+    box.count = 0;
+    for (SKuint32 r = box.lo[0]; r <= box.hi[0]; ++r)
+    {
+        for (SKuint32 g = box.lo[1]; g <= box.hi[1]; ++g)
+        {
+            for (SKuint32 b = box.lo[2]; b <= box.hi[2]; ++b)
+            {
+                const SKuint32 n = m_count[r << (2 * Bits) | g << Bits | b];
+                if (n == 0)
+                    continue;
+
+                box.count += n;
+                lo[0] = skMin(lo[0], r), hi[0] = skMax(hi[0], r);
+                lo[1] = skMin(lo[1], g), hi[1] = skMax(hi[1], g);
+                lo[2] = skMin(lo[2], b), hi[2] = skMax(hi[2], b);
+            }
+        }
+    }
+
+    if (box.count > 0)
+    {
+        for (SKuint32 a = 0; a < 3; ++a)
+        {
+            box.lo[a] = lo[a];
+            box.hi[a] = hi[a];
+        }
+    }
+}
+
+void skQuantizer::buildPalette()
+{
+    Box boxes[256];
+
+    boxes[0].lo[0] = boxes[0].lo[1] = boxes[0].lo[2] = 0;
+    boxes[0].hi[0] = boxes[0].hi[1] = boxes[0].hi[2] = Side - 1;
+    shrink(boxes[0]);
+
+    SKuint32 nBoxes = boxes[0].count > 0 ? 1 : 0;
+
+    while (nBoxes < m_maxColors)
+    {
+        // Split the box with the most weight along its longest side.
+        SKuint32 pick = nBoxes, axis = 0;
+        SKuint64 best = 0;
+
+        for (SKuint32 i = 0; i < nBoxes; ++i)
+        {
+            SKuint32 a = 0;
+            for (SKuint32 k = 1; k < 3; ++k)
+            {
+                if (boxes[i].hi[k] - boxes[i].lo[k] > boxes[i].hi[a] - boxes[i].lo[a])
+                    a = k;
+            }
+
+            const SKuint64 side = boxes[i].hi[a] - boxes[i].lo[a];
+            if (side > 0 && boxes[i].count * side > best)
+            {
+                best = boxes[i].count * side;
+                pick = i;
+                axis = a;
+            }
+        }
+
+        if (pick == nBoxes)
+            break;
+
+        Box& box = boxes[pick];
+
+        // Find the median plane along the axis.
+        SKuint64 planes[Side] = {};
+        for (SKuint32 r = box.lo[0]; r <= box.hi[0]; ++r)
+        {
+            for (SKuint32 g = box.lo[1]; g <= box.hi[1]; ++g)
+            {
+                for (SKuint32 b = box.lo[2]; b <= box.hi[2]; ++b)
+                {
+                    const SKuint32 p = axis == 0 ? r : axis == 1 ? g : b;
+                    planes[p] += m_count[r << (2 * Bits) | g << Bits | b];
+                }
+            }
+        }
+
+        SKuint64 acc = 0;
+        SKuint32 cut = box.lo[axis];
+        for (; cut < box.hi[axis] - 1; ++cut)
+        {
+            acc += planes[cut];
+            if (acc * 2 >= box.count)
+                break;
+        }
+
+        Box& next = boxes[nBoxes++];
+        next      = box;
+
+        box.hi[axis]  = cut;
+        next.lo[axis] = cut + 1;
+        shrink(box);
+        shrink(next);
+    }
+
+    m_paletteSize = nBoxes;
+
+    for (SKuint32 i = 0; i < nBoxes; ++i)
+    {
+        const Box& box = boxes[i];
+
+        SKuint64 sum[3] = {0, 0, 0};
+        for (SKuint32 r = box.lo[0]; r <= box.hi[0]; ++r)
+        {
+            for (SKuint32 g = box.lo[1]; g <= box.hi[1]; ++g)
+            {
+                for (SKuint32 b = box.lo[2]; b <= box.hi[2]; ++b)
+                {
+                    const SKuint32 j = r << (2 * Bits) | g << Bits | b;
+                    sum[0] += m_sum[j * 3 + 0];
+                    sum[1] += m_sum[j * 3 + 1];
+                    sum[2] += m_sum[j * 3 + 2];
+                }
+            }
+        }
+
+        const SKuint64 n = skMax<SKuint64>(box.count, 1);
+        m_palette[i]     = skPixel((SKubyte)((sum[0] + n / 2) / n),
+                               (SKubyte)((sum[1] + n / 2) / n),
+                               (SKubyte)((sum[2] + n / 2) / n),
+                               255);
+    }
+}
+
+void skQuantizer::buildCache()
+{
+    const SKuint32 half = 1 << (7 - Bits);
+
+    skParallel::forRange(
+        Bins,
+        1024,
+        [this, half](const SKuint32 i0, const SKuint32 i1)
+        {
+            for (SKuint32 i = i0; i < i1; ++i)
+            {
+                const SKint32 r = (SKint32)(((i >> (2 * Bits)) << (8 - Bits)) + half);
+                const SKint32 g = (SKint32)((((i >> Bits) & (Side - 1)) << (8 - Bits)) + half);
+                const SKint32 b = (SKint32)(((i & (Side - 1)) << (8 - Bits)) + half);
+
+                SKuint32 best = 0, bestDist = 0xFFFFFFFF;
+                for (SKuint32 p = 0; p < m_paletteSize; ++p)
+                {
+                    const SKint32 dr = r - m_palette[p].r;
+                    const SKint32 dg = g - m_palette[p].g;
+                    const SKint32 db = b - m_palette[p].b;
+
+                    const SKuint32 d = (SKuint32)(dr * dr + dg * dg + db * db);
+                    if (d < bestDist)
+                    {
+                        bestDist = d;
+                        best     = p;
+                    }
+                }
+                m_cache[i] = (SKubyte)best;
+            }
+        });
+}
+
+void skQuantizer::map(const skImage& src, const skImage& dst, const SKint32* offs) const
+{
+    const SKuint32 bpp = src.getBPP();
+
+    skParallel::forRange(
+        src.getHeight(),
+        64,
+        [&](const SKuint32 y0, const SKuint32 y1)
+        {
+            for (SKuint32 y = y0; y < y1; ++y)
+            {
+                const SKubyte* sp = src.getBytes() + (SKsize)y * src.getPitch();
+                SKubyte*       dp = dst.getBytes() + (SKsize)y * dst.getPitch();
+
+                for (SKuint32 x = 0; x < src.getWidth(); ++x, sp += bpp)
+                    dp[x] = lookup(sp[offs[0]], sp[offs[1]], sp[offs[2]]);
+            }
+        },
+        (SKsize)src.getWidth() * src.getHeight() >= SK_IMAGE_PARALLEL_MIN ? 0 : 1);
+}
+
+void skQuantizer::mapDithered(const skImage& src, const skImage& dst, const SKint32* offs) const
+{
+    const SKuint32 w   = src.getWidth();
+    const SKuint32 bpp = src.getBPP();
+
+    // Error rows carry one pixel of padding on each side, in 1/16ths.
+    SKint32* cur  = new SKint32[(SKsize)(w + 2) * 3];
+    SKint32* next = new SKint32[(SKsize)(w + 2) * 3];
+    skMemset(cur, 0, sizeof(SKint32) * (w + 2) * 3);
+    skMemset(next, 0, sizeof(SKint32) * (w + 2) * 3);
+
+    for (SKuint32 y = 0; y < src.getHeight(); ++y)
+    {
+        const SKubyte* sp = src.getBytes() + (SKsize)y * src.getPitch();
+        SKubyte*       dp = dst.getBytes() + (SKsize)y * dst.getPitch();
+
+        // Serpentine order keeps the error from drifting to one side.
+        const bool    rtl  = (y & 1) != 0;
+        const SKint32 step = rtl ? -1 : 1;
+
+        for (SKuint32 i = 0; i < w; ++i)
+        {
+            const SKuint32 x = rtl ? w - 1 - i : i;
+            const SKubyte* p = sp + (SKsize)x * bpp;
+            SKint32*       e = cur + (SKsize)(x + 1) * 3;
+
+            SKint32 v[3];
+            for (SKuint32 c = 0; c < 3; ++c)
+                v[c] = skClamp<SKint32>(p[offs[c]] + (e[c] + 8) / 16, 0, 255);
+
+            const SKubyte  idx = lookup(v[0], v[1], v[2]);
+            const skPixel& q   = m_palette[idx];
+            dp[x]              = idx;
+
+            const SKint32 err[3] = {v[0] - q.r, v[1] - q.g, v[2] - q.b};
+
+            SKint32* en = next + (SKsize)(x + 1) * 3;
+            for (SKint32 c = 0; c < 3; ++c)
+            {
+                e[step * 3 + c] += err[c] * 7;
+                en[-step * 3 + c] += err[c] * 3;
+                en[c] += err[c] * 5;
+                en[step * 3 + c] += err[c];
+            }
+        }
+
+        skSwap(cur, next);
+        skMemset(next, 0, sizeof(SKint32) * (w + 2) * 3);
+    }
+
+    delete[] cur;
+    delete[] next;
+}
+
+skImage* skQuantizer::quantize(const skImage& src)
+{
+    if (!src.getBytes() || src.getWidth() == 0 || src.getHeight() == 0)
+        return nullptr;
+
+    SKint32 offs[SK_CHANNEL_MAX];
+    if (!ImageUtils::getChannelOffsets(src.getFormat(), offs))
+    {
+        skImage* rgb = src.convertToFormat(SK_RGB);
+        skImage* img = rgb ? quantize(*rgb) : nullptr;
+        delete rgb;
+        return img;
+    }
+
+    if (!m_count)
+    {
+        m_count = new SKuint32[Bins];
+        m_sum   = new SKuint64[Bins * 3];
+        m_cache = new SKubyte[Bins];
+    }
+
+    buildHistogram(src, offs);
+    buildPalette();
+    buildCache();
+
+    skImage* img = new skImage(src.getWidth(), src.getHeight(), SK_INDEXED8);
+    if (!img->getBytes())
+    {
+        delete img;
+        return nullptr;
+    }
+
+    img->setFlipY(src.isFlipY());
+
+    for (SKuint32 i = 0; i < img->getPaletteSize(); ++i)
+        img->setPaletteColor(i, i < m_paletteSize ? m_palette[i] : skPixel(0, 0, 0, 255));
+
+    if (m_dither)
+        mapDithered(src, *img, offs);
+    else
+        map(src, *img, offs);
+    return img;
+}
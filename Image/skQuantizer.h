@@ -0,0 +1,107 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _skQuantizer_h_
+#define _skQuantizer_h_
+
+#include "Image/skPixel.h"
+
+class skImage;
+
+// Reduces an image to an SK_INDEXED8 palette image by median cut over
+// a 5-bit-per-channel histogram, optionally with Floyd-Steinberg
+// error diffusion. Alpha is not part of the palette.
+class skQuantizer
+{
+public:
+    static const SKuint32 Bits = 5;
+    static const SKuint32 Side = 1 << Bits;
+    static const SKuint32 Bins = Side * Side * Side;
+
+private:
+    struct Box
+    {
+        SKuint32 lo[3], hi[3];
+        SKuint64 count;
+    };
+
+    SKuint32  m_maxColors;
+    bool      m_dither;
+    SKuint32* m_count;
+    SKuint64* m_sum;
+    skPixel   m_palette[256];
+    SKuint32  m_paletteSize;
+    SKubyte*  m_cache;
+
+    static SKuint32 bin(SKuint32 r, SKuint32 g, SKuint32 b)
+    {
+        return (r >> (8 - Bits)) << (2 * Bits) |
+               (g >> (8 - Bits)) << Bits |
+               b >> (8 - Bits);
+    }
+
+    void buildHistogram(const skImage& img, const SKint32* offs);
+
+    void shrink(Box& box) const;
+
+    void buildPalette();
+
+    void buildCache();
+
+    void map(const skImage& src, const skImage& dst, const SKint32* offs) const;
+
+    void mapDithered(const skImage& src, const skImage& dst, const SKint32* offs) const;
+
+public:
+    skQuantizer();
+    ~skQuantizer();
+
+    skQuantizer(const skQuantizer& rhs) = delete;
+    skQuantizer& operator=(const skQuantizer& rhs) = delete;
+
+    void setMaxColors(SKuint32 maxColors);
+
+    void setDither(bool dither)
+    {
+        m_dither = dither;
+    }
+
+    SKuint32 getPaletteSize() const
+    {
+        return m_paletteSize;
+    }
+
+    const skPixel& getPaletteColor(const SKuint32 index) const
+    {
+        return m_palette[index];
+    }
+
+    // Index of the palette entry nearest to (r, g, b), looked up in the
+    // precomputed cache. Only valid after quantize.
+    SKubyte lookup(const SKuint32 r, const SKuint32 g, const SKuint32 b) const
+    {
+        return m_cache[bin(r, g, b)];
+    }
+
+    skImage* quantize(const skImage& src);
+};
+
+#endif  //_skQuantizer_h_
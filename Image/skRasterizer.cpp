@@ -0,0 +1,492 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Image/skRasterizer.h"
+#include <math.h>
+#include <stdlib.h>
+#include "Image/skImage.h"
+#include "Image/skImageUtils.h"
+#include "Utils/skMemoryUtils.h"
+#include "Utils/skMinMax.h"
+
+
+skRasterizer::skRasterizer(const skImage* image, const skAntiAlias aa) :
+    m_image(image),
+    m_samples((SKint32)aa),
+    m_clipX0(0),
+    m_clipY0(0),
+    m_clipX1(0),
+    m_clipY1(0),
+    m_cover(nullptr),
+    m_delta(nullptr),
+    m_coverX0(0),
+    m_dirtyMin(0),
+    m_dirtyMax(-1)
+{
+    if (m_image)
+    {
+        m_clipX1 = (SKint32)m_image->getWidth();
+        m_clipY1 = (SKint32)m_image->getHeight();
+    }
+
+    skMemset(m_packed, 0, sizeof m_packed);
+    setAntiAlias(aa);
+}
+
+skRasterizer::~skRasterizer()
+{
+    delete[] m_cover;
+    delete[] m_delta;
+}
+
+void skRasterizer::setClip(const SKint32 x0,
+                           const SKint32 y0,
+                           const SKint32 x1,
+                           const SKint32 y1)
+{
+    if (!m_image)
+        return;
+
+    m_clipX0 = skClamp<SKint32>(x0, 0, (SKint32)m_image->getWidth());
+    m_clipY0 = skClamp<SKint32>(y0, 0, (SKint32)m_image->getHeight());
+    m_clipX1 = skClamp<SKint32>(x1, m_clipX0, (SKint32)m_image->getWidth());
+    m_clipY1 = skClamp<SKint32>(y1, m_clipY0, (SKint32)m_image->getHeight());
+
+    // Coverage rows only span the clip, so they are resized with it.
+    if (m_cover)
+    {
+        delete[] m_cover;
+        delete[] m_delta;
+        m_cover = nullptr;
+        m_delta = nullptr;
+    }
+
+    if (m_samples > 1)
+        allocateCoverage();
+}
+
+void skRasterizer::setAntiAlias(const skAntiAlias aa)
+{
+    m_samples = (SKint32)aa;
+    if (m_samples != SK_AA_4X && m_samples != SK_AA_8X)
+        m_samples = SK_AA_NONE;
+
+    if (m_samples > 1 && !m_cover)
+        allocateCoverage();
+}
+
+void skRasterizer::allocateCoverage()
+{
+    if (!m_image || m_clipX1 <= m_clipX0)
+        return;
+
+    const SKsize n = (SKsize)(m_clipX1 - m_clipX0) + 1;
+
+    m_coverX0 = m_clipX0;
+
+    m_cover = new SKint32[n];
+    m_delta = new SKint32[n];
+    skMemset(m_cover, 0, sizeof(SKint32) * n);
+    skMemset(m_delta, 0, sizeof(SKint32) * n);
+}
+
+bool skRasterizer::canDraw() const
+{
+    return m_image && m_image->m_bytes &&
+           m_clipX1 > m_clipX0 && m_clipY1 > m_clipY0 &&
+           (m_samples == 1 || m_cover);
+}
+
+void skRasterizer::setColor(const skPixel& col)
+{
+    m_color = col;
+    m_image->packPixel(m_packed, col);
+}
+
+void skRasterizer::span(const SKint32 y, float xa, float xb)
+{
+    xa = skMax<float>(xa, (float)m_clipX0);
+    xb = skMin<float>(xb, (float)m_clipX1);
+    if (xa >= xb)
+        return;
+
+    const SKint32 s  = m_samples;
+    const SKint32 sa = (SKint32)ceilf(xa * (float)s - 0.5f);
+    const SKint32 sb = (SKint32)ceilf(xb * (float)s - 0.5f);
+    if (sa >= sb)
+        return;
+
+    if (s == 1)
+    {
+        SKubyte* dst = m_image->m_bytes + m_image->getBufferPos(sa, y);
+        ImageUtils::fillSpan(dst, sb - sa, m_packed, m_image->m_bpp);
+        return;
+    }
+
+    // Partial end pixels are counted directly, the fully covered
+    // interior is recorded as a difference and resolved in endRow.
+    const SKint32 pa = sa / s;
+    const SKint32 pb = (sb - 1) / s;
+    const SKint32 ca = pa - m_coverX0;
+    const SKint32 cb = pb - m_coverX0;
+
+    if (pa == pb)
+        m_cover[ca] += sb - sa;
+    else
+    {
+        m_cover[ca] += s - (sa - pa * s);
+        m_cover[cb] += sb - pb * s;
+
+        if (pb > pa + 1)
+        {
+            m_delta[ca + 1] += s;
+            m_delta[cb] -= s;
+        }
+    }
+
+    m_dirtyMin = skMin(m_dirtyMin, pa);
+    m_dirtyMax = skMax(m_dirtyMax, pb);
+}
+
+void skRasterizer::endRow(const SKint32 y)
+{
+    if (m_samples == 1 || m_dirtyMax < m_dirtyMin)
+    {
+        m_dirtyMin = m_clipX1;
+        m_dirtyMax = -1;
+        return;
+    }
+
+    const SKint32  full = m_samples * m_samples;
+    const SKuint32 bpp  = m_image->m_bpp;
+    const SKsize   base = m_image->getBufferPos(0, y);
+
+    SKubyte* row = m_image->m_bytes + base;
+
+    SKint32 run   = 0;
+    SKint32 start = -1;
+
+    for (SKint32 x = m_dirtyMin; x <= m_dirtyMax; ++x)
+    {
+        const SKint32 i = x - m_coverX0;
+
+        run += m_delta[i];
+        const SKint32 c = m_cover[i] + run;
+
+        m_cover[i] = 0;
+        m_delta[i] = 0;
+
+        if (c >= full)
+        {
+            if (start < 0)
+                start = x;
+            continue;
+        }
+
+        if (start >= 0)
+        {
+            ImageUtils::fillSpan(row + (SKsize)start * bpp, x - start, m_packed, bpp);
+            start = -1;
+        }
+
+        if (c > 0)
+        {
+            ImageUtils::blendPixel(*m_image,
+                                   row + (SKsize)x * bpp,
+                                   m_color,
+                                   (SKuint32)(c * 255 / full));
+        }
+    }
+
+    if (start >= 0)
+        ImageUtils::fillSpan(row + (SKsize)start * bpp, m_dirtyMax + 1 - start, m_packed, bpp);
+
+    m_dirtyMin = m_clipX1;
+    m_dirtyMax = -1;
+}
+
+void skRasterizer::plot(const SKint32 x, const SKint32 y)
+{
+    if (x >= m_clipX0 && x < m_clipX1 && y >= m_clipY0 && y < m_clipY1)
+        skMemcpy(m_image->m_bytes + m_image->getBufferPos(x, y), m_packed, m_image->m_bpp);
+}
+
+void skRasterizer::fillRect(const SKint32  x,
+                            const SKint32  y,
+                            const SKint32  width,
+                            const SKint32  height,
+                            const skPixel& col)
+{
+    if (!canDraw() || width <= 0 || height <= 0)
+        return;
+
+    const SKint32 x0 = skMax(x, m_clipX0);
+    const SKint32 y0 = skMax(y, m_clipY0);
+    const SKint32 x1 = (SKint32)skMin<SKint64>((SKint64)x + width, m_clipX1);
+    const SKint32 y1 = (SKint32)skMin<SKint64>((SKint64)y + height, m_clipY1);
+    if (x0 >= x1 || y0 >= y1)
+        return;
+
+    setColor(col);
+
+    for (SKint32 iy = y0; iy < y1; ++iy)
+    {
+        SKubyte* dst = m_image->m_bytes + m_image->getBufferPos(x0, iy);
+        ImageUtils::fillSpan(dst, x1 - x0, m_packed, m_image->m_bpp);
+    }
+}
+
+void skRasterizer::line(SKint32        x1,
+                        SKint32        y1,
+                        SKint32        x2,
+                        SKint32        y2,
+                        const skPixel& col)
+{
+    if (!canDraw())
+        return;
+
+    setColor(col);
+
+    if (y2 == y1)
+    {
+        if (x2 < x1)
+            skSwap(x2, x1);
+
+        if (y1 >= m_clipY0 && y1 < m_clipY1)
+        {
+            x1 = skMax(x1, m_clipX0);
+            x2 = skMin(x2, m_clipX1 - 1);
+            if (x1 <= x2)
+            {
+                SKubyte* dst = m_image->m_bytes + m_image->getBufferPos(x1, y1);
+                ImageUtils::fillSpan(dst, x2 - x1 + 1, m_packed, m_image->m_bpp);
+            }
+        }
+        return;
+    }
+
+    if (x2 == x1)
+    {
+        if (y2 < y1)
+            skSwap(y2, y1);
+
+        y1 = skMax(y1, m_clipY0);
+        y2 = skMin(y2, m_clipY1 - 1);
+        for (SKint32 iy = y1; iy <= y2; ++iy)
+            plot(x1, iy);
+        return;
+    }
+
+    const bool steep = skABS(y2 - y1) > skABS(x2 - x1);
+    if (steep)
+    {
+        skSwap(x1, y1);
+        skSwap(x2, y2);
+    }
+
+    if (x1 > x2)
+    {
+        skSwap(x1, x2);
+        skSwap(y1, y2);
+    }
+
+    const SKint32 de = skABS(y2 - y1);
+    const SKint32 sy = y1 > y2 ? -1 : 1;
+    const SKint32 dx = x2 - x1;
+
+    // Steps that fall before the clip rectangle on the major axis are
+    // skipped by solving for the error term at the first visible step,
+    // which keeps the plotted pixels identical to the unclipped walk.
+    const SKint32 lo = steep ? m_clipY0 : m_clipX0;
+    const SKint32 hi = steep ? m_clipY1 - 1 : m_clipX1 - 1;
+
+    const SKint32 k0 = skMax(lo - x1, 0);
+    const SKint32 xe = skMin(x2, hi);
+
+    const SKint64 t = -(SKint64)(dx >> 1) + (SKint64)k0 * de;
+    const SKint64 m = t > 0 ? (t + dx - 1) / dx : 0;
+
+    SKint64 e  = t - m * dx;
+    SKint32 iy = y1 + (SKint32)(m * sy);
+
+    for (SKint32 ix = x1 + k0; ix <= xe; ++ix)
+    {
+        if (steep)
+            plot(iy, ix);
+        else
+            plot(ix, iy);
+
+        e += de;
+        if (e > 0)
+        {
+            iy += sy;
+            e -= dx;
+        }
+    }
+}
+
+int skRasterizer::sortEdges(const void* a, const void* b)
+{
+    const float ya = ((const Edge*)a)->y0;
+    const float yb = ((const Edge*)b)->y0;
+    return ya < yb ? -1 : ya > yb ? 1 : 0;
+}
+
+void skRasterizer::fillPolygon(const skPointf*  points,
+                               const SKuint32   count,
+                               const skPixel&   col,
+                               const skFillRule rule)
+{
+    if (!points || count < 3 || !canDraw())
+        return;
+
+    setColor(col);
+
+    Edge*     edges   = new Edge[count];
+    SKuint32* active  = new SKuint32[count];
+    Crossing* crosses = new Crossing[count];
+
+    SKuint32 nEdges = 0;
+    float    yMin = points[0].y, yMax = points[0].y;
+
+    for (SKuint32 i = 0; i < count; ++i)
+    {
+        skPointf a = points[i];
+        skPointf b = points[(i + 1) % count];
+
+        yMin = skMin(yMin, a.y);
+        yMax = skMax(yMax, a.y);
+
+        if (a.y == b.y)
+            continue;
+
+        SKint32 dir = 1;
+        if (a.y > b.y)
+        {
+            skSwap(a, b);
+            dir = -1;
+        }
+
+        Edge& e = edges[nEdges++];
+        e.y0    = a.y;
+        e.y1    = b.y;
+        e.x0    = a.x;
+        e.dxdy  = (b.x - a.x) / (b.y - a.y);
+        e.dir   = dir;
+    }
+
+    qsort(edges, nEdges, sizeof(Edge), sortEdges);
+
+    const SKint32 r0 = skMax<SKint32>((SKint32)floorf(yMin), m_clipY0);
+    const SKint32 r1 = skMin<SKint32>((SKint32)ceilf(yMax), m_clipY1);
+    const float   rs = 1.f / (float)m_samples;
+
+    SKuint32 nActive = 0, next = 0;
+
+    m_dirtyMin = m_clipX1;
+    m_dirtyMax = -1;
+
+    for (SKint32 y = r0; y < r1; ++y)
+    {
+        for (SKint32 s = 0; s < m_samples; ++s)
+        {
+            const float ys = (float)y + ((float)s + 0.5f) * rs;
+
+            while (next < nEdges && edges[next].y0 <= ys)
+                active[nActive++] = next++;
+
+            SKuint32 nCross = 0, k = 0;
+            for (SKuint32 i = 0; i < nActive; ++i)
+            {
+                const Edge& e = edges[active[i]];
+                if (e.y1 <= ys)
+                    continue;
+                active[k++] = active[i];
+
+                Crossing c = {e.x0 + (ys - e.y0) * e.dxdy, e.dir};
+
+                SKuint32 j = nCross++;
+                while (j > 0 && crosses[j - 1].x > c.x)
+                {
+                    crosses[j] = crosses[j - 1];
+                    --j;
+                }
+                crosses[j] = c;
+            }
+            nActive = k;
+
+            if (rule == SK_FILL_NON_ZERO)
+            {
+                SKint32 winding = 0;
+                for (SKuint32 i = 0; i + 1 < nCross; ++i)
+                {
+                    winding += crosses[i].dir;
+                    if (winding != 0)
+                        span(y, crosses[i].x, crosses[i + 1].x);
+                }
+            }
+            else
+            {
+                for (SKuint32 i = 0; i + 1 < nCross; i += 2)
+                    span(y, crosses[i].x, crosses[i + 1].x);
+            }
+        }
+        endRow(y);
+    }
+
+    delete[] edges;
+    delete[] active;
+    delete[] crosses;
+}
+
+void skRasterizer::fillEllipse(const float    cx,
+                               const float    cy,
+                               const float    rx,
+                               const float    ry,
+                               const skPixel& col)
+{
+    if (rx <= 0 || ry <= 0 || !canDraw())
+        return;
+
+    setColor(col);
+
+    const SKint32 r0 = skMax<SKint32>((SKint32)floorf(cy - ry), m_clipY0);
+    const SKint32 r1 = skMin<SKint32>((SKint32)ceilf(cy + ry), m_clipY1);
+    const float   rs = 1.f / (float)m_samples;
+
+    m_dirtyMin = m_clipX1;
+    m_dirtyMax = -1;
+
+    for (SKint32 y = r0; y < r1; ++y)
+    {
+        for (SKint32 s = 0; s < m_samples; ++s)
+        {
+            const float dy = ((float)y + ((float)s + 0.5f) * rs - cy) / ry;
+            const float t  = 1.f - dy * dy;
+            if (t <= 0)
+                continue;
+
+            const float hw = rx * sqrtf(t);
+            span(y, cx - hw, cx + hw);
+        }
+        endRow(y);
+    }
+}
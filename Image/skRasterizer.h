@@ -0,0 +1,105 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _skRasterizer_h_
+#define _skRasterizer_h_
+
+#include "Image/skPixel.h"
+
+class skImage;
+
+class skRasterizer
+{
+private:
+    struct Edge
+    {
+        float   y0, y1;
+        float   x0, dxdy;
+        SKint32 dir;
+    };
+
+    struct Crossing
+    {
+        float   x;
+        SKint32 dir;
+    };
+
+    const skImage* m_image;
+    SKint32        m_samples;
+    SKint32        m_clipX0, m_clipY0;
+    SKint32        m_clipX1, m_clipY1;
+    SKint32*       m_cover;
+    SKint32*       m_delta;
+    SKint32        m_coverX0;
+    SKint32        m_dirtyMin, m_dirtyMax;
+    SKubyte        m_packed[16];
+    skPixel        m_color;
+
+    bool canDraw() const;
+
+    void allocateCoverage();
+
+    void plot(SKint32 x, SKint32 y);
+
+    void setColor(const skPixel& col);
+
+    void span(SKint32 y, float xa, float xb);
+
+    void endRow(SKint32 y);
+
+    static int sortEdges(const void* a, const void* b);
+
+public:
+    skRasterizer(const skImage* image, skAntiAlias aa = SK_AA_NONE);
+    ~skRasterizer();
+
+    skRasterizer(const skRasterizer& rhs) = delete;
+    skRasterizer& operator=(const skRasterizer& rhs) = delete;
+
+    void setClip(SKint32 x0, SKint32 y0, SKint32 x1, SKint32 y1);
+
+    void setAntiAlias(skAntiAlias aa);
+
+    void fillRect(SKint32        x,
+                  SKint32        y,
+                  SKint32        width,
+                  SKint32        height,
+                  const skPixel& col);
+
+    void line(SKint32        x1,
+              SKint32        y1,
+              SKint32        x2,
+              SKint32        y2,
+              const skPixel& col);
+
+    void fillPolygon(const skPointf* points,
+                     SKuint32        count,
+                     const skPixel&  col,
+                     skFillRule      rule);
+
+    void fillEllipse(float          cx,
+                     float          cy,
+                     float          rx,
+                     float          ry,
+                     const skPixel& col);
+};
+
+#endif  //_skRasterizer_h_
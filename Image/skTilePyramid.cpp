@@ -0,0 +1,463 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Image/skTilePyramid.h"
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include "Image/skImage.h"
+#include "Image/skImageUtils.h"
+#include "Image/skParallel.h"
+#include "Image/skTiledImage.h"
+#include "Utils/skLogger.h"
+#include "Utils/skMinMax.h"
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// Room left in file names for the level, tile and extension.
+const SKuint32 MaxPath = 1024;
+const SKuint32 MaxBase = MaxPath - 64;
+
+struct skTilePyramid::Level
+{
+    SKuint32 width;
+    SKuint32 height;
+    SKuint32 number;    // DZI level or XYZ zoom
+    SKuint32 cols;      // tiles across
+    SKuint32 rows;      // tiles down
+    SKuint32 pitch;
+    SKubyte* buffer;    // image rows [first, first + count)
+    SKuint32 first;
+    SKuint32 count;
+    SKuint32 received;
+    SKuint32 next;      // next tile row to write
+    SKubyte* pending;   // unpaired row waiting to be downsampled
+    bool     paired;
+    SKubyte* half;
+};
+
+static bool makeDirectory(const char* path)
+{
+#ifdef _WIN32
+    if (_mkdir(path) == 0 || errno == EEXIST)
+#else
+    if (mkdir(path, 0755) == 0 || errno == EEXIST)
+#endif
+        return true;
+
+    skLogf(LD_ERROR, "Failed to create the directory %s.\n", path);
+    return false;
+}
+
+static bool isJpeg(const char* ext)
+{
+    return strcmp(ext, "jpg") == 0 || strcmp(ext, "jpeg") == 0;
+}
+
+// JPEG has no alpha, and every format keeps luminance as one channel.
+static skPixelFormat getTileFormat(const skPixelFormat source, const bool jpeg)
+{
+    const bool gray = source == SK_ALPHA ||
+                      source == SK_LUMINANCE ||
+                      source == SK_LUMINANCE16 ||
+                      source == SK_LUMINANCE_HALF ||
+                      source == SK_LUMINANCE_FLOAT;
+    if (gray)
+        return SK_LUMINANCE;
+    if (jpeg)
+        return SK_RGB;
+    return ImageUtils::isByteFormat(source) ? source : SK_RGBA;
+}
+
+// Averages two rows into one of half the width, repeating the last
+// column of odd widths.
+static void downsampleRow(SKubyte*       dst,
+                          const SKubyte* a,
+                          const SKubyte* b,
+                          const SKuint32 w,
+                          const SKuint32 bpp)
+{
+    const SKuint32 dw = (w + 1) / 2;
+    for (SKuint32 x = 0; x < dw; ++x, dst += bpp)
+    {
+        const SKsize x0 = (SKsize)(2 * x) * bpp;
+        const SKsize x1 = 2 * x + 1 < w ? x0 + bpp : x0;
+
+        for (SKuint32 i = 0; i < bpp; ++i)
+            dst[i] = (SKubyte)((a[x0 + i] + a[x1 + i] + b[x0 + i] + b[x1 + i] + 2) >> 2);
+    }
+}
+
+static SKubyte* getRow(const skImage& img, const SKuint32 y)
+{
+    return img.getBytes() + (SKsize)(img.isFlipY() ? img.getHeight() - 1 - y : y) * img.getPitch();
+}
+
+skTilePyramid::skTilePyramid() :
+    m_layout(SK_PYRAMID_DZI),
+    m_tileSize(254),
+    m_overlap(1),
+    m_border(0),
+    m_threads(0),
+    m_background(0, 0, 0, 0),
+    m_format(SK_RGBA),
+    m_bpp(4),
+    m_levels(0),
+    m_level(nullptr),
+    m_path(nullptr)
+{
+    strcpy(m_extension, "png");
+}
+
+skTilePyramid::~skTilePyramid()
+{
+    end();
+}
+
+void skTilePyramid::setTileSize(const SKuint32 size)
+{
+    m_tileSize = skClamp<SKuint32>(size, 1, 0x4000);
+}
+
+void skTilePyramid::setOverlap(const SKuint32 overlap)
+{
+    m_overlap = skMin<SKuint32>(overlap, 0x100);
+}
+
+void skTilePyramid::setExtension(const char* ext)
+{
+    if (!ext)
+        return;
+    if (*ext == '.')
+        ++ext;
+
+    SKuint32 i = 0;
+    for (; ext[i] && i < sizeof m_extension - 1; ++i)
+        m_extension[i] = (char)tolower((unsigned char)ext[i]);
+    m_extension[i] = 0;
+}
+
+bool skTilePyramid::begin(const SKuint32      width,
+                          const SKuint32      height,
+                          const skPixelFormat source,
+                          const char*         path)
+{
+    if (width == 0 || height == 0 || !path || strlen(path) > MaxBase || !*m_extension)
+        return false;
+
+    const bool     dzi = m_layout == SK_PYRAMID_DZI;
+    const SKuint32 ts  = m_tileSize;
+    const SKuint32 ov  = dzi ? skMin(m_overlap, ts) : 0;
+
+    m_border = ov;
+    m_path   = path;
+    m_format = getTileFormat(source, isJpeg(m_extension));
+    m_bpp    = skImage::getSize(m_format);
+
+    // DZI goes down to a single pixel, XYZ to a single tile.
+    const SKuint32 stop = dzi ? 1 : ts;
+
+    m_levels = 1;
+    for (SKuint32 w = width, h = height; skMax(w, h) > stop; ++m_levels)
+    {
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+    }
+
+    m_level = new Level[m_levels];
+    memset(m_level, 0, sizeof(Level) * m_levels);
+
+    char file[MaxPath];
+    if (dzi)
+    {
+        snprintf(file, MaxPath, "%s_files", path);
+        if (!makeDirectory(file))
+            return false;
+    }
+    else if (!makeDirectory(path))
+        return false;
+
+    for (SKuint32 i = 0; i < m_levels; ++i)
+    {
+        Level& lv = m_level[i];
+
+        lv.width  = i ? (m_level[i - 1].width + 1) / 2 : width;
+        lv.height = i ? (m_level[i - 1].height + 1) / 2 : height;
+        lv.number = m_levels - 1 - i;
+        lv.cols   = (lv.width + ts - 1) / ts;
+        lv.rows   = (lv.height + ts - 1) / ts;
+        lv.pitch  = lv.width * m_bpp;
+        lv.buffer = new SKubyte[(SKsize)lv.pitch * (ts + 2 * ov)];
+
+        if (i + 1 < m_levels)
+        {
+            lv.pending = new SKubyte[lv.pitch];
+            lv.half    = new SKubyte[(SKsize)(lv.width + 1) / 2 * m_bpp];
+        }
+
+        if (dzi)
+        {
+            snprintf(file, MaxPath, "%s_files/%u", path, lv.number);
+            if (!makeDirectory(file))
+                return false;
+            continue;
+        }
+
+        // Column directories are made up front so tiles never race on them.
+        snprintf(file, MaxPath, "%s/%u", path, lv.number);
+        if (!makeDirectory(file))
+            return false;
+
+        for (SKuint32 x = 0; x < lv.cols; ++x)
+        {
+            snprintf(file, MaxPath, "%s/%u/%u", path, lv.number, x);
+            if (!makeDirectory(file))
+                return false;
+        }
+    }
+
+    if (dzi)
+    {
+        snprintf(file, MaxPath, "%s.dzi", path);
+
+        FILE* fp = fopen(file, "wb");
+        if (!fp)
+        {
+            skLogf(LD_ERROR, "Failed to open %s for writing.\n", file);
+            return false;
+        }
+
+        fprintf(fp,
+                "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" "
+                "Format=\"%s\" Overlap=\"%u\" TileSize=\"%u\">\n"
+                "  <Size Width=\"%u\" Height=\"%u\"/>\n"
+                "</Image>\n",
+                m_extension,
+                ov,
+                ts,
+                width,
+                height);
+        fclose(fp);
+    }
+    return true;
+}
+
+void skTilePyramid::end()
+{
+    if (m_level)
+    {
+        for (SKuint32 i = 0; i < m_levels; ++i)
+        {
+            delete[] m_level[i].buffer;
+            delete[] m_level[i].pending;
+            delete[] m_level[i].half;
+        }
+        delete[] m_level;
+    }
+
+    m_level  = nullptr;
+    m_levels = 0;
+    m_path   = nullptr;
+}
+
+void skTilePyramid::writeTileRow(const Level& lv, const SKuint32 row) const
+{
+    const bool     dzi = m_layout == SK_PYRAMID_DZI;
+    const SKuint32 ts  = m_tileSize;
+    const SKuint32 ov  = m_border;
+
+    const SKuint32 y0 = row * ts - (row ? ov : 0);
+    const SKuint32 y1 = skMin(row * ts + ts + ov, lv.height);
+
+    skParallel::forEach(
+        lv.cols,
+        [&](const SKuint32 col)
+        {
+            const SKuint32 x0 = col * ts - (col ? ov : 0);
+            const SKuint32 x1 = skMin(col * ts + ts + ov, lv.width);
+
+            skImage tile(dzi ? x1 - x0 : ts, dzi ? y1 - y0 : ts, m_format);
+            if (!tile.getBytes())
+                return;
+            if (!dzi)
+            {
+                SKubyte packed[16];
+                tile.packPixel(packed, m_background);
+
+                for (SKuint32 y = 0; y < ts; ++y)
+                    ImageUtils::fillSpan(getRow(tile, y), ts, packed, m_bpp);
+            }
+
+            for (SKuint32 y = y0; y < y1; ++y)
+            {
+                skMemcpy(getRow(tile, y - y0),
+                         lv.buffer + (SKsize)(y - lv.first) * lv.pitch + (SKsize)x0 * m_bpp,
+                         (SKsize)(x1 - x0) * m_bpp);
+            }
+
+            char file[MaxPath];
+            if (dzi)
+                snprintf(file, MaxPath, "%s_files/%u/%u_%u.%s", m_path, lv.number, col, row, m_extension);
+            else
+                snprintf(file, MaxPath, "%s/%u/%u/%u.%s", m_path, lv.number, col, row, m_extension);
+            tile.save(file);
+        },
+        m_threads);
+}
+
+void skTilePyramid::pushRow(const SKuint32 level, const SKubyte* row)
+{
+    Level& lv = m_level[level];
+
+    const SKuint32 ts = m_tileSize;
+    const SKuint32 ov = m_border;
+
+    skMemcpy(lv.buffer + (SKsize)lv.count * lv.pitch, row, lv.pitch);
+    ++lv.count;
+    ++lv.received;
+
+    if (level + 1 < m_levels)
+    {
+        if (lv.paired)
+        {
+            downsampleRow(lv.half, lv.pending, row, lv.width, m_bpp);
+            lv.paired = false;
+            pushRow(level + 1, lv.half);
+        }
+        else
+        {
+            skMemcpy(lv.pending, row, lv.pitch);
+            lv.paired = true;
+        }
+    }
+
+    // A tile row is written once its last row, overlap included, is
+    // in. Only the rows the next tile row shares are kept. The last two
+    // tile rows can complete together when the overlap reaches past a
+    // short final row.
+    while (lv.next < lv.rows && lv.received == skMin(lv.next * ts + ts + ov, lv.height))
+    {
+        writeTileRow(lv, lv.next);
+        ++lv.next;
+
+        const SKuint32 keep = skMin(lv.next * ts - ov, lv.received);
+        const SKuint32 drop = keep - lv.first;
+
+        memmove(lv.buffer, lv.buffer + (SKsize)drop * lv.pitch, (SKsize)(lv.count - drop) * lv.pitch);
+        lv.first = keep;
+        lv.count -= drop;
+    }
+}
+
+// Odd rows left at the bottom of each level are paired with themselves.
+void skTilePyramid::flush()
+{
+    for (SKuint32 i = 0; i + 1 < m_levels; ++i)
+    {
+        Level& lv = m_level[i];
+        if (!lv.paired)
+            continue;
+
+        downsampleRow(lv.half, lv.pending, lv.pending, lv.width, m_bpp);
+        lv.paired = false;
+        pushRow(i + 1, lv.half);
+    }
+}
+
+bool skTilePyramid::write(const skImage& image, const char* path)
+{
+    end();
+
+    const skImage* src  = &image;
+    skImage*       temp = nullptr;
+
+    // Palette lookups need the image, so indexed sources convert whole.
+    if (image.getFormat() == SK_INDEXED8)
+        src = temp = image.convertToFormat(SK_RGBA);
+
+    if (!src || !src->getBytes() || !begin(src->getWidth(), src->getHeight(), src->getFormat(), path))
+    {
+        end();
+        delete temp;
+        return false;
+    }
+
+    const SKuint32 w    = src->getWidth();
+    SKubyte*       conv = src->getFormat() != m_format ? new SKubyte[(SKsize)w * m_bpp] : nullptr;
+
+    for (SKuint32 y = 0; y < src->getHeight(); ++y)
+    {
+        const SKubyte* row = getRow(*src, y);
+        if (conv)
+        {
+            skImage::copy(conv, row, w, 1, m_format, src->getFormat());
+            row = conv;
+        }
+        pushRow(0, row);
+    }
+
+    flush();
+
+    delete[] conv;
+    delete temp;
+    end();
+    return true;
+}
+
+bool skTilePyramid::write(skTiledImage& image, const char* path)
+{
+    end();
+
+    if (!begin(image.getWidth(), image.getHeight(), image.getFormat(), path))
+    {
+        end();
+        return false;
+    }
+
+    const SKuint32 w    = image.getWidth();
+    const SKuint32 h    = image.getHeight();
+    const SKuint32 band = skTiledImage::TileSize;
+
+    skImage rows(w, band, m_format);
+    if (!rows.getBytes())
+    {
+        end();
+        return false;
+    }
+
+    for (SKuint32 y = 0; y < h; y += band)
+    {
+        image.read(rows, 0, y);
+
+        const SKuint32 n = skMin(band, h - y);
+        for (SKuint32 i = 0; i < n; ++i)
+            pushRow(0, getRow(rows, i));
+    }
+
+    flush();
+    end();
+    return true;
+}
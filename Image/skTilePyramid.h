@@ -0,0 +1,111 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _skTilePyramid_h_
+#define _skTilePyramid_h_
+
+#include "Image/skPixel.h"
+#include "Utils/Config/skConfig.h"
+
+class skImage;
+class skTiledImage;
+
+// Writes an image as a zoomable pyramid of fixed-size tiles. Levels
+// are made by successive 2x box downsampling as the source is read
+// top to bottom, and each level keeps only the rows of its current
+// tile row, so memory grows with the width and not the height.
+//
+// SK_PYRAMID_DZI writes <path>.dzi and <path>_files/<level>/<x>_<y>.<ext>,
+// with levels from 1x1 up to the full image and tiles sharing the
+// overlap with their neighbours. SK_PYRAMID_XYZ writes
+// <path>/<z>/<x>/<y>.<ext>, from the level that fits one tile up to
+// the full image, with edge tiles padded by the background color.
+class skTilePyramid
+{
+public:
+    static const SKuint32 MaxLevels = 33;
+
+private:
+    struct Level;
+
+    skPyramidLayout m_layout;
+    SKuint32        m_tileSize;
+    SKuint32        m_overlap;
+    SKuint32        m_border;
+    SKuint32        m_threads;
+    skPixel         m_background;
+    char            m_extension[8];
+    skPixelFormat   m_format;
+    SKuint32        m_bpp;
+    SKuint32        m_levels;
+    Level*          m_level;
+    const char*     m_path;
+
+    bool begin(SKuint32 width, SKuint32 height, skPixelFormat source, const char* path);
+
+    void pushRow(SKuint32 level, const SKubyte* row);
+
+    void writeTileRow(const Level& lv, SKuint32 row) const;
+
+    void flush();
+
+    void end();
+
+public:
+    skTilePyramid();
+    ~skTilePyramid();
+
+    skTilePyramid(const skTilePyramid& rhs) = delete;
+    skTilePyramid& operator=(const skTilePyramid& rhs) = delete;
+
+    void setLayout(skPyramidLayout layout)
+    {
+        m_layout = layout;
+    }
+
+    void setTileSize(SKuint32 size);
+
+    // Pixels shared with each neighbouring tile. Only used by DZI.
+    void setOverlap(SKuint32 overlap);
+
+    // The tile file extension, such as "png" or "jpg". JPEG tiles are
+    // written without alpha.
+    void setExtension(const char* ext);
+
+    void setBackground(const skPixel& col)
+    {
+        m_background = col;
+    }
+
+    // Tiles of a row are encoded in parallel. A thread count of zero
+    // uses every hardware thread.
+    void setThreads(SKuint32 threads)
+    {
+        m_threads = threads;
+    }
+
+    bool write(const skImage& image, const char* path);
+
+    // Reads the canvas a band of tiles at a time.
+    bool write(skTiledImage& image, const char* path);
+};
+
+#endif  //_skTilePyramid_h_
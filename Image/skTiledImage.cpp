@@ -0,0 +1,554 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#include "Image/skTiledImage.h"
+#include "Image/skImage.h"
+#include "Image/skImageUtils.h"
+#include "Utils/skLogger.h"
+#include "Utils/skMemoryUtils.h"
+#include "Utils/skMinMax.h"
+
+const SKuint64 NoSlot = ~(SKuint64)0;
+const SKuint32 NoLink = 0xFFFFFFFF;
+
+static bool seekScratch(FILE* fp, const SKuint64 offset)
+{
+#ifdef _WIN32
+    return _fseeki64(fp, (__int64)offset, SEEK_SET) == 0;
+#else
+    return fseeko(fp, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+static SKubyte* getRow(const skImage& img, const SKuint32 x, const SKuint32 y)
+{
+    const SKuint32 row = img.isFlipY() ? img.getHeight() - 1 - y : y;
+    return img.getBytes() + (SKsize)row * img.getPitch() + (SKsize)x * img.getBPP();
+}
+
+skTiledImage::skTiledImage(const SKuint32      width,
+                           const SKuint32      height,
+                           const skPixelFormat format) :
+    m_width(width),
+    m_height(height),
+    m_format(format == SK_INDEXED8 ? SK_RGBA : format),
+    m_bpp(0),
+    m_tilesX((SKuint32)(((SKuint64)width + TileSize - 1) >> TileShift)),
+    m_tilesY((SKuint32)(((SKuint64)height + TileSize - 1) >> TileShift)),
+    m_tiles(nullptr),
+    m_head(NoLink),
+    m_tail(NoLink),
+    m_budget(256 * 1024 * 1024),
+    m_resident(0),
+    m_slots(0),
+    m_scratch(nullptr)
+{
+    m_bpp = skImage::getSize(m_format);
+
+    const SKsize count = (SKsize)m_tilesX * m_tilesY;
+    if (count == 0 || m_bpp == 0)
+    {
+        m_tilesX = m_tilesY = 0;
+        return;
+    }
+
+    m_tiles = new Tile[count];
+    for (SKsize i = 0; i < count; ++i)
+    {
+        Tile& tile = m_tiles[i];
+
+        tile.image    = nullptr;
+        tile.slot     = NoSlot;
+        tile.prev     = NoLink;
+        tile.next     = NoLink;
+        tile.locks    = 0;
+        tile.constant = true;
+        tile.dirty    = false;
+        skMemset(tile.color, 0, MaxBPP);
+    }
+}
+
+skTiledImage::~skTiledImage()
+{
+    const SKsize count = (SKsize)m_tilesX * m_tilesY;
+    for (SKsize i = 0; i < count; ++i)
+        delete m_tiles[i].image;
+    delete[] m_tiles;
+
+    if (m_scratch)
+        fclose(m_scratch);
+}
+
+SKuint32 skTiledImage::getTileWidth(const SKuint32 tx) const
+{
+    return skMin((SKuint32)TileSize, m_width - (tx << TileShift));
+}
+
+SKuint32 skTiledImage::getTileHeight(const SKuint32 ty) const
+{
+    return skMin((SKuint32)TileSize, m_height - (ty << TileShift));
+}
+
+SKsize skTiledImage::getTileBytes(const Tile& tile) const
+{
+    return (SKsize)tile.image->getPitch() * tile.image->getHeight();
+}
+
+void skTiledImage::link(const SKuint32 index)
+{
+    Tile& tile = m_tiles[index];
+    tile.prev  = NoLink;
+    tile.next  = m_head;
+
+    if (m_head != NoLink)
+        m_tiles[m_head].prev = index;
+    else
+        m_tail = index;
+    m_head = index;
+}
+
+void skTiledImage::unlink(const SKuint32 index)
+{
+    Tile& tile = m_tiles[index];
+
+    if (tile.prev != NoLink)
+        m_tiles[tile.prev].next = tile.next;
+    else
+        m_head = tile.next;
+
+    if (tile.next != NoLink)
+        m_tiles[tile.next].prev = tile.prev;
+    else
+        m_tail = tile.prev;
+
+    tile.prev = tile.next = NoLink;
+}
+
+void skTiledImage::touch(const SKuint32 index)
+{
+    if (m_head != index)
+    {
+        unlink(index);
+        link(index);
+    }
+}
+
+void skTiledImage::setBudget(const SKsize budget)
+{
+    m_budget = budget;
+    makeRoom(0);
+}
+
+void skTiledImage::makeRoom(const SKsize bytes)
+{
+    SKuint32 index = m_tail;
+    while (index != NoLink && m_resident + bytes > m_budget)
+    {
+        const SKuint32 prev = m_tiles[index].prev;
+        if (m_tiles[index].locks == 0 && !pageOut(index))
+            break;
+        index = prev;
+    }
+}
+
+bool skTiledImage::pageOut(const SKuint32 index)
+{
+    Tile&        tile  = m_tiles[index];
+    const SKsize bytes = getTileBytes(tile);
+
+    // Tiles read back and left untouched still match their slot.
+    if (tile.dirty || tile.slot == NoSlot)
+    {
+        if (!m_scratch)
+        {
+            m_scratch = tmpfile();
+            if (!m_scratch)
+            {
+                skLogf(LD_ERROR, "Failed to create the tile scratch file.\n");
+                return false;
+            }
+        }
+
+        if (tile.slot == NoSlot)
+            tile.slot = m_slots++;
+
+        const SKuint64 offset = tile.slot * ((SKuint64)TileSize * TileSize * m_bpp);
+        if (!seekScratch(m_scratch, offset) ||
+            fwrite(tile.image->getBytes(), 1, bytes, m_scratch) != bytes)
+        {
+            skLogf(LD_ERROR, "Failed to write a tile to the scratch file.\n");
+            return false;
+        }
+    }
+
+    unlink(index);
+    delete tile.image;
+
+    tile.image = nullptr;
+    tile.dirty = false;
+    m_resident -= bytes;
+    return true;
+}
+
+bool skTiledImage::makeResident(const SKuint32 index)
+{
+    Tile& tile = m_tiles[index];
+    if (tile.image)
+    {
+        touch(index);
+        return true;
+    }
+
+    const SKuint32 tx = index % m_tilesX;
+    const SKuint32 ty = index / m_tilesX;
+    const SKuint32 tw = getTileWidth(tx);
+    const SKuint32 th = getTileHeight(ty);
+
+    makeRoom((SKsize)tw * th * m_bpp);
+
+    skImage* img = new skImage(tw, th, m_format);
+    if (!img->getBytes())
+    {
+        delete img;
+        return false;
+    }
+
+    const SKsize bytes = (SKsize)img->getPitch() * th;
+    if (tile.constant)
+    {
+        for (SKuint32 y = 0; y < th; ++y)
+            ImageUtils::fillSpan(img->getBytes() + (SKsize)y * img->getPitch(), tw, tile.color, m_bpp);
+        tile.dirty = true;
+    }
+    else
+    {
+        const SKuint64 offset = tile.slot * ((SKuint64)TileSize * TileSize * m_bpp);
+        if (!seekScratch(m_scratch, offset) ||
+            fread(img->getBytes(), 1, bytes, m_scratch) != bytes)
+        {
+            skLogf(LD_ERROR, "Failed to read a tile from the scratch file.\n");
+            delete img;
+            return false;
+        }
+        tile.dirty = false;
+    }
+
+    tile.image    = img;
+    tile.constant = false;
+    m_resident += bytes;
+    link(index);
+    return true;
+}
+
+void skTiledImage::setConstant(const SKuint32 index, const SKubyte* color)
+{
+    Tile& tile = m_tiles[index];
+
+    if (tile.image && tile.locks > 0)
+    {
+        // The caller still holds the pixels, so fill them instead.
+        const skImage& img = *tile.image;
+        for (SKuint32 y = 0; y < img.getHeight(); ++y)
+            ImageUtils::fillSpan(img.getBytes() + (SKsize)y * img.getPitch(), img.getWidth(), color, m_bpp);
+        tile.dirty = true;
+        return;
+    }
+
+    if (tile.image)
+    {
+        unlink(index);
+        m_resident -= getTileBytes(tile);
+        delete tile.image;
+        tile.image = nullptr;
+    }
+
+    skMemcpy(tile.color, color, m_bpp);
+    tile.constant = true;
+    tile.dirty    = false;
+}
+
+void skTiledImage::packColor(SKubyte* dst, const skPixel& col) const
+{
+    skMemset(dst, 0, MaxBPP);
+    skImage::setPixel(dst, col, m_format);
+}
+
+bool skTiledImage::isConstantTile(const SKuint32 tx, const SKuint32 ty) const
+{
+    if (tx >= m_tilesX || ty >= m_tilesY)
+        return false;
+    return m_tiles[(SKsize)ty * m_tilesX + tx].constant;
+}
+
+skImage* skTiledImage::lockTile(const SKuint32 tx, const SKuint32 ty)
+{
+    if (tx >= m_tilesX || ty >= m_tilesY)
+        return nullptr;
+
+    const SKuint32 index = ty * m_tilesX + tx;
+    if (!makeResident(index))
+        return nullptr;
+
+    Tile& tile = m_tiles[index];
+    tile.locks++;
+    tile.dirty = true;
+    return tile.image;
+}
+
+void skTiledImage::unlockTile(const SKuint32 tx, const SKuint32 ty)
+{
+    if (tx >= m_tilesX || ty >= m_tilesY)
+        return;
+
+    Tile& tile = m_tiles[ty * m_tilesX + tx];
+    if (tile.locks > 0 && --tile.locks == 0)
+        makeRoom(0);
+}
+
+void skTiledImage::clear(const skPixel& col)
+{
+    SKubyte packed[MaxBPP];
+    packColor(packed, col);
+
+    const SKuint32 count = m_tilesX * m_tilesY;
+    for (SKuint32 i = 0; i < count; ++i)
+        setConstant(i, packed);
+}
+
+void skTiledImage::setPixel(const SKuint32 x, const SKuint32 y, const skPixel& col)
+{
+    if (x >= m_width || y >= m_height)
+        return;
+
+    const SKuint32 index = (y >> TileShift) * m_tilesX + (x >> TileShift);
+    Tile&          tile  = m_tiles[index];
+
+    if (tile.constant)
+    {
+        SKubyte packed[MaxBPP];
+        packColor(packed, col);
+        if (memcmp(packed, tile.color, m_bpp) == 0)
+            return;
+    }
+
+    if (!makeResident(index))
+        return;
+
+    tile.image->setPixel(x & (TileSize - 1), y & (TileSize - 1), col);
+    tile.dirty = true;
+}
+
+void skTiledImage::getPixel(const SKuint32 x, const SKuint32 y, skPixel& col)
+{
+    if (x >= m_width || y >= m_height)
+        return;
+
+    const SKuint32 index = (y >> TileShift) * m_tilesX + (x >> TileShift);
+    const Tile&    tile  = m_tiles[index];
+
+    if (tile.constant)
+        skImage::getPixel(col, tile.color, m_format);
+    else if (makeResident(index))
+        tile.image->getPixel(x & (TileSize - 1), y & (TileSize - 1), col);
+}
+
+void skTiledImage::fillRect(const SKuint32 x,
+                            const SKuint32 y,
+                            SKuint32       width,
+                            SKuint32       height,
+                            const skPixel& col)
+{
+    if (x >= m_width || y >= m_height)
+        return;
+
+    width  = skMin(width, m_width - x);
+    height = skMin(height, m_height - y);
+    if (width == 0 || height == 0)
+        return;
+
+    SKubyte packed[MaxBPP];
+    packColor(packed, col);
+
+    const SKuint32 x1 = x + width;
+    const SKuint32 y1 = y + height;
+
+    for (SKuint32 ty = y >> TileShift; ty <= (y1 - 1) >> TileShift; ++ty)
+    {
+        const SKuint32 oy  = ty << TileShift;
+        const SKuint32 th  = getTileHeight(ty);
+        const SKuint32 sy0 = skMax(y, oy) - oy;
+        const SKuint32 sy1 = skMin(y1, oy + th) - oy;
+
+        for (SKuint32 tx = x >> TileShift; tx <= (x1 - 1) >> TileShift; ++tx)
+        {
+            const SKuint32 ox    = tx << TileShift;
+            const SKuint32 tw    = getTileWidth(tx);
+            const SKuint32 sx0   = skMax(x, ox) - ox;
+            const SKuint32 sx1   = skMin(x1, ox + tw) - ox;
+            const SKuint32 index = ty * m_tilesX + tx;
+            Tile&          tile  = m_tiles[index];
+
+            if (sx0 == 0 && sy0 == 0 && sx1 == tw && sy1 == th)
+                setConstant(index, packed);
+            else if (!tile.constant || memcmp(packed, tile.color, m_bpp) != 0)
+            {
+                if (!makeResident(index))
+                    continue;
+
+                tile.image->fillRect(sx0, sy0, sx1 - sx0, sy1 - sy0, col);
+                tile.dirty = true;
+            }
+        }
+    }
+}
+
+void skTiledImage::write(const skImage& src, const SKuint32 x, const SKuint32 y)
+{
+    if (!src.getBytes() || x >= m_width || y >= m_height)
+        return;
+
+    if (src.getFormat() == SK_INDEXED8)
+    {
+        skImage* rgba = src.convertToFormat(SK_RGBA);
+        if (rgba)
+            write(*rgba, x, y);
+        delete rgba;
+        return;
+    }
+
+    const SKuint32 x1 = x + skMin(src.getWidth(), m_width - x);
+    const SKuint32 y1 = y + skMin(src.getHeight(), m_height - y);
+
+    for (SKuint32 ty = y >> TileShift; ty <= (y1 - 1) >> TileShift; ++ty)
+    {
+        const SKuint32 oy  = ty << TileShift;
+        const SKuint32 sy0 = skMax(y, oy);
+        const SKuint32 sy1 = skMin(y1, oy + getTileHeight(ty));
+
+        for (SKuint32 tx = x >> TileShift; tx <= (x1 - 1) >> TileShift; ++tx)
+        {
+            const SKuint32 ox    = tx << TileShift;
+            const SKuint32 sx0   = skMax(x, ox);
+            const SKuint32 sx1   = skMin(x1, ox + getTileWidth(tx));
+            const SKuint32 index = ty * m_tilesX + tx;
+
+            if (!makeResident(index))
+                continue;
+
+            Tile& tile = m_tiles[index];
+            for (SKuint32 cy = sy0; cy < sy1; ++cy)
+            {
+                skImage::copy(getRow(*tile.image, sx0 - ox, cy - oy),
+                              getRow(src, sx0 - x, cy - y),
+                              sx1 - sx0,
+                              1,
+                              m_format,
+                              src.getFormat());
+            }
+            tile.dirty = true;
+        }
+    }
+}
+
+void skTiledImage::read(const skImage& dst, const SKuint32 x, const SKuint32 y)
+{
+    if (!dst.getBytes() || dst.getFormat() == SK_INDEXED8 || x >= m_width || y >= m_height)
+        return;
+
+    const SKuint32 x1 = x + skMin(dst.getWidth(), m_width - x);
+    const SKuint32 y1 = y + skMin(dst.getHeight(), m_height - y);
+
+    for (SKuint32 ty = y >> TileShift; ty <= (y1 - 1) >> TileShift; ++ty)
+    {
+        const SKuint32 oy  = ty << TileShift;
+        const SKuint32 sy0 = skMax(y, oy);
+        const SKuint32 sy1 = skMin(y1, oy + getTileHeight(ty));
+
+        for (SKuint32 tx = x >> TileShift; tx <= (x1 - 1) >> TileShift; ++tx)
+        {
+            const SKuint32 ox    = tx << TileShift;
+            const SKuint32 sx0   = skMax(x, ox);
+            const SKuint32 sx1   = skMin(x1, ox + getTileWidth(tx));
+            const SKuint32 index = ty * m_tilesX + tx;
+            const Tile&    tile  = m_tiles[index];
+
+            if (tile.constant)
+            {
+                SKubyte packed[MaxBPP];
+                skImage::copy(packed, tile.color, 1, 1, dst.getFormat(), m_format);
+
+                for (SKuint32 cy = sy0; cy < sy1; ++cy)
+                    ImageUtils::fillSpan(getRow(dst, sx0 - x, cy - y), sx1 - sx0, packed, dst.getBPP());
+                continue;
+            }
+
+            if (!makeResident(index))
+                continue;
+
+            for (SKuint32 cy = sy0; cy < sy1; ++cy)
+            {
+                skImage::copy(getRow(dst, sx0 - x, cy - y),
+                              getRow(*tile.image, sx0 - ox, cy - oy),
+                              sx1 - sx0,
+                              1,
+                              dst.getFormat(),
+                              m_format);
+            }
+        }
+    }
+}
+
+skTiledImage* skTiledImage::convertToFormat(const skPixelFormat format)
+{
+    skTiledImage* cpy = new skTiledImage(m_width, m_height, format);
+    cpy->setBudget(m_budget);
+
+    const SKuint32 count = m_tilesX * m_tilesY;
+    for (SKuint32 i = 0; i < count; ++i)
+    {
+        Tile& tile = m_tiles[i];
+        if (tile.constant)
+        {
+            SKubyte packed[MaxBPP] = {};
+            skImage::copy(packed, tile.color, 1, 1, cpy->m_format, m_format);
+            cpy->setConstant(i, packed);
+            continue;
+        }
+
+        if (!makeResident(i))
+            continue;
+
+        skImage* img = tile.image->convertToFormat(cpy->m_format);
+        if (!img)
+            continue;
+
+        const SKsize bytes = (SKsize)img->getPitch() * img->getHeight();
+        cpy->makeRoom(bytes);
+
+        Tile& dst    = cpy->m_tiles[i];
+        dst.image    = img;
+        dst.constant = false;
+        dst.dirty    = true;
+        cpy->m_resident += bytes;
+        cpy->link(i);
+    }
+    return cpy;
+}
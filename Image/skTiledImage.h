@@ -0,0 +1,206 @@
+/*
+-------------------------------------------------------------------------------
+    Copyright (c) Charles Carley.
+
+  This software is provided 'as-is', without any express or implied
+  warranty. In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+-------------------------------------------------------------------------------
+*/
+#ifndef _skTiledImage_h_
+#define _skTiledImage_h_
+
+#include <stdio.h>
+#include "Image/skPixel.h"
+#include "Utils/Config/skConfig.h"
+
+class skImage;
+
+// Stores a large canvas as fixed-size tiles. Tiles start out as a
+// constant color and only get pixels on their first write. Once the
+// resident tiles exceed the memory budget, the least recently used
+// ones are written to a scratch file and read back on demand.
+//
+// Each tile with pixels is an ordinary skImage, so lockTile gives
+// access to every skImage operation on that part of the canvas.
+// SK_INDEXED8 is not supported and is stored as SK_RGBA.
+class skTiledImage
+{
+public:
+    static const SKuint32 TileShift = 8;
+    static const SKuint32 TileSize  = 1 << TileShift;
+    static const SKuint32 MaxBPP    = 16;
+
+private:
+    struct Tile
+    {
+        skImage* image;
+        SKubyte  color[MaxBPP];
+        SKuint64 slot;
+        SKuint32 prev;
+        SKuint32 next;
+        SKuint32 locks;
+        bool     constant;
+        bool     dirty;
+    };
+
+    SKuint32      m_width;
+    SKuint32      m_height;
+    skPixelFormat m_format;
+    SKuint32      m_bpp;
+    SKuint32      m_tilesX;
+    SKuint32      m_tilesY;
+    Tile*         m_tiles;
+    SKuint32      m_head;
+    SKuint32      m_tail;
+    SKsize        m_budget;
+    SKsize        m_resident;
+    SKuint64      m_slots;
+    FILE*         m_scratch;
+
+    SKuint32 getTileWidth(SKuint32 tx) const;
+
+    SKuint32 getTileHeight(SKuint32 ty) const;
+
+    SKsize getTileBytes(const Tile& tile) const;
+
+    void link(SKuint32 index);
+
+    void unlink(SKuint32 index);
+
+    void touch(SKuint32 index);
+
+    void makeRoom(SKsize bytes);
+
+    bool pageOut(SKuint32 index);
+
+    bool makeResident(SKuint32 index);
+
+    void setConstant(SKuint32 index, const SKubyte* color);
+
+    Tile* acquire(SKuint32 x, SKuint32 y, SKuint32& index);
+
+    void packColor(SKubyte* dst, const skPixel& col) const;
+
+public:
+    skTiledImage(SKuint32 width, SKuint32 height, skPixelFormat format);
+    ~skTiledImage();
+
+    skTiledImage(const skTiledImage& rhs) = delete;
+    skTiledImage& operator=(const skTiledImage& rhs) = delete;
+
+    SKuint32 getWidth() const
+    {
+        return m_width;
+    }
+
+    SKuint32 getHeight() const
+    {
+        return m_height;
+    }
+
+    skPixelFormat getFormat() const
+    {
+        return m_format;
+    }
+
+    SKuint32 getBPP() const
+    {
+        return m_bpp;
+    }
+
+    SKuint32 getTilesX() const
+    {
+        return m_tilesX;
+    }
+
+    SKuint32 getTilesY() const
+    {
+        return m_tilesY;
+    }
+
+    // Bytes held by tiles that are in memory.
+    SKsize getResidentBytes() const
+    {
+        return m_resident;
+    }
+
+    // Tiles that are locked are never paged out, so the budget can
+    // be exceeded while they are held.
+    void setBudget(SKsize budget);
+
+    SKsize getBudget() const
+    {
+        return m_budget;
+    }
+
+    bool isConstantTile(SKuint32 tx, SKuint32 ty) const;
+
+    // Returns the pixels of one tile, giving it its own storage if
+    // it was constant. The tile stays in memory and is treated as
+    // modified until unlockTile is called.
+    skImage* lockTile(SKuint32 tx, SKuint32 ty);
+
+    void unlockTile(SKuint32 tx, SKuint32 ty);
+
+    void clear(const skPixel& col);
+
+    void setPixel(SKuint32 x, SKuint32 y, const skPixel& col);
+
+    void getPixel(SKuint32 x, SKuint32 y, skPixel& col);
+
+    // Tiles that are fully covered become constant instead of being
+    // filled.
+    void fillRect(SKuint32       x,
+                  SKuint32       y,
+                  SKuint32       width,
+                  SKuint32       height,
+                  const skPixel& col);
+
+    // Copies src onto the canvas at x, y, converting its format.
+    void write(const skImage& src, SKuint32 x, SKuint32 y);
+
+    // Fills dst with the part of the canvas that starts at x, y.
+    void read(const skImage& dst, SKuint32 x, SKuint32 y);
+
+    // Constant tiles stay constant in the copy.
+    skTiledImage* convertToFormat(skPixelFormat format);
+
+    // Calls fn(tile, x, y) for every tile with the tile locked, where
+    // x and y are the canvas position of its top left pixel. Locking
+    // gives a constant tile pixels, so constant tiles are skipped
+    // unless includeConstant is set.
+    template <typename Fn>
+    void forEachTile(const Fn& fn, const bool includeConstant = false)
+    {
+        for (SKuint32 ty = 0; ty < m_tilesY; ++ty)
+        {
+            for (SKuint32 tx = 0; tx < m_tilesX; ++tx)
+            {
+                if (!includeConstant && isConstantTile(tx, ty))
+                    continue;
+
+                skImage* tile = lockTile(tx, ty);
+                if (tile)
+                {
+                    fn(*tile, tx << TileShift, ty << TileShift);
+                    unlockTile(tx, ty);
+                }
+            }
+        }
+    }
+};
+
+#endif  //_skTiledImage_h_